@@ -0,0 +1,33 @@
+#!/bin/sh
+# how long the examples take from the command line to exit: on the bytecode
+# VM (-interp), and on the JIT (-run) with its object cache and without.
+# usage: bench/interp.sh [runs] [examples...], from the top directory, or
+# make bench. it fails when -interp prints something else than -run.
+# example/fibo.c alone takes minutes on the VM, for a second on the JIT
+runs=${1:-10}
+[ $# -gt 0 ] && shift
+examples=${*:-$(ls example/*.c)}
+now() { date +%s%N; }
+# milliseconds per run of "$@", with the output of the last in $out
+measure() {
+  begin=$(now)
+  i=0
+  while [ $i -lt $runs ]; do
+    "$@" > $out 2> /dev/null < /dev/null
+    i=$((i + 1))
+  done
+  awk -v ns=$(($(now) - begin)) -v n=$runs 'BEGIN { printf "%.3f", ns / n / 1e6 }'
+}
+out=$(mktemp) jit=$(mktemp)
+status=0
+printf '%-24s %12s %12s %12s\n' program '-run (cold)' -run -interp
+for f in $examples; do
+  cold=$(measure ./qcc -run -no-jit-cache $f)
+  warm=$(measure ./qcc -run $f)
+  grep -v '^warning: ' $out > $jit
+  vm=$(measure ./qcc -interp $f)
+  printf '%-24s %10s ms %10s ms %10s ms\n' $f $cold $warm $vm
+  grep -v '^warning: ' $out | cmp -s - $jit || { echo "$f: -interp and -run print different things"; status=1; }
+done
+rm -f $out $jit
+exit $status
@@ -1,11 +1,11 @@
 #include "ast.hpp"
 
-FunctionProtoAST::FunctionProtoAST(std::string _name, llvm::FunctionType *fty, int _stg):
-  stg(_stg), name(_name), func_type(fty) {
+FunctionProtoAST::FunctionProtoAST(std::string _name, llvm::FunctionType *fty, int _stg, int _attr):
+  stg(_stg), attr(_attr), name(_name), func_type(fty) {
 }
 
-FunctionDefAST::FunctionDefAST(std::string _name, llvm::FunctionType *fty, std::vector<std::string> _args, AST_vec _body, int _stg):
-  stg(_stg), name(_name), func_type(fty), args_name(_args), body(_body) {
+FunctionDefAST::FunctionDefAST(std::string _name, llvm::FunctionType *fty, std::vector<std::string> _args, AST_vec _body, int _stg, int _attr):
+  stg(_stg), attr(_attr), name(_name), func_type(fty), args_name(_args), body(_body) {
 }
 
 FunctionCallAST::FunctionCallAST(AST *_callee, AST_vec _args):
@@ -20,8 +20,8 @@ ArrayAST::ArrayAST(AST_vec _elems):
   elems(_elems) {
 }
 
-TypeCastAST::TypeCastAST(AST *_expr, llvm::Type *_cast_to):
-  expr(_expr), cast_to(_cast_to) {
+TypeCastAST::TypeCastAST(AST *_expr, llvm::Type *_cast_to, int _qual):
+  expr(_expr), cast_to(_cast_to), qual(_qual) {
 }
 
 UnaryAST::UnaryAST(std::string _op, AST *_expr, bool _postfix):
@@ -92,3 +92,71 @@ StringAST::StringAST(std::string _str):
   str(_str) {
 }
 
+static void collect(AST *st, std::unordered_set<AST *> &nodes, std::unordered_set<declarator_t *> &decls) {
+  if(!st || !nodes.insert(st).second) return;
+  auto all = [&](AST_vec &v) { for(auto s : v) collect(s, nodes, decls); };
+  switch(st->get_type()) {
+    case AST_FUNCTION_DEF:  all(((FunctionDefAST *)st)->body); break;
+    case AST_FUNCTION_CALL: collect(((FunctionCallAST *)st)->callee, nodes, decls);
+                            all(((FunctionCallAST *)st)->args); break;
+    case AST_BLOCK:         all(((BlockAST *)st)->body); break;
+    case AST_ARRAY:         all(((ArrayAST *)st)->elems); break;
+    case AST_TYPECAST:      collect(((TypeCastAST *)st)->expr, nodes, decls); break;
+    case AST_UNARY:         collect(((UnaryAST *)st)->expr, nodes, decls); break;
+    case AST_SIZEOF:        collect(((SizeofAST *)st)->expr, nodes, decls); break;
+    case AST_RETURN:        collect(((ReturnAST *)st)->expr, nodes, decls); break;
+    case AST_BINARY: {
+      BinaryAST *b = (BinaryAST *)st;
+      collect(b->lhs, nodes, decls), collect(b->rhs, nodes, decls);
+      break;
+    }
+    case AST_DOT: {
+      DotOpAST *d = (DotOpAST *)st;
+      collect(d->lhs, nodes, decls), collect(d->rhs, nodes, decls);
+      break;
+    }
+    case AST_INDEX: {
+      IndexAST *i = (IndexAST *)st;
+      collect(i->ary, nodes, decls), collect(i->idx, nodes, decls);
+      break;
+    }
+    case AST_ASGMT: {
+      AsgmtAST *a = (AsgmtAST *)st;
+      collect(a->dst, nodes, decls), collect(a->src, nodes, decls);
+      break;
+    }
+    case AST_TERNARY: {
+      TernaryAST *t = (TernaryAST *)st;
+      collect(t->cond, nodes, decls), collect(t->then_expr, nodes, decls), collect(t->else_expr, nodes, decls);
+      break;
+    }
+    case AST_IF: {
+      IfAST *i = (IfAST *)st;
+      collect(i->cond, nodes, decls), collect(i->b_then, nodes, decls), collect(i->b_else, nodes, decls);
+      break;
+    }
+    case AST_WHILE: {
+      WhileAST *w = (WhileAST *)st;
+      collect(w->cond, nodes, decls), collect(w->body, nodes, decls);
+      break;
+    }
+    case AST_FOR: {
+      ForAST *f = (ForAST *)st;
+      collect(f->init, nodes, decls), collect(f->cond, nodes, decls);
+      collect(f->reinit, nodes, decls), collect(f->body, nodes, decls);
+      break;
+    }
+    case AST_VAR_DECLARATION:
+      for(auto d : ((VarDeclarationAST *)st)->decls)
+        if(decls.insert(d).second) collect(d->init_expr, nodes, decls);
+      break;
+  }
+}
+
+void delete_ast(const AST_vec &ast) {
+  std::unordered_set<AST *> nodes;
+  std::unordered_set<declarator_t *> decls;
+  for(auto st : ast) collect(st, nodes, decls);
+  for(auto d : decls) delete d;
+  for(auto n : nodes) delete n;
+}
@@ -29,43 +29,77 @@ enum {
   AST_STRING,
 };
 
+enum FunctionAttr {
+  FUNC_ATTR_CONST = 1, // __attribute__((const))
+  FUNC_ATTR_PURE  = 2, // __attribute__((pure))
+};
+
+enum TypeQual {
+  QUAL_UNSIGNED = 1,
+  QUAL_CONST    = 2,
+  QUAL_VOLATILE = 4,
+};
+
+// C type of an expression. llvm types know nothing about signedness or
+// qualifiers, 'qual' applies to the scalar under any pointers and arrays.
+struct ctype_t {
+  ctype_t(llvm::Type *ty = nullptr, int q = 0):type(ty), qual(q) {};
+  llvm::Type *type;
+  int qual;
+  bool is_unsigned() const { return qual & QUAL_UNSIGNED; }
+};
+
 class AST {
   public:
+    virtual ~AST() {}
     virtual int get_type() const = 0;
+    // filled in by Sema for expressions. for 'return' it is the function's return type
+    ctype_t ctype;
+    bool is_lvalue = false;
 };
 
 typedef std::vector<AST *> AST_vec;
 
 struct argument_t {
-  argument_t(llvm::Type *ty, std::string nm):type(ty), name(nm) {};
+  argument_t(llvm::Type *ty, std::string nm, int q = 0):type(ty), name(nm), qual(q) {};
   llvm::Type *type;
   std::string name;
+  int qual;
 };
 
 class FunctionProtoAST : public AST {
   public:
-    int stg;
+    int stg, attr;
     std::string name;
     llvm::FunctionType *func_type;
+    int ret_qual = 0;
+    std::vector<int> args_qual;
+    int func_id = -1; // set by Sema
     virtual int get_type() const { return AST_FUNCTION_PROTO; };
-    FunctionProtoAST(std::string func_name, llvm::FunctionType *, int = 0);
+    FunctionProtoAST(std::string func_name, llvm::FunctionType *, int = 0, int = 0);
 };
 
 class FunctionDefAST : public AST {
   public:
-    int stg;
+    int stg, attr;
     std::string name;
     llvm::FunctionType *func_type;
     std::vector<std::string> args_name;
+    int ret_qual = 0;
+    std::vector<int> args_qual;
+    int func_id = -1; // set by Sema
+    std::deque<bool> args_escape; // set by Sema, see declarator_t::escapes
     AST_vec body;
     virtual int get_type() const { return AST_FUNCTION_DEF; };
-    FunctionDefAST(std::string, llvm::FunctionType *, std::vector<std::string>, AST_vec, int = 0);
+    FunctionDefAST(std::string, llvm::FunctionType *, std::vector<std::string>, AST_vec, int = 0, int = 0);
 };
 
 class FunctionCallAST : public AST {
   public:
     AST *callee;
     AST_vec args;
+    std::vector<ctype_t> args_type; // set by Sema: what each argument is converted to
+    int func_id = -1; // set by Sema when the callee is a function name, not a pointer
     virtual int get_type() const { return AST_FUNCTION_CALL; };
     FunctionCallAST(AST *callee, AST_vec args);
 };
@@ -88,8 +122,9 @@ class TypeCastAST : public AST {
   public:
     AST *expr;
     llvm::Type *cast_to;
+    int qual;
     virtual int get_type() const { return AST_TYPECAST; };
-    TypeCastAST(AST *, llvm::Type *);
+    TypeCastAST(AST *, llvm::Type *, int = 0);
 };
 
 class UnaryAST : public AST {
@@ -105,6 +140,7 @@ class BinaryAST : public AST {
   public:
     std::string op;
     AST *lhs, *rhs;
+    ctype_t conv; // set by Sema: both operands are converted to this before the operation
     virtual int get_type() const { return AST_BINARY; };
     BinaryAST(std::string, AST *, AST *);
 };
@@ -125,10 +161,12 @@ class DotOpAST : public AST {
 };
 
 struct declarator_t {
-  declarator_t(llvm::Type *ty, std::string nm, AST *init_exp = nullptr):type(ty), name(nm), init_expr(init_exp) {};
+  declarator_t(llvm::Type *ty, std::string nm, AST *init_exp = nullptr, int q = 0):type(ty), name(nm), init_expr(init_exp), qual(q) {};
   llvm::Type *type;
   std::string name;
   AST *init_expr = nullptr;
+  int qual;
+  bool escapes = false; // set by Sema: its address is taken, so it needs a stack slot
 };
 class VarDeclarationAST : public AST {
   public: 
@@ -149,6 +187,7 @@ class TypedefAST : public AST {
 class VariableAST : public AST {
   public:
     std::string name;
+    int func_id = -1; // set by Sema when the name is a function
     virtual int get_type() const { return AST_VARIABLE; };
     VariableAST(std::string);
 };
@@ -208,6 +247,7 @@ class ReturnAST : public AST {
 class SizeofAST : public AST {
   public:
     AST *expr;
+    llvm::Type *operand_type = nullptr; // set by Sema, arrays not decayed
     virtual int get_type() const { return AST_SIZEOF; };
     SizeofAST(AST *);
 };
@@ -230,3 +270,7 @@ class StringAST : public AST {
     virtual int get_type() const { return AST_STRING; }
     StringAST(std::string);
 };
+
+// frees top-level declarations and every node under them. the parser shares
+// nodes within a declaration ('a += b' uses 'a' twice), never between two
+void delete_ast(const AST_vec &);
@@ -1,36 +1,161 @@
 #include "codegen.hpp"
 #include "parse.hpp"
 
-llvm::LLVMContext context;
-llvm::IRBuilder<> builder(context);
-llvm::Module *mod;
-llvm::DataLayout *data_layout;
+thread_local unit_t *unit;
+
+llvm::TargetMachine *create_target_machine(int opt_level) {
+  static std::once_flag init; // registers targets, which isn't thread-safe
+  std::call_once(init, []() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+  std::string triple = llvm::sys::getDefaultTargetTriple(), err;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, err);
+  if(!target) error("error: %s", err.c_str());
+  // PIC, since the system linker may well make a PIE
+  return target->createTargetMachine(triple, llvm::sys::getHostCPUName(), "", 
+      llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::CodeModel::Default, codegen_opt_level(opt_level));
+}
+
+llvm::CodeGenOpt::Level codegen_opt_level(int opt_level) {
+  return opt_level == 0 ? llvm::CodeGenOpt::None : 
+         opt_level == 1 ? llvm::CodeGenOpt::Less :
+         opt_level == 2 ? llvm::CodeGenOpt::Default : llvm::CodeGenOpt::Aggressive;
+}
 
 void Codegen::run(AST_vec ast, std::string out_file_name, bool emit_llvm_ir) {
+  begin();
+  if(!incremental_db.empty()) reuse_functions(ast);
+  for(auto st : ast) {
+    statement(st);
+    generate_referenced();
+  }
+  if(!incremental_db.empty()) relink_functions();
+  finish(out_file_name, emit_llvm_ir);
+}
+
+// under unit->types_lock, which a function takes a statement at a time
+void Codegen::generate(AST *st) {
+  if(st->get_type() == AST_FUNCTION_DEF) statement(st);
+  else {
+    types_guard guard;
+    statement(st);
+  }
+  generate_referenced();
+}
+
+bool Codegen::is_pending(const std::string &name) {
+  func_t *f = func_list.get(name);
+  return f && f->pending;
+}
+
+void Codegen::begin() {
+  types_guard guard; // the parser is running already under -pipeline
   { // create function(s) used in array initialization
     llvm::FunctionType *llvm_func_type_memcpy = 
       llvm::FunctionType::get(
-          builder.getVoidTy(),
+          unit->builder.getVoidTy(),
           std::vector<llvm::Type *>{
-          builder.getInt8PtrTy(), 
-          builder.getInt8PtrTy(),
-          builder.getInt32Ty(),
-          builder.getInt32Ty(),
-          builder.getInt1Ty()}, /*var arg=*/false);
+          unit->builder.getInt8PtrTy(), 
+          unit->builder.getInt8PtrTy(),
+          unit->builder.getInt32Ty(),
+          unit->builder.getInt32Ty(),
+          unit->builder.getInt1Ty()}, /*var arg=*/false);
     tool_memcpy = llvm::Function::Create(llvm_func_type_memcpy, 
-        llvm::Function::ExternalLinkage, "llvm.memcpy.p0i8.p0i8.i32", mod);
+        llvm::Function::ExternalLinkage, "llvm.memcpy.p0i8.p0i8.i32", unit->mod);
   }
-  for(auto st : ast) statement(st);
-  if(emit_llvm_ir) mod->dump();
+}
+
+void Codegen::finish(const std::string &out_file_name, bool emit_llvm_ir) {
+  // -emit-ir wants the whole module, so it stays on one thread
+  if(jobs > 1 && !emit_llvm_ir && (output == OUTPUT_BITCODE || output == OUTPUT_OBJ)
+      && run_sharded(out_file_name)) return;
+  optimize();
+  if(emit_llvm_ir) unit->mod->dump();
+  if(output == OUTPUT_NONE) return;
+  if(output == OUTPUT_ASM) 
+    return emit_native(out_file_name, llvm::TargetMachine::CGFT_AssemblyFile);
+  if(output == OUTPUT_OBJ) 
+    return emit_native(out_file_name, llvm::TargetMachine::CGFT_ObjectFile);
   std::error_code EC;
   llvm::raw_fd_ostream out(out_file_name, EC, llvm::sys::fs::OpenFlags::F_RW);
-  llvm::WriteBitcodeToFile(mod, out);
+  llvm::WriteBitcodeToFile(unit->mod, out);
+}
+
+// what llc does, on the module in memory
+void Codegen::emit_native(const std::string &out_file_name, llvm::TargetMachine::CodeGenFileType type) {
+  std::error_code EC;
+  llvm::raw_fd_ostream out(out_file_name, EC, llvm::sys::fs::F_None);
+  if(EC) error("error: can't write '%s': %s", out_file_name.c_str(), EC.message().c_str());
+  ::emit_native(*unit->mod, out, type);
+}
+
+void emit_native(llvm::Module &m, llvm::raw_pwrite_stream &out, llvm::TargetMachine::CodeGenFileType type) {
+  llvm::legacy::PassManager pm;
+  if(unit->target_machine->addPassesToEmitFile(pm, out, type)) 
+    error("error: the target can't emit this type of file");
+  pm.run(m);
+}
+
+// the pipeline of 'opt -O<n>', run in process on the finished module
+void Codegen::optimize() {
+  if(time_report) llvm::TimePassesIsEnabled = true;
+  optimize_module(*unit->mod, unit->target_machine, opt_level, size_level);
+  if(time_report) llvm::TimerGroup::printAll(llvm::errs());
+}
+
+// what the target says about the cost of instructions, for the vectorizers
+// and the unrollers. without it they assume a generic machine
+static void add_target_info(llvm::legacy::PassManagerBase &pm, llvm::TargetMachine *tm) {
+  if(tm) pm.add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+}
+
+// touches nothing but m, its context and tm, so shards can run it on their
+// own threads, each with a target machine of its own
+void optimize_module(llvm::Module &m, llvm::TargetMachine *tm, int opt_level, int size_level) {
+  if(opt_level == 0 && size_level == 0) return;
+
+  llvm::PassManagerBuilder pmb; // owns the inliner and library info
+  pmb.OptLevel = opt_level;
+  pmb.SizeLevel = size_level;
+  pmb.Inliner = opt_level > 1 ? 
+    llvm::createFunctionInliningPass(opt_level, size_level) : llvm::createAlwaysInlinerPass();
+  // as opt does: only -Oz goes without
+  pmb.LoopVectorize = pmb.SLPVectorize = opt_level > 1 && size_level < 2;
+  std::string triple = m.getTargetTriple();
+  pmb.LibraryInfo = new llvm::TargetLibraryInfoImpl(
+      llvm::Triple(triple.empty() ? llvm::sys::getDefaultTargetTriple() : triple));
+
+  llvm::legacy::FunctionPassManager fpm(&m);
+  add_target_info(fpm, tm);
+  pmb.populateFunctionPassManager(fpm);
+  fpm.doInitialization();
+  for(auto &f : m) fpm.run(f);
+  fpm.doFinalization();
+
+  llvm::legacy::PassManager mpm;
+  add_target_info(mpm, tm);
+  pmb.populateModulePassManager(mpm);
+  mpm.run(m);
+}
+
+void optimize_whole_program(llvm::Module &m, llvm::TargetMachine *tm, int opt_level, int size_level) {
+  llvm::PassManagerBuilder pmb;
+  pmb.OptLevel = opt_level;
+  pmb.SizeLevel = size_level;
+  pmb.Inliner = llvm::createFunctionInliningPass(opt_level, size_level);
+  pmb.LoopVectorize = pmb.SLPVectorize = size_level < 2;
+  pmb.LibraryInfo = new llvm::TargetLibraryInfoImpl(llvm::Triple(m.getTargetTriple()));
+  llvm::legacy::PassManager pm;
+  add_target_info(pm, tm);
+  pmb.populateLTOPassManager(pm);
+  pm.run(m);
 }
 
 llvm::AllocaInst *Codegen::create_entry_alloca(llvm::Function *TheFunction, std::string &VarName, llvm::Type *type) {
   llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
       TheFunction->getEntryBlock().begin());
-  return TmpB.CreateAlloca(type == nullptr ? llvm::Type::getInt32Ty(context) : type, 0, VarName.c_str());
+  return TmpB.CreateAlloca(type == nullptr ? llvm::Type::getInt32Ty(unit->context) : type, 0, VarName.c_str());
 }
 
 llvm::Value *Codegen::type_cast(llvm::Value *val, llvm::Type *to) {
@@ -38,13 +163,49 @@ llvm::Value *Codegen::type_cast(llvm::Value *val, llvm::Type *to) {
     llvm::IntegerType *ival = (llvm::IntegerType *)val->getType();
     llvm::IntegerType *ito  = (llvm::IntegerType *)to;
     if(ival->getBitWidth() < ito->getBitWidth()) 
-      return builder.CreateZExtOrBitCast(val, to);
+      return unit->builder.CreateZExtOrBitCast(val, to);
   } else if(val->getType()->isIntegerTy() && to->isDoubleTy()) {
-    return builder.CreateSIToFP(val, to);
+    return unit->builder.CreateSIToFP(val, to);
   } else if(val->getType()->isDoubleTy() && to->isIntegerTy()) {
-    return builder.CreateFPToSI(val, to);
+    return unit->builder.CreateFPToSI(val, to);
   } else if(to->isVoidTy()) return val;
-  return builder.CreateTruncOrBitCast(val, to);
+  return unit->builder.CreateTruncOrBitCast(val, to);
+}
+
+// the conversion of a value of Sema's type 'from' to 'to'.
+// aggregates are left alone, asgmt_value copies them.
+llvm::Value *Codegen::convert(llvm::Value *val, ctype_t from, ctype_t to) {
+  llvm::Type *ty = to.type;
+  if(!val || !ty || ty->isVoidTy() || val->getType() == ty) return val;
+  llvm::Type *vty = val->getType();
+  if(!vty->isSingleValueType() || !ty->isSingleValueType()) return val;
+  // truth values are 0 or 1
+  bool from_unsigned = from.is_unsigned() || vty->isIntegerTy(1);
+  if(vty->isIntegerTy() && ty->isIntegerTy()) {
+    if(vty->getIntegerBitWidth() > ty->getIntegerBitWidth())
+      return unit->builder.CreateTrunc(val, ty);
+    return from_unsigned ? unit->builder.CreateZExt(val, ty) : unit->builder.CreateSExt(val, ty);
+  } else if(vty->isIntegerTy() && ty->isFloatingPointTy()) {
+    return from_unsigned ? unit->builder.CreateUIToFP(val, ty) : unit->builder.CreateSIToFP(val, ty);
+  } else if(vty->isFloatingPointTy() && ty->isIntegerTy()) {
+    return to.is_unsigned() ? unit->builder.CreateFPToUI(val, ty) : unit->builder.CreateFPToSI(val, ty);
+  } else if(vty->isFloatingPointTy() && ty->isFloatingPointTy()) {
+    return unit->builder.CreateFPCast(val, ty);
+  } else if(vty->isIntegerTy() && ty->isPointerTy()) {
+    return unit->builder.CreateIntToPtr(val, ty);
+  } else if(vty->isPointerTy() && ty->isIntegerTy()) {
+    return unit->builder.CreatePtrToInt(val, ty);
+  }
+  return type_cast(val, ty);
+}
+
+// 'val != 0' as i1, for conditions
+llvm::Value *Codegen::to_bool(llvm::Value *val) {
+  llvm::Type *ty = val->getType();
+  if(ty->isIntegerTy(1)) return val;
+  if(ty->isFloatingPointTy())
+    return unit->builder.CreateFCmpUNE(val, llvm::ConstantFP::get(ty, 0.0));
+  return unit->builder.CreateICmpNE(val, llvm::Constant::getNullValue(ty));
 }
 
 llvm::Value *Codegen::statement(AST *st) {
@@ -100,144 +261,165 @@ llvm::Value *Codegen::statement(AST *st) {
 }
 
 llvm::Value *Codegen::statement(FunctionProtoAST *st) {
-  func_t func;
-  func.name = st->name;
-  func.ret_type = st->func_type->getReturnType();
-  this->func_list.add(func);
-  func_t *function = this->func_list.get(func.name);
-  
-  llvm::FunctionType *llvm_func_type = st->func_type;
-  llvm::Function *llvm_func = 
-    llvm::Function::Create(llvm_func_type, 
-        st->stg == STG_STATIC ? llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage, func.name, mod);
-  function->llvm_function = llvm_func;
-
+  func_t *function = this->func_list.add(st->name, st->func_id);
+  if(function->type) return nullptr; // declared again
+  function->ret_type = st->func_type->getReturnType();
+  function->type = st->func_type;
+  function->is_static = st->stg == STG_STATIC;
   return nullptr;
 }
 
+llvm::Function *Codegen::declare(func_t *f) {
+  if(!f->llvm_function)
+    f->llvm_function = llvm::Function::Create(f->type, 
+        f->is_static ? llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage, f->name, unit->mod);
+  return f->llvm_function;
+}
+
+// f, declared if it wasn't. a static function defined already is generated
+// after the current top-level declaration, by generate_referenced()
+llvm::Function *Codegen::function_of(func_t *f) {
+  if(!f->llvm_function && f->pending) referenced.push_back(f);
+  return declare(f);
+}
+
+// outside of any function, since statement(FunctionDefAST *) starts afresh.
+// they may refer to more, which come after them
+void Codegen::generate_referenced() {
+  for(size_t i = 0; i < referenced.size(); i++)
+    statement(referenced[i]->pending);
+  referenced.clear();
+}
+
 llvm::Value *Codegen::statement(FunctionDefAST *st) {
-  func_t func;
+  types_guard guard;
+  if(reused.count(st)) { // unchanged since the last -incremental compilation
+    FunctionProtoAST proto(st->name, st->func_type, st->stg, st->attr);
+    proto.func_id = st->func_id;
+    statement(&proto);
+    declare(func_list.get(st->name)); // its IR is linked in by name
+    return nullptr;
+  }
   // if prototype exists, use it instead
-  func_t *proto = this->func_list.get(st->name);
-  if(proto) func = *proto;
-  else {
-    func.name = st->name;
-    func.ret_type = st->func_type->getReturnType();
+  func_t *function = this->func_list.add(st->name, st->func_id);
+  if(!function->type) {
+    function->ret_type = st->func_type->getReturnType();
+    function->type = st->func_type;
+    function->is_static = st->stg == STG_STATIC;
   }
-  func.args_name = st->args_name;
+  // -incremental keeps every function, so that it may be reused
+  if(function->is_static && !function->llvm_function && incremental_db.empty()) {
+    function->pending = st;
+    return nullptr;
+  }
+  function->pending = nullptr;
+  function->args_name = st->args_name;
 
-  func.block_list.create_new_block();
+  symbols.enter_function();
   int i = 0;
-  for(auto arg : st->args_name) {
-    func.block_list.get_varlist()->add(var_t(
-          arg, st->func_type->getFunctionParamType(i++)));
-  }
-  this->func_list.add(func);
-  func_t *function = this->func_list.get(func.name);
-
-  if(!proto) {
-    llvm::FunctionType *llvm_func_type = st->func_type;
-    llvm::Function *llvm_func = llvm::Function::Create(llvm_func_type, 
-        st->stg == STG_STATIC ? llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage, func.name, mod);
-    function->llvm_function = llvm_func;
-  }
+  for(auto arg : st->args_name)
+    symbols.add(arg, st->func_type->getFunctionParamType(i++));
+
+  declare(function);
 
   { // create function body
-    llvm::BasicBlock *entry = llvm::BasicBlock::Create(context, "entry", function->llvm_function);
-    builder.SetInsertPoint(entry);
+    llvm::BasicBlock *entry = llvm::BasicBlock::Create(unit->context, "entry", function->llvm_function);
+    unit->builder.SetInsertPoint(entry);
     
     cur_func = function;
+    reset_ssa();
     // auto llvm_args_type_it = function->llvm_function->arg_begin();
     auto args_name_it = function->args_name.begin();
+    size_t arg_no = 0;
     for(auto arg_it = function->llvm_function->arg_begin(); arg_it != function->llvm_function->arg_end(); ++arg_it) {
       arg_it->setName(*args_name_it);
-      llvm::AllocaInst *ainst = create_entry_alloca(function->llvm_function, *args_name_it, arg_it->getType());
-      builder.CreateStore(&*arg_it, ainst);
       var_t *v = lookup_var(*args_name_it);
-      if(v) v->val = ainst;
-      args_name_it++;
+      bool escapes = arg_no >= st->args_escape.size() || st->args_escape[arg_no];
+      if(v && !escapes && arg_it->getType()->isSingleValueType()) {
+        v->ssa = true;
+        write_var(v, entry, &*arg_it);
+      } else {
+        llvm::AllocaInst *ainst = create_entry_alloca(function->llvm_function, *args_name_it, arg_it->getType());
+        unit->builder.CreateStore(&*arg_it, ainst);
+        if(v) v->val = ainst;
+      }
+      args_name_it++, arg_no++;
     }
 
 
-    for(auto stmt : st->body)
+    for(auto stmt : st->body) {
+      guard.yield(); // to the parser, under -pipeline
       statement(stmt);
+    }
     for(auto it = cur_func->llvm_function->getBasicBlockList().begin(); 
         it != cur_func->llvm_function->getBasicBlockList().end(); ++it) {
       auto term = !it->empty();
       if(term) term = it->back().isTerminator();
       if(!term) {
-        printf("warning: in function '%s': expected termination instruction such as 'return'\n", function->name.c_str());
+        warning("warning: in function '%s': expected termination instruction such as 'return'", function->name.c_str());
         if(function->llvm_function->getReturnType()->isVoidTy())
-          builder.CreateRetVoid();
+          unit->builder.CreateRetVoid();
         else {
           auto ret_type = function->llvm_function->getReturnType();
           if(ret_type->isDoubleTy())
-            builder.CreateRet(llvm::ConstantFP::get(builder.getDoubleTy(), 0.0));
+            unit->builder.CreateRet(llvm::ConstantFP::get(unit->builder.getDoubleTy(), 0.0));
           else // ptr, int ...
-            builder.CreateRet(make_int(0, ret_type));
+            unit->builder.CreateRet(make_int(0, ret_type));
         }
       }
     }
     cur_func = nullptr;
   }
+  reset_ssa();
+  symbols.leave_function();
 
   return nullptr;
 }
 
 llvm::Value *Codegen::statement(BlockAST *st) {
-  this->cur_func->block_list.create_new_block();
+  symbols.push_scope();
   for(auto a : st->body) 
     statement(a);
-  this->cur_func->block_list.escape_block();
+  symbols.pop_scope();
   return nullptr;
 }
 
 llvm::Value *Codegen::statement(FunctionCallAST *st) {
-  llvm::Function *f = st->callee->get_type() == AST_VARIABLE ? // function ptr or function name
-    [&]() -> llvm::Function * {
-      VariableAST *va = static_cast<VariableAST *>(st->callee);
-      func_t *func = this->func_list.get(va->name);
-      if(!func) { // not function, it is variable of function pointer
-        auto var = lookup_var(va->name);
-        if(!var) error("error: not found the function \'%s\'", va->name.c_str());
-        return (llvm::Function *)builder.CreateLoad(var->val);
-      } else return func->llvm_function; 
-    }() : reinterpret_cast<llvm::Function *>( statement(st->callee) );
-
-  int params = f->getType()->getPointerElementType()->getFunctionNumParams();
+  // Sema resolved a function name to its id, anything else is a function pointer
+  func_t *func = this->func_list.get(st->func_id);
+  llvm::Value *f = func ? function_of(func) : statement(st->callee);
+
   std::vector<llvm::Value *> caller_args;
-  int i = 0;
-  for(auto a : st->args) {
-    caller_args.push_back(
-        params <= i ? statement(a) : // varaible argument                                    
-        type_cast(statement(a), f->getType()->getPointerElementType()->getFunctionParamType(i++))
-        );
-  } 
+  for(size_t i = 0; i < st->args.size(); i++) // Sema has promoted variable arguments
+    caller_args.push_back(convert(statement(st->args[i]), st->args[i]->ctype, st->args_type[i]));
   auto callee = f;
-  auto ret = builder.CreateCall((llvm::Value *)callee, caller_args);
+  auto ret = unit->builder.CreateCall((llvm::Value *)callee, caller_args);
   return ret;
 }
 
-void Codegen::create_var(var_t v, llvm::Value *init_val) {
-  cur_func->block_list.get_varlist()->add(v);
-  auto cur_var = lookup_var(v.name);
-  if(!cur_var) error("error: not found variable '%s'", v.name.c_str());
+// a scalar whose address is never taken gets no stack slot, see ssa.cpp
+void Codegen::create_var(const std::string &name, llvm::Type *type, llvm::Value *init_val, bool escapes) {
+  var_t *cur_var = symbols.add(name, type);
+  if(!escapes && type->isSingleValueType()) {
+    cur_var->ssa = true;
+    if(init_val) store_var(cur_var, init_val);
+    return;
+  }
   // get begin of current basic block
   llvm::IRBuilder<> B = [&]() -> llvm::IRBuilder<> {
     if(cur_func->llvm_function->begin()->empty())
       return llvm::IRBuilder<>(&*cur_func->llvm_function->begin());
     else return llvm::IRBuilder<>(&*cur_func->llvm_function->begin()->begin());
   }();
-  cur_var->val = B.CreateAlloca(cur_var->type, nullptr, cur_var->name);
+  cur_var->val = B.CreateAlloca(cur_var->type, nullptr, name);
   if(init_val) 
     asgmt_value(cur_var->val, init_val);
 }
 
-void Codegen::create_global_var(var_t v, int stg, AST *init_val) {
-  global_var.add(v);
-  auto cur_var = lookup_var(v.name);
-  mod->getOrInsertGlobal(v.name, v.type);
-  llvm::GlobalVariable *gv = mod->getNamedGlobal(v.name);
+void Codegen::create_global_var(const std::string &name, llvm::Type *type, int stg, AST *init_val) {
+  var_t *cur_var = symbols.add(name, type);
+  unit->mod->getOrInsertGlobal(name, type);
+  llvm::GlobalVariable *gv = unit->mod->getNamedGlobal(name);
   if(init_val) {
     auto c = constinit_global_var(gv, init_val);
     gv->setInitializer(c);
@@ -313,7 +495,7 @@ llvm::Constant *Codegen::constinit_global_var(llvm::GlobalVariable *gv, AST *ini
         error("error: initialization of global variables must be constant");
     }
   } else {
-    auto expr = type_cast(statement(init_expr), varty);
+    auto expr = convert(statement(init_expr), init_expr->ctype, ctype_t(varty));
     if(llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(expr)) 
       return c;
     else 
@@ -326,13 +508,12 @@ llvm::Constant *Codegen::constinit_global_var(llvm::GlobalVariable *gv, AST *ini
 llvm::Value *Codegen::statement(VarDeclarationAST *st) {
   for(auto v : st->decls) {
     llvm::Value *init_val = nullptr;
-    if(v->init_expr) init_val = statement(v->init_expr);
-    // int a[] = {1, 2}; -->> int a[2] = {1, 2};
-    if(v->type->isPointerTy() && init_val && init_val->getType()->isArrayTy()) v->type = init_val->getType();
+    // Sema has already turned 'int a[] = {1, 2};' into 'int a[2] = {1, 2};'
+    if(v->init_expr) init_val = convert(statement(v->init_expr), v->init_expr->ctype, ctype_t(v->type, v->qual));
     if(cur_func == nullptr) { // global 
-      create_global_var(var_t(v->name, v->type), st->stg, v->init_expr);
+      create_global_var(v->name, v->type, st->stg, v->init_expr);
     } else {
-      create_var(var_t(v->name, v->type), init_val);
+      create_var(v->name, v->type, init_val, v->escapes);
     }
   }
   return nullptr;
@@ -340,77 +521,67 @@ llvm::Value *Codegen::statement(VarDeclarationAST *st) {
 
 llvm::Value *Codegen::statement(BreakAST *st) {
   cur_func->br_list.top() = true;
-  return builder.CreateBr(cur_func->break_list.top());
+  return unit->builder.CreateBr(cur_func->break_list.top());
 }
 llvm::Value *Codegen::statement(ContinueAST *st) {
   cur_func->br_list.top() = true;
-  return builder.CreateBr(cur_func->continue_list.top());
+  return unit->builder.CreateBr(cur_func->continue_list.top());
 }
 
 llvm::Value *Codegen::statement(IfAST *st) {
-  llvm::Value *val_cond = statement(st->cond);
-  val_cond = builder.CreateICmpNE(
-      val_cond, 
-      val_cond->getType()->isPointerTy() ?
-      llvm::ConstantPointerNull::getNullValue(val_cond->getType()) :
-      make_int(0, val_cond->getType()));
+  llvm::Value *val_cond = to_bool(statement(st->cond));
 
-  auto *func = builder.GetInsertBlock()->getParent();
+  auto *func = unit->builder.GetInsertBlock()->getParent();
 
-  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(context, "then", func);
-  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(context, "else");
-  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(context, "merge");
+  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(unit->context, "then", func);
+  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(unit->context, "else");
+  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(unit->context, "merge");
 
-  builder.CreateCondBr(val_cond, bb_then, bb_else);
-  builder.SetInsertPoint(bb_then);
+  unit->builder.CreateCondBr(val_cond, bb_then, bb_else);
+  unit->builder.SetInsertPoint(bb_then);
 
   bool necessary_merge = false, has_br;
   cur_func->br_list.push(false);
   if(st->b_then) statement(st->b_then);
   if(cur_func->br_list.top());
-  else builder.CreateBr(bb_merge), necessary_merge = true;
+  else unit->builder.CreateBr(bb_merge), necessary_merge = true;
   has_br = cur_func->br_list.top();
   cur_func->br_list.pop();
   if(!cur_func->br_list.empty()) cur_func->br_list.top() = has_br;
-  bb_then = builder.GetInsertBlock();
+  bb_then = unit->builder.GetInsertBlock();
 
   func->getBasicBlockList().push_back(bb_else);
-  builder.SetInsertPoint(bb_else);
+  unit->builder.SetInsertPoint(bb_else);
 
   cur_func->br_list.push(false);
   if(st->b_else) statement(st->b_else);
   if(cur_func->br_list.top());
-  else builder.CreateBr(bb_merge), necessary_merge = true;
+  else unit->builder.CreateBr(bb_merge), necessary_merge = true;
   has_br = cur_func->br_list.top();
   cur_func->br_list.pop();
   if(!cur_func->br_list.empty()) cur_func->br_list.top() = has_br;
-  bb_else = builder.GetInsertBlock();
+  bb_else = unit->builder.GetInsertBlock();
 
   if(necessary_merge) {
     func->getBasicBlockList().push_back(bb_merge);
-    builder.SetInsertPoint(bb_merge);
+    unit->builder.SetInsertPoint(bb_merge);
   }
   
   return nullptr;
 }
 
 llvm::Value *Codegen::statement(WhileAST *st) {
-  llvm::BasicBlock *bb_before_loop = llvm::BasicBlock::Create(context, "before_loop", cur_func->llvm_function);
-  llvm::BasicBlock *bb_loop = llvm::BasicBlock::Create(context, "loop", cur_func->llvm_function);
-  llvm::BasicBlock *bb_after_loop = llvm::BasicBlock::Create(context, "after_loop", cur_func->llvm_function);
+  llvm::BasicBlock *bb_before_loop = create_unsealed_block("before_loop", cur_func->llvm_function);
+  llvm::BasicBlock *bb_loop = llvm::BasicBlock::Create(unit->context, "loop", cur_func->llvm_function);
+  llvm::BasicBlock *bb_after_loop = create_unsealed_block("after_loop", cur_func->llvm_function);
 
-  builder.CreateBr(bb_before_loop);
+  unit->builder.CreateBr(bb_before_loop);
 
-  builder.SetInsertPoint(bb_before_loop);
-  llvm::Value *val_cond_1 = statement(st->cond);
-  llvm::Value *first_val_cond = builder.CreateICmpNE(
-      val_cond_1, 
-      val_cond_1->getType()->isPointerTy() ?
-      llvm::ConstantPointerNull::getNullValue(val_cond_1->getType()) :
-      llvm::ConstantInt::get(val_cond_1->getType(), 0, true));
-  builder.CreateCondBr(first_val_cond, bb_loop, bb_after_loop);
+  unit->builder.SetInsertPoint(bb_before_loop);
+  llvm::Value *first_val_cond = to_bool(statement(st->cond));
+  unit->builder.CreateCondBr(first_val_cond, bb_loop, bb_after_loop);
 
-  builder.SetInsertPoint(bb_loop);
+  unit->builder.SetInsertPoint(bb_loop);
 
   cur_func->break_list.push(bb_after_loop);
   cur_func->continue_list.push(bb_before_loop);
@@ -418,48 +589,48 @@ llvm::Value *Codegen::statement(WhileAST *st) {
   cur_func->break_list.pop();
   cur_func->continue_list.pop();
 
-  builder.CreateBr(bb_before_loop);
+  unit->builder.CreateBr(bb_before_loop);
+  seal_block(bb_before_loop);
+  seal_block(bb_after_loop);
 
-  builder.SetInsertPoint(bb_after_loop);
+  unit->builder.SetInsertPoint(bb_after_loop);
 
   return nullptr;
 }
 
 llvm::Value *Codegen::statement(ForAST *st) {
-  auto func = builder.GetInsertBlock()->getParent();
-  llvm::BasicBlock *bb_before_loop = llvm::BasicBlock::Create(context, "before_loop", func);
-  llvm::BasicBlock *bb_loop = llvm::BasicBlock::Create(context, "loop", func);
-  llvm::BasicBlock *bb_step = llvm::BasicBlock::Create(context, "loop_step", func);
-  llvm::BasicBlock *bb_after_loop = llvm::BasicBlock::Create(context, "after_loop", func);
+  auto func = unit->builder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *bb_before_loop = create_unsealed_block("before_loop", func);
+  llvm::BasicBlock *bb_loop = llvm::BasicBlock::Create(unit->context, "loop", func);
+  llvm::BasicBlock *bb_step = create_unsealed_block("loop_step", func);
+  llvm::BasicBlock *bb_after_loop = create_unsealed_block("after_loop", func);
 
   if(st->init) statement(st->init);
 
-  builder.CreateBr(bb_before_loop);
-  builder.SetInsertPoint(bb_before_loop);
+  unit->builder.CreateBr(bb_before_loop);
+  unit->builder.SetInsertPoint(bb_before_loop);
   if(st->cond) {
-    auto val_cond = statement(st->cond);
-    llvm::Value *first_val_cond = builder.CreateICmpNE(
-        val_cond, 
-        val_cond->getType()->isPointerTy() ?
-        llvm::ConstantPointerNull::getNullValue(val_cond->getType()) :
-        llvm::ConstantInt::get(val_cond->getType(), 0, true));
-    builder.CreateCondBr(first_val_cond, bb_loop, bb_after_loop);
-  } else builder.CreateBr(bb_loop);
-  builder.SetInsertPoint(bb_loop);
+    llvm::Value *first_val_cond = to_bool(statement(st->cond));
+    unit->builder.CreateCondBr(first_val_cond, bb_loop, bb_after_loop);
+  } else unit->builder.CreateBr(bb_loop);
+  unit->builder.SetInsertPoint(bb_loop);
 
   cur_func->break_list.push(bb_after_loop);
   cur_func->continue_list.push(bb_step);
   statement(st->body);
   cur_func->break_list.pop();
   cur_func->continue_list.pop();
-  builder.CreateBr(bb_step);
+  unit->builder.CreateBr(bb_step);
+  seal_block(bb_step);
 
-  builder.SetInsertPoint(bb_step);
+  unit->builder.SetInsertPoint(bb_step);
   if(st->reinit) statement(st->reinit);
 
-  builder.CreateBr(bb_before_loop);
+  unit->builder.CreateBr(bb_before_loop);
+  seal_block(bb_before_loop);
+  seal_block(bb_after_loop);
 
-  builder.SetInsertPoint(bb_after_loop);
+  unit->builder.SetInsertPoint(bb_after_loop);
 
   return nullptr;
 }
@@ -467,9 +638,9 @@ llvm::Value *Codegen::statement(ForAST *st) {
 llvm::Value *Codegen::statement(ReturnAST *st) {
   if(!cur_func->br_list.empty()) cur_func->br_list.top() = true;
   if(st->expr) 
-    return builder.CreateRet(type_cast(statement(st->expr), cur_func->llvm_function->getReturnType()));
+    return unit->builder.CreateRet(convert(statement(st->expr), st->expr->ctype, st->ctype));
   else
-    return builder.CreateRetVoid();
+    return unit->builder.CreateRetVoid();
 }
 
 llvm::Value *Codegen::statement(VariableAST *st) {
@@ -480,14 +651,14 @@ llvm::Value *Codegen::statement(VariableAST *st) {
       llvm::Value *elem = llvm::GetElementPtrInst::CreateInBounds(
           a, 
           std::vector<llvm::Value *>{
-            llvm::ConstantInt::get(builder.getInt32Ty(), 0), 
-            llvm::ConstantInt::get(builder.getInt32Ty(), 0)}, "elem", builder.GetInsertBlock());
+            llvm::ConstantInt::get(unit->builder.getInt32Ty(), 0), 
+            llvm::ConstantInt::get(unit->builder.getInt32Ty(), 0)}, "elem", unit->builder.GetInsertBlock());
       return elem;
     } else 
-      return builder.CreateLoad(var->val);
+      return load_var(var);
   } else { // function name?
-    auto f = func_list.get(st->name);
-    if(f) return f->llvm_function;
+    auto f = func_list.get(st->func_id);
+    if(f) return function_of(f);
   }
   error("error: not found variable '%s'", st->name.c_str());
   return nullptr;
@@ -498,6 +669,7 @@ llvm::Value *Codegen::get_value(AST *st) {
     VariableAST *va = (VariableAST *)st;
     auto cur_var = lookup_var(va->name);
     if(!cur_var) error("error: not found variable '%s'", va->name.c_str());
+    if(cur_var->ssa) error("error: in codegen: '%s' has no address", va->name.c_str());
     return cur_var->val;
   } else if(st->get_type() == AST_INDEX) {
     IndexAST *vidx = (IndexAST *)st;
@@ -510,7 +682,7 @@ llvm::Value *Codegen::get_value(AST *st) {
     return get_element_ptr((IndexAST *)st);
   } else if(st->get_type() == AST_DOT) {
     DotOpAST *da = (DotOpAST *)st;
-    std::string expected_name = ((VariableAST *)da->rhs)->name;
+    const std::string &expected_name = ((VariableAST *)da->rhs)->name;
     auto parent = statement(da->lhs);
     if(!parent->getType()->isPointerTy())
       parent = get_value(da->lhs);
@@ -528,24 +700,17 @@ llvm::Value *Codegen::get_value(AST *st) {
   return nullptr;
 }
 
-llvm::Value *Codegen::get_value_struct(llvm::Value *parent, struct_t *sinfo, std::string elem_name) {
-  int member_count = 0;
-  for(auto m : sinfo->members_name) {
-    if(m == elem_name) break;
-    member_count++;
-  }
-  return builder.CreateStructGEP(parent->getType()->getPointerElementType(), parent, member_count);
+llvm::Value *Codegen::get_value_struct(llvm::Value *parent, struct_t *sinfo, const std::string &elem_name) {
+  const member_t *m = sinfo->member(elem_name);
+  if(!m) error("error: not found element '%s' in struct '%s'", 
+      elem_name.c_str(), sinfo->name.c_str());
+  return unit->builder.CreateStructGEP(parent->getType()->getPointerElementType(), parent, m->index);
 }
-llvm::Value *Codegen::get_value_union(llvm::Value *parent, union_t *uinfo, std::string elem_name) {
-  llvm::Type *member_type = nullptr;
-  for(auto m : uinfo->members) {
-    if(m.name == elem_name) {
-      member_type = m.type;
-      break;
-    }
-  } if(member_type == nullptr) error("error: not found element '%s' in union '%s'", 
+llvm::Value *Codegen::get_value_union(llvm::Value *parent, union_t *uinfo, const std::string &elem_name) {
+  const member_t *m = uinfo->member(elem_name);
+  if(!m) error("error: not found element '%s' in union '%s'", 
       elem_name.c_str(), uinfo->name.c_str());
-  return type_cast(parent, member_type->getPointerTo());
+  return type_cast(parent, m->type->getPointerTo());
 }
 
 llvm::Constant *Codegen::create_const_array(std::vector<llvm::Constant *> elems, int size) {
@@ -563,12 +728,12 @@ llvm::Value *Codegen::get_element_ptr(IndexAST *st) {
     VariableAST *va = (VariableAST *)st->ary;
     auto v = lookup_var(va->name);
     if(!v) error("error: not found variable '%s'", va->name.c_str());
-    a = v->type->isPointerTy() ? ptr = true, builder.CreateLoad(v->val) : v->val;
+    a = v->type->isPointerTy() ? ptr = true, load_var(v) : v->val;
   } else if(st->ary->get_type() == AST_INDEX) {
     a = get_element_ptr((IndexAST *)st->ary);
     if(!a->getType()->getArrayElementType()->isArrayTy()) {
       ptr = true;
-      a = builder.CreateLoad(a);
+      a = unit->builder.CreateLoad(a);
     }
   } else {
     a = statement(st->ary);
@@ -579,12 +744,12 @@ llvm::Value *Codegen::get_element_ptr(IndexAST *st) {
     elem = llvm::GetElementPtrInst::CreateInBounds(
         a, 
         llvm::ArrayRef<llvm::Value *>(
-        statement(st->idx)), "elem", builder.GetInsertBlock());
+        statement(st->idx)), "elem", unit->builder.GetInsertBlock());
   } else {
     elem = llvm::GetElementPtrInst::CreateInBounds(
         a, 
-        llvm::ArrayRef<llvm::Value *>{llvm::ConstantInt::get(builder.getInt32Ty(), 0), 
-        statement(st->idx)}, "elem", builder.GetInsertBlock());
+        llvm::ArrayRef<llvm::Value *>{llvm::ConstantInt::get(unit->builder.getInt32Ty(), 0), 
+        statement(st->idx)}, "elem", unit->builder.GetInsertBlock());
   }
   return elem;
 }
@@ -592,45 +757,40 @@ llvm::Value *Codegen::get_element_ptr(IndexAST *st) {
 llvm::Value *Codegen::asgmt_value(llvm::Value *dst, llvm::Value *src) {
   if(dst->getType()->getPointerElementType()->isArrayTy()) {
     if(src->getType()->isArrayTy() && llvm::dyn_cast<llvm::Constant>(src)) {
-      // if src is constant array, copy it to global variable
-      std::string name = []() -> std::string { 
-        std::string str;
-        int len = 8; while(len--)
-          str += (rand() % 26) + 65;
-        return str;
-      }();
-      mod->getOrInsertGlobal("const_ary."+name, src->getType());
-      llvm::GlobalVariable *gv = mod->getNamedGlobal("const_ary."+name);
-      gv->setInitializer((llvm::Constant *)src);
-      src = gv;
+      // if src is constant array, copy it to global variable.
+      // llvm numbers the names, so they are the same in every run
+      src = new llvm::GlobalVariable(*unit->mod, src->getType(), /*constant=*/true,
+          llvm::GlobalValue::PrivateLinkage, (llvm::Constant *)src, "const_ary");
     }
 
-    return builder.CreateCall(tool_memcpy,
+    return unit->builder.CreateCall(tool_memcpy,
         std::vector<llvm::Value *> {
-          type_cast(dst, builder.getInt8Ty()->getPointerTo()), type_cast(src, builder.getInt8Ty()->getPointerTo()), 
-          make_int(data_layout->getTypeAllocSize(src->getType()->getPointerElementType())),
-          make_int(data_layout->getTypeAllocSize(
+          type_cast(dst, unit->builder.getInt8Ty()->getPointerTo()), type_cast(src, unit->builder.getInt8Ty()->getPointerTo()), 
+          make_int(unit->data_layout->getTypeAllocSize(src->getType()->getPointerElementType())),
+          make_int(unit->data_layout->getTypeAllocSize(
             [&]() -> llvm::Type * {
                 auto basety = src->getType()->getPointerElementType();
                 while(basety->isArrayTy()) basety = basety->getArrayElementType();
                 return basety;
-            }())), make_int(0, builder.getInt1Ty())});
+            }())), make_int(0, unit->builder.getInt1Ty())});
   } else 
     src = this->type_cast(src, dst->getType()->getPointerElementType());
-  return builder.CreateStore(src, dst);
+  return unit->builder.CreateStore(src, dst);
 }
 
 llvm::Value *Codegen::statement(AsgmtAST *st) {
-  auto src = statement(st->src);
+  auto src = convert(statement(st->src), st->src->ctype, st->ctype);
+  if(var_t *v = ssa_var(st->dst))
+    return store_var(v, src);
   llvm::Value *dst = nullptr;
   dst = get_value(st->dst);
   asgmt_value(dst, src);
-  return builder.CreateLoad(dst);
+  return unit->builder.CreateLoad(dst);
 }
 
 llvm::Value *Codegen::statement(IndexAST *st) {
   auto elem = get_element_ptr(st);
-  return builder.CreateLoad(elem);
+  return unit->builder.CreateLoad(elem);
 }
 
 llvm::Value *Codegen::make_int(int n, llvm::Type *ty) {
@@ -639,223 +799,187 @@ llvm::Value *Codegen::make_int(int n, llvm::Type *ty) {
   return llvm::ConstantInt::get(ty, n);
 }
 
-#define IMPLICIT_CAST \
-  if(lhs->getType()->isDoubleTy()) \
-    rhs = type_cast(rhs, builder.getDoubleTy()); \
-  else if(rhs->getType()->isDoubleTy()) \
-    lhs = type_cast(lhs, builder.getDoubleTy());
-
+// the operands are of the same type, converted by the caller.
+// only pointer arithmetic mixes a pointer and an integer.
 llvm::Value *Codegen::op_add(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
   if(lhs->getType()->isPointerTy() && rhs->getType()->isIntegerTy()) {
     return llvm::GetElementPtrInst::CreateInBounds(
         lhs, 
-        llvm::ArrayRef<llvm::Value *>(rhs), "elem", builder.GetInsertBlock());
+        llvm::ArrayRef<llvm::Value *>(rhs), "elem", unit->builder.GetInsertBlock());
   } else if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateAdd(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateAdd(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFAdd(lhs, rhs);
+    return unit->builder.CreateFAdd(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 }
 llvm::Value *Codegen::op_sub(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
   if(lhs->getType()->isPointerTy() && rhs->getType()->isIntegerTy()) {
     return llvm::GetElementPtrInst::CreateInBounds(lhs,
         llvm::ArrayRef<llvm::Value *>(
-          builder.CreateSub(make_int(0, rhs->getType()), rhs)), "elem", builder.GetInsertBlock());
+          unit->builder.CreateSub(make_int(0, rhs->getType()), rhs)), "elem", unit->builder.GetInsertBlock());
   } else if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateSub(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateSub(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFSub(lhs, rhs);
+    return unit->builder.CreateFSub(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 }
 llvm::Value *Codegen::op_mul(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateMul(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateMul(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFMul(lhs, rhs);
+    return unit->builder.CreateFMul(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_div(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
+llvm::Value *Codegen::op_div(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateSDiv(lhs, type_cast(rhs, lhs->getType()));
+    return is_unsigned ? unit->builder.CreateUDiv(lhs, rhs) : unit->builder.CreateSDiv(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFDiv(lhs, rhs);
+    return unit->builder.CreateFDiv(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_rem(llvm::Value *lhs, llvm::Value *rhs) {
+llvm::Value *Codegen::op_rem(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateSRem(lhs, type_cast(rhs, lhs->getType()));
+    return is_unsigned ? unit->builder.CreateURem(lhs, rhs) : unit->builder.CreateSRem(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_and(llvm::Value *lhs, llvm::Value *rhs) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateAnd(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateAnd(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_land(AST *lhs, AST *rhs) {
-  auto lhs_val = statement(lhs);
-  auto cond_val = builder.CreateICmpNE(
-      lhs_val,
-      lhs_val->getType()->isPointerTy() ?
-      llvm::ConstantPointerNull::getNullValue(lhs_val->getType()) :
-      make_int(0, lhs_val->getType()));
-  auto *func = builder.GetInsertBlock()->getParent();
-
-  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(context, "then", func);
-  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(context, "else", func);
-  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(context, "merge",func);
-
-  builder.CreateCondBr(cond_val, bb_then, bb_else);
-  builder.SetInsertPoint(bb_then);
+  auto cond_val = to_bool(statement(lhs));
+  auto *func = unit->builder.GetInsertBlock()->getParent();
+
+  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(unit->context, "then", func);
+  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(unit->context, "else", func);
+  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(unit->context, "merge",func);
+
+  unit->builder.CreateCondBr(cond_val, bb_then, bb_else);
+  unit->builder.SetInsertPoint(bb_then);
     // lhs is TRUE
-    auto rhs_val = statement(rhs);
-    cond_val = builder.CreateICmpNE(
-        rhs_val,
-        rhs_val->getType()->isPointerTy() ?
-        llvm::ConstantPointerNull::getNullValue(rhs_val->getType()) :
-        make_int(0, rhs_val->getType()));
+    cond_val = to_bool(statement(rhs));
     auto lhs_rhs_true = cond_val; // lhs is already true, cond_val means rhs is true or not.
-    builder.CreateBr(bb_merge);
-  bb_then = builder.GetInsertBlock();
-  builder.SetInsertPoint(bb_else);
+    unit->builder.CreateBr(bb_merge);
+  bb_then = unit->builder.GetInsertBlock();
+  unit->builder.SetInsertPoint(bb_else);
     // lhs is FALSE
-    builder.CreateBr(bb_merge);
-  bb_else = builder.GetInsertBlock();
+    unit->builder.CreateBr(bb_merge);
+  bb_else = unit->builder.GetInsertBlock();
 
-  builder.SetInsertPoint(bb_merge);
+  unit->builder.SetInsertPoint(bb_merge);
 
-  llvm::PHINode *pnode = builder.CreatePHI(builder.getInt1Ty(), 2);
+  llvm::PHINode *pnode = unit->builder.CreatePHI(unit->builder.getInt1Ty(), 2);
   pnode->addIncoming(lhs_rhs_true, bb_then);
-  pnode->addIncoming(make_int(false, builder.getInt1Ty()), bb_else);
+  pnode->addIncoming(make_int(false, unit->builder.getInt1Ty()), bb_else);
   return pnode;
 }
 llvm::Value *Codegen::op_or(llvm::Value *lhs, llvm::Value *rhs) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateOr(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateOr(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_lor(AST *lhs, AST *rhs) {
-  auto lhs_val = statement(lhs);
-  auto cond_val = builder.CreateICmpNE(
-      lhs_val,
-      lhs_val->getType()->isPointerTy() ?
-      llvm::ConstantPointerNull::getNullValue(lhs_val->getType()) :
-      make_int(0, lhs_val->getType()));
-  auto *func = builder.GetInsertBlock()->getParent();
-
-  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(context, "then", func);
-  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(context, "else", func);
-  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(context, "merge",func);
-
-  builder.CreateCondBr(cond_val, bb_then, bb_else);
-  builder.SetInsertPoint(bb_then);
+  auto cond_val = to_bool(statement(lhs));
+  auto *func = unit->builder.GetInsertBlock()->getParent();
+
+  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(unit->context, "then", func);
+  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(unit->context, "else", func);
+  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(unit->context, "merge",func);
+
+  unit->builder.CreateCondBr(cond_val, bb_then, bb_else);
+  unit->builder.SetInsertPoint(bb_then);
     // lhs is TRUE
-    builder.CreateBr(bb_merge);
-  bb_then = builder.GetInsertBlock();
-  builder.SetInsertPoint(bb_else);
+    unit->builder.CreateBr(bb_merge);
+  bb_then = unit->builder.GetInsertBlock();
+  unit->builder.SetInsertPoint(bb_else);
     // lhs is FALSE
-    auto rhs_val = statement(rhs);
-    cond_val = builder.CreateICmpNE(
-        rhs_val,
-        rhs_val->getType()->isPointerTy() ?
-        llvm::ConstantPointerNull::getNullValue(rhs_val->getType()) :
-        make_int(0, rhs_val->getType()));
+    cond_val = to_bool(statement(rhs));
     auto lhs_rhs_false = cond_val; // lhs is already false, cond_val means rhs is false or not.
-    builder.CreateBr(bb_merge);
-  bb_else = builder.GetInsertBlock();
+    unit->builder.CreateBr(bb_merge);
+  bb_else = unit->builder.GetInsertBlock();
 
-  builder.SetInsertPoint(bb_merge);
+  unit->builder.SetInsertPoint(bb_merge);
 
-  llvm::PHINode *pnode = builder.CreatePHI(builder.getInt1Ty(), 2);
-  pnode->addIncoming(make_int(true, builder.getInt1Ty()), bb_then);
+  llvm::PHINode *pnode = unit->builder.CreatePHI(unit->builder.getInt1Ty(), 2);
+  pnode->addIncoming(make_int(true, unit->builder.getInt1Ty()), bb_then);
   pnode->addIncoming(lhs_rhs_false, bb_else);
   return pnode;
 } 
 llvm::Value *Codegen::op_xor(llvm::Value *lhs, llvm::Value *rhs) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateXor(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateXor(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_shl(llvm::Value *lhs, llvm::Value *rhs) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateShl(lhs, type_cast(rhs, lhs->getType()));
+    return unit->builder.CreateShl(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_shr(llvm::Value *lhs, llvm::Value *rhs) {
+llvm::Value *Codegen::op_shr(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
   if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateAShr(lhs, type_cast(rhs, lhs->getType()));
+    return is_unsigned ? unit->builder.CreateLShr(lhs, rhs) : unit->builder.CreateAShr(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_eq(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpEQ(lhs, type_cast(rhs, lhs->getType()));
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return unit->builder.CreateICmpEQ(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpOEQ(lhs, rhs);
+    return unit->builder.CreateFCmpOEQ(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 llvm::Value *Codegen::op_ne(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpNE(lhs, type_cast(rhs, lhs->getType()));
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return unit->builder.CreateICmpNE(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpONE(lhs, rhs);
+    return unit->builder.CreateFCmpONE(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_lt(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpSLT(lhs, type_cast(rhs, lhs->getType()));
+llvm::Value *Codegen::op_lt(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return is_unsigned ? unit->builder.CreateICmpULT(lhs, rhs) : unit->builder.CreateICmpSLT(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpOLT(lhs, rhs);
+    return unit->builder.CreateFCmpOLT(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_gt(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpSGT(lhs, type_cast(rhs, lhs->getType()));
+llvm::Value *Codegen::op_gt(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return is_unsigned ? unit->builder.CreateICmpUGT(lhs, rhs) : unit->builder.CreateICmpSGT(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpOGT(lhs, rhs);
+    return unit->builder.CreateFCmpOGT(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_le(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpSLE(lhs, type_cast(rhs, lhs->getType()));
+llvm::Value *Codegen::op_le(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return is_unsigned ? unit->builder.CreateICmpULE(lhs, rhs) : unit->builder.CreateICmpSLE(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpOLE(lhs, rhs);
+    return unit->builder.CreateFCmpOLE(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
-llvm::Value *Codegen::op_ge(llvm::Value *lhs, llvm::Value *rhs) {
-  IMPLICIT_CAST;
-  if(lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
-    return builder.CreateICmpSGE(lhs, type_cast(rhs, lhs->getType()));
+llvm::Value *Codegen::op_ge(llvm::Value *lhs, llvm::Value *rhs, bool is_unsigned) {
+  if(lhs->getType()->isIntegerTy() || lhs->getType()->isPointerTy()) {
+    return is_unsigned ? unit->builder.CreateICmpUGE(lhs, rhs) : unit->builder.CreateICmpSGE(lhs, rhs);
   } else if(lhs->getType()->isDoubleTy()) {
-    return builder.CreateFCmpOGE(lhs, rhs);
+    return unit->builder.CreateFCmpOGE(lhs, rhs);
   } else error("error: unknown operation");
   return nullptr;
 } 
 
-#undef IMPLICIT_CAST
-
 llvm::Value *Codegen::statement(ArrayAST *st) {
   std::vector<llvm::Constant *> const_elems;
   for(auto e : st->elems) 
@@ -864,9 +988,15 @@ llvm::Value *Codegen::statement(ArrayAST *st) {
 }
 
 llvm::Value *Codegen::statement(TypeCastAST *st) {
-  if(!st->cast_to->isVoidTy())
-    return type_cast(statement(st->expr), st->cast_to);
-  return nullptr;
+  auto v = statement(st->expr);
+  if(st->cast_to->isVoidTy()) return nullptr;
+  return convert(v, st->expr->ctype, st->ctype);
+}
+
+// 1 of the type of 'ty', a pointer steps by one element
+llvm::Value *Codegen::make_one(llvm::Type *ty) {
+  if(ty->isDoubleTy()) return llvm::ConstantFP::get(ty, 1.0);
+  return make_int(1, ty->isPointerTy() ? unit->builder.getInt32Ty() : ty);
 }
 
 llvm::Value *Codegen::statement(UnaryAST *st) {
@@ -874,31 +1004,24 @@ llvm::Value *Codegen::statement(UnaryAST *st) {
     return get_value(st->expr);
   } else if(st->op == "*") {
     auto e = statement(st->expr);
-    return builder.CreateLoad(e);
+    return unit->builder.CreateLoad(e);
   } else if(st->op == "-") {
-    return op_sub(make_int(0), statement(st->expr));
-  } else if(st->op == "++") {
-    auto v1 = get_value(st->expr);
-    auto v  = builder.CreateLoad(v1);
-    auto vv = op_add(v, make_int(1));
-    asgmt_value(v1, vv);
-    return st->postfix ? v : vv;
-  } else if(st->op == "--") {
-    auto v1 = get_value(st->expr);
-    auto v  = builder.CreateLoad(v1);
-    auto vv = op_sub(v, make_int(1));
-    asgmt_value(v1, vv);
+    auto v = convert(statement(st->expr), st->expr->ctype, st->ctype);
+    return op_sub(llvm::Constant::getNullValue(v->getType()), v);
+  } else if(st->op == "++" || st->op == "--") {
+    var_t *sv = ssa_var(st->expr);
+    auto v1 = sv ? nullptr : get_value(st->expr);
+    auto v  = sv ? load_var(sv) : unit->builder.CreateLoad(v1);
+    auto vv = st->op == "++" ? op_add(v, make_one(v->getType())) : op_sub(v, make_one(v->getType()));
+    if(sv) store_var(sv, vv);
+    else asgmt_value(v1, vv);
     return st->postfix ? v : vv;
   } else if(st->op == "!") {
-    auto v = statement(st->expr);
-    return type_cast(
-        builder.CreateXor(
-          builder.CreateICmpNE(v, make_int(0, v->getType())),
-          make_int(1, builder.getInt1Ty())), 
-        v->getType());
+    auto v = unit->builder.CreateNot(to_bool(statement(st->expr)));
+    return convert(v, ctype_t(v->getType()), st->ctype);
   } else if(st->op == "~") {
-    auto v = statement(st->expr);
-    return builder.CreateXor(v, make_int(-1, v->getType()));
+    auto v = convert(statement(st->expr), st->expr->ctype, st->ctype);
+    return unit->builder.CreateXor(v, make_int(-1, v->getType()));
   }
   return nullptr;
 }
@@ -910,8 +1033,10 @@ llvm::Value *Codegen::statement(BinaryAST *st) {
   } else if(st->op == "||") {
     return op_lor(st->lhs, st->rhs);
   } else {
-    auto lhs = statement(st->lhs),
-         rhs = statement(st->rhs);
+    // Sema's usual arithmetic conversions; conv is empty for pointer arithmetic
+    auto lhs = convert(statement(st->lhs), st->lhs->ctype, st->conv),
+         rhs = convert(statement(st->rhs), st->rhs->ctype, st->conv);
+    bool is_unsigned = st->conv.is_unsigned() || (st->conv.type && st->conv.type->isPointerTy());
     if(st->op == "+") {
       return op_add(lhs, rhs);
     } else if(st->op == "-") {
@@ -919,25 +1044,25 @@ llvm::Value *Codegen::statement(BinaryAST *st) {
     } else if(st->op == "*") {
       return op_mul(lhs, rhs);
     } else if(st->op == "/") {
-      return op_div(lhs, rhs);
+      return op_div(lhs, rhs, is_unsigned);
     } else if(st->op == "%") {
-      return op_rem(lhs, rhs);
+      return op_rem(lhs, rhs, is_unsigned);
     } else if(st->op == "<<") {
       return op_shl(lhs, rhs);
     } else if(st->op == (">>")) {
-      return op_shr(lhs, rhs);
+      return op_shr(lhs, rhs, is_unsigned);
     } else if(st->op == "==") {
       return op_eq(lhs, rhs);
     } else if(st->op == "!=") {
       return op_ne(lhs, rhs);
     } else if(st->op == "<=") {
-      return op_le(lhs, rhs);
+      return op_le(lhs, rhs, is_unsigned);
     } else if(st->op == (">=")) {
-      return op_ge(lhs, rhs);
+      return op_ge(lhs, rhs, is_unsigned);
     } else if(st->op == "<") {
-      return op_lt(lhs, rhs);
+      return op_lt(lhs, rhs, is_unsigned);
     } else if(st->op == (">")) {
-      return op_gt(lhs, rhs);
+      return op_gt(lhs, rhs, is_unsigned);
     } else if(st->op == "&") {
       return op_and(lhs, rhs);
     } else if(st->op == "|") {
@@ -950,40 +1075,35 @@ llvm::Value *Codegen::statement(BinaryAST *st) {
 }
 
 llvm::Value *Codegen::statement(TernaryAST *st) {
-  llvm::Value *val_cond = statement(st->cond);
-  val_cond = builder.CreateICmpNE(
-      val_cond, 
-      val_cond->getType()->isPointerTy() ?
-      llvm::ConstantPointerNull::getNullValue(val_cond->getType()) :
-      make_int(0, val_cond->getType()));
+  llvm::Value *val_cond = to_bool(statement(st->cond));
 
-  auto *func = builder.GetInsertBlock()->getParent();
+  auto *func = unit->builder.GetInsertBlock()->getParent();
 
-  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(context, "then", func);
-  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(context, "else", func);
-  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(context, "merge",func);
+  llvm::BasicBlock *bb_then = llvm::BasicBlock::Create(unit->context, "then", func);
+  llvm::BasicBlock *bb_else = llvm::BasicBlock::Create(unit->context, "else", func);
+  llvm::BasicBlock *bb_merge= llvm::BasicBlock::Create(unit->context, "merge",func);
 
-  builder.CreateCondBr(val_cond, bb_then, bb_else);
-  builder.SetInsertPoint(bb_then);
+  unit->builder.CreateCondBr(val_cond, bb_then, bb_else);
+  unit->builder.SetInsertPoint(bb_then);
 
-  bool ret_void = false;
+  bool ret_void = st->ctype.type->isVoidTy();
 
-  auto val_then = statement(st->then_expr);
+  auto val_then = convert(statement(st->then_expr), st->then_expr->ctype, st->ctype);
   if(!val_then) ret_void = true;
-  builder.CreateBr(bb_merge);
-  bb_then = builder.GetInsertBlock();
+  unit->builder.CreateBr(bb_merge);
+  bb_then = unit->builder.GetInsertBlock();
 
-  builder.SetInsertPoint(bb_else);
+  unit->builder.SetInsertPoint(bb_else);
 
-  auto val_else = statement(st->else_expr);
+  auto val_else = convert(statement(st->else_expr), st->else_expr->ctype, st->ctype);
   if(!val_else) ret_void = true;
-  builder.CreateBr(bb_merge);
-  bb_else = builder.GetInsertBlock();
+  unit->builder.CreateBr(bb_merge);
+  bb_else = unit->builder.GetInsertBlock();
 
-  builder.SetInsertPoint(bb_merge);
+  unit->builder.SetInsertPoint(bb_merge);
 
   if(!ret_void) {
-    llvm::PHINode *pnode = builder.CreatePHI(val_then->getType(), 2);
+    llvm::PHINode *pnode = unit->builder.CreatePHI(val_then->getType(), 2);
     pnode->addIncoming(val_then, bb_then);
     pnode->addIncoming(val_else, bb_else);
     return pnode;
@@ -992,36 +1112,25 @@ llvm::Value *Codegen::statement(TernaryAST *st) {
 }
 
 llvm::Value *Codegen::statement(DotOpAST *st) {
-  return builder.CreateLoad(get_value(st));
+  return unit->builder.CreateLoad(get_value(st));
 }
 
 llvm::Value *Codegen::statement(SizeofAST *st) {
-  // sizeof(EXPR), EXPR is not evaluated
-  llvm::Type *t;
-  auto bgn = builder.GetInsertBlock()->getInstList().size();
-  auto s = statement(st->expr);
-  auto end = builder.GetInsertBlock()->getInstList().size();
-  for(size_t i = 0; i < (end-bgn); i++)
-    builder.GetInsertBlock()->getInstList().back().eraseFromParent();
-  t = s->getType();
-
-  return make_int(data_layout->getTypeAllocSize(t));
+  // sizeof(EXPR), EXPR is not evaluated. Sema knows its type
+  return make_int(unit->data_layout->getTypeAllocSize(st->operand_type));
 }
 
 llvm::Value *Codegen::statement(StringAST *st) {
-  return builder.CreateGlobalStringPtr(st->str);
+  return unit->builder.CreateGlobalStringPtr(st->str);
 }
 
 llvm::Value *Codegen::statement(NumberAST *st) {
   if(st->is_float) {
-    return llvm::ConstantFP::get(builder.getDoubleTy(), st->f_number);
+    return llvm::ConstantFP::get(unit->builder.getDoubleTy(), st->f_number);
   } else 
     return make_int(st->i_number);
 }
 
-var_t *Codegen::lookup_var(std::string name) {
-  var_t *v = nullptr;
-  if(cur_func) v = cur_func->block_list.lookup_var(name);
-  if(!v) return global_var.get(name);
-  return v;
+var_t *Codegen::lookup_var(const std::string &name) {
+  return symbols.lookup(name);
 }
@@ -4,41 +4,82 @@
 #include "ast.hpp"
 #include "func.hpp"
 #include "struct.hpp"
+#include "unit.hpp"
 
-extern llvm::LLVMContext context;
-extern llvm::IRBuilder<> builder;
-extern llvm::Module *mod;
-extern llvm::DataLayout *data_layout;
+// what Codegen::run writes
+enum OutputKind {
+  OUTPUT_NONE, // -run, the module stays in memory for the JIT
+  OUTPUT_BITCODE,
+  OUTPUT_ASM, // -S
+  OUTPUT_OBJ, // -c
+};
+
+// for the host, see Codegen::emit_native()
+llvm::TargetMachine *create_target_machine(int opt_level);
+llvm::CodeGenOpt::Level codegen_opt_level(int opt_level);
+// machine code for m, by unit->target_machine
+void emit_native(llvm::Module &m, llvm::raw_pwrite_stream &, llvm::TargetMachine::CodeGenFileType);
+// the -O<n> pipeline, see Codegen::optimize()
+// with what tm tells about the target, when there's one
+void optimize_module(llvm::Module &, llvm::TargetMachine *, int opt_level, int size_level);
+// what 'opt -std-link-opts' does, for a module of the whole program whose
+// symbols are internal but for its entry points
+void optimize_whole_program(llvm::Module &, llvm::TargetMachine *, int opt_level, int size_level);
 
 class Codegen {
   private:
     FunctionList func_list;
     std::map<std::string, llvm::Type *> typedef_map;
-    VariableList global_var;
+    SymbolTable symbols;
     func_t *cur_func = nullptr;
 
     llvm::Function *tool_memcpy;
 
+    // SSA construction, see ssa.cpp
+    std::unordered_map<llvm::BasicBlock *, std::unordered_map<var_t *, llvm::WeakVH>> current_def;
+    std::set<llvm::BasicBlock *> unsealed;
+    std::map<llvm::BasicBlock *, std::vector<std::pair<var_t *, llvm::PHINode *>>> incomplete_phis;
+    llvm::BasicBlock *create_unsealed_block(const std::string &, llvm::Function *);
+    void seal_block(llvm::BasicBlock *);
+    void reset_ssa();
+    void write_var(var_t *, llvm::BasicBlock *, llvm::Value *);
+    llvm::Value *read_var(var_t *, llvm::BasicBlock *);
+    llvm::Value *read_var_recursive(var_t *, llvm::BasicBlock *);
+    llvm::Value *add_phi_operands(var_t *, llvm::PHINode *);
+    llvm::Value *try_remove_trivial_phi(llvm::PHINode *);
+    var_t *ssa_var(AST *);
+    llvm::Value *load_var(var_t *);
+    llvm::Value *store_var(var_t *, llvm::Value *);
+
     llvm::Value *op_add(llvm::Value *, llvm::Value *);
     llvm::Value *op_sub(llvm::Value *, llvm::Value *);
     llvm::Value *op_mul(llvm::Value *, llvm::Value *);
-    llvm::Value *op_div(llvm::Value *, llvm::Value *);
-    llvm::Value *op_rem(llvm::Value *, llvm::Value *);
+    llvm::Value *op_div(llvm::Value *, llvm::Value *, bool is_unsigned);
+    llvm::Value *op_rem(llvm::Value *, llvm::Value *, bool is_unsigned);
     llvm::Value *op_and(llvm::Value *, llvm::Value *);
     llvm::Value *op_or (llvm::Value *, llvm::Value *);
     llvm::Value *op_xor(llvm::Value *, llvm::Value *);
     llvm::Value *op_shl(llvm::Value *, llvm::Value *);
-    llvm::Value *op_shr(llvm::Value *, llvm::Value *);
+    llvm::Value *op_shr(llvm::Value *, llvm::Value *, bool is_unsigned);
     llvm::Value *op_eq (llvm::Value *, llvm::Value *);
     llvm::Value *op_ne (llvm::Value *, llvm::Value *);
-    llvm::Value *op_lt (llvm::Value *, llvm::Value *);
-    llvm::Value *op_gt (llvm::Value *, llvm::Value *);
-    llvm::Value *op_le (llvm::Value *, llvm::Value *);
-    llvm::Value *op_ge (llvm::Value *, llvm::Value *);
+    llvm::Value *op_lt (llvm::Value *, llvm::Value *, bool is_unsigned);
+    llvm::Value *op_gt (llvm::Value *, llvm::Value *, bool is_unsigned);
+    llvm::Value *op_le (llvm::Value *, llvm::Value *, bool is_unsigned);
+    llvm::Value *op_ge (llvm::Value *, llvm::Value *, bool is_unsigned);
     llvm::Value *op_land(AST *, AST *);
     llvm::Value *op_lor (AST *, AST *);
 
-    llvm::Value *make_int(int, llvm::Type * = builder.getInt32Ty());
+    // functions are declared in the module when they're first referenced,
+    // and static ones generated then: a header's prototypes and static
+    // functions cost nothing unless they're used
+    std::vector<func_t *> referenced; // static definitions to generate
+    llvm::Function *declare(func_t *);
+    llvm::Function *function_of(func_t *);
+    void generate_referenced();
+
+    llvm::Value *make_int(int, llvm::Type * = unit->builder.getInt32Ty());
+    llvm::Value *make_one(llvm::Type *);
 
     llvm::Value *statement(AST *                 ); 
     llvm::Value *statement(FunctionDefAST *      ); 
@@ -69,19 +110,45 @@ class Codegen {
     llvm::Type *get_base_type(llvm::Type *);
     llvm::Constant *constinit_global_var(llvm::GlobalVariable *gv, AST *init_expr);
     llvm::ConstantStruct *to_rectype_initializer(AST *ary, llvm::StructType *);
-    llvm::Value *get_value_struct(llvm::Value *, struct_t *, std::string);
-    llvm::Value *get_value_union(llvm::Value *, union_t *, std::string);
-    void create_var(var_t v, llvm::Value * = nullptr);
-    void create_global_var(var_t v, int /*storage ty*/, AST * = nullptr);
+    llvm::Value *get_value_struct(llvm::Value *, struct_t *, const std::string &);
+    llvm::Value *get_value_union(llvm::Value *, union_t *, const std::string &);
+    void create_var(const std::string &, llvm::Type *, llvm::Value * = nullptr, bool escapes = true);
+    void create_global_var(const std::string &, llvm::Type *, int /*storage ty*/, AST * = nullptr);
     llvm::Constant *create_const_array(std::vector<llvm::Constant *>, int = 0);
     llvm::Value *get_element_ptr(IndexAST *      ); 
     llvm::Value *get_value(AST *                 ); 
     llvm::Value *asgmt_value(llvm::Value *, llvm::Value *src);
     llvm::Value *type_cast(llvm::Value *, llvm::Type *);
+    llvm::Value *convert(llvm::Value *, ctype_t from, ctype_t to);
+    llvm::Value *to_bool(llvm::Value *);
     llvm::AllocaInst *create_entry_alloca(llvm::Function *TheFunction, std::string &VarName, llvm::Type *type = nullptr);
-    var_t *lookup_var(std::string);
+    var_t *lookup_var(const std::string &);
+
+    // -incremental, see incremental.cpp
+    struct fragment_t { std::string fingerprint, bitcode; };
+    std::map<std::string, fragment_t> fragments; // the database, by function name
+    std::vector<std::pair<FunctionDefAST *, std::string>> fingerprints; // in the order of the file
+    std::set<FunctionDefAST *> reused; // only declared, their IR comes from fragments
+    void reuse_functions(AST_vec &);
+    void relink_functions();
   public:
     StructList struct_list;
     UnionList   union_list;
+    int opt_level = 0;  // -O<n>
+    int size_level = 0; // 1 for -Os
+    bool time_report = false;
+    unsigned jobs = 1; // -j<n>, threads for optimizing and compiling shards
+    OutputKind output = OUTPUT_BITCODE;
+    std::string incremental_db; // -incremental: where the functions are kept, empty when off
     void run(AST_vec, std::string = "a.bc", bool emit_llvm_ir = false);    
+    // what run() does, a top-level declaration at a time: begin(), generate()
+    // for each, then finish() optimizes and writes the output
+    void begin();
+    void generate(AST *);
+    void finish(const std::string &out_file_name, bool emit_llvm_ir);
+    // a static function whose AST is kept until something refers to it
+    bool is_pending(const std::string &name);
+    void optimize();
+    bool run_sharded(const std::string &); // see shard.cpp
+    void emit_native(const std::string &, llvm::TargetMachine::CodeGenFileType);
 };
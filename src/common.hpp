@@ -3,19 +3,36 @@
 #include "llvm/Analysis/Passes.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/DynamicLibrary.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <llvm/Support/MemoryBuffer.h>
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
@@ -40,7 +57,9 @@
 
 // C++ 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <chrono>
 #include <complex>
 #include <deque>
 #include <exception>
@@ -57,6 +76,7 @@
 #include <locale>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <numeric>
 #include <ostream>
@@ -67,7 +87,10 @@
 #include <stdexcept>
 #include <streambuf>
 #include <string>
+#include <thread>
 #include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <valarray>
 #include <vector>
@@ -76,9 +99,28 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
 #include <dlfcn.h>
+#include <link.h>
 
-// void error(const char *errs, ...);
-void error(const char *errs, ...);
+// prints nothing and doesn't exit: it throws compile_error with the message,
+// which ends the compilation of the current file only (see QCC::compile)
+[[noreturn]] void error(const char *errs, ...);
+struct compile_error : std::runtime_error {
+  compile_error(const std::string &msg): std::runtime_error(msg) {}
+};
+// printed, or kept in unit->warnings
+void warning(const char *fmt, ...);
+// runs argv[0] from PATH with argv and waits, true if it exited with 0
+bool run_program(const std::vector<std::string> &argv);
+// qcc's version and build time, for people
+std::string qcc_build();
+// what tells this build of qcc from any other, for what's kept from one run
+// to the next: it changes with every source file, not only qcc.cpp
+std::string qcc_binary_id();
 
 typedef std::vector<llvm::Type *> Type_vec;
@@ -0,0 +1,525 @@
+#include "consteval.hpp"
+#include "unit.hpp"
+
+// wraps around like the i32 arithmetic codegen emits
+static int wrap(int64_t n) {
+  return (int)(uint32_t)(uint64_t)n;
+}
+
+bool const_unary(const std::string &op, const_t v, const_t &r) {
+  if(op == "-") {
+    r = v.is_float ? const_t(-v.f_number) : const_t(wrap(-(int64_t)v.i_number));
+    return true;
+  }
+  if(op == "!") { r = const_t((int)!v.is_true()); return true; }
+  if(op == "~" && !v.is_float) { r = const_t(~v.i_number); return true; }
+  return false;
+}
+
+bool const_binary(const std::string &op, const_t l, const_t r, const_t &res) {
+  if(op == "&&") { res = const_t((int)(l.is_true() && r.is_true())); return true; }
+  if(op == "||") { res = const_t((int)(l.is_true() || r.is_true())); return true; }
+
+  if(l.is_float || r.is_float) {
+    double a = l.to_double(), b = r.to_double();
+         if(op == "+") res = const_t(a + b);
+    else if(op == "-") res = const_t(a - b);
+    else if(op == "*") res = const_t(a * b);
+    else if(op == "/") res = const_t(a / b);
+    else if(op == "==")res = const_t((int)(a == b));
+    else if(op == "!=")res = const_t((int)(a != b));
+    else if(op == "<") res = const_t((int)(a <  b));
+    else if(op == ">") res = const_t((int)(a >  b));
+    else if(op == "<=")res = const_t((int)(a <= b));
+    else if(op == ">=")res = const_t((int)(a >= b));
+    else return false;
+    return true;
+  }
+
+  int64_t a = l.i_number, b = r.i_number;
+  if(op == "/" || op == "%") {
+    // leave division by zero and INT_MIN / -1 to run time
+    if(b == 0 || (a == INT_MIN && b == -1)) return false;
+    res = const_t((int)(op == "/" ? a / b : a % b));
+    return true;
+  }
+  if(op == "<<" || op == ">>") {
+    if(b < 0 || b >= 32) return false;
+    res = const_t(op == "<<" ? wrap((uint32_t)a << b) : (int)a >> b);
+    return true;
+  }
+       if(op == "+") res = const_t(wrap(a + b));
+  else if(op == "-") res = const_t(wrap(a - b));
+  else if(op == "*") res = const_t(wrap(a * b));
+  else if(op == "&") res = const_t((int)(a & b));
+  else if(op == "|") res = const_t((int)(a | b));
+  else if(op == "^") res = const_t((int)(a ^ b));
+  else if(op == "==")res = const_t((int)(a == b));
+  else if(op == "!=")res = const_t((int)(a != b));
+  else if(op == "<") res = const_t((int)(a <  b));
+  else if(op == ">") res = const_t((int)(a >  b));
+  else if(op == "<=")res = const_t((int)(a <= b));
+  else if(op == ">=")res = const_t((int)(a >= b));
+  else return false;
+  return true;
+}
+
+void ConstEval::add(AST *st) {
+  if(!st) return;
+  if(st->get_type() == AST_FUNCTION_DEF) {
+    FunctionDefAST *f = static_cast<FunctionDefAST *>(st);
+    func_defs[f->name] = f;
+    func_attrs[f->name] |= f->attr;
+  } else if(st->get_type() == AST_FUNCTION_PROTO) {
+    FunctionProtoAST *f = static_cast<FunctionProtoAST *>(st);
+    func_attrs[f->name] |= f->attr;
+  }
+}
+
+void ConstEval::forget(const std::string &name) {
+  func_defs.erase(name);
+  purity[name] = -1;
+}
+
+AST *ConstEval::call(const std::string &name, AST_vec &args) {
+  if(!func_defs.count(name) || !is_pure(name)) return nullptr;
+  FunctionDefAST *f = func_defs[name];
+  if(f->func_type->getNumParams() != args.size()) return nullptr;
+
+  std::vector<const_t> vals;
+  aborted = false;
+  steps = 0;
+  for(size_t i = 0; i < args.size(); i++) {
+    if(args[i]->get_type() != AST_NUMBER) return nullptr;
+    NumberAST *n = static_cast<NumberAST *>(args[i]);
+    vals.push_back(convert(n->is_float ? const_t(n->f_number) : const_t(n->i_number),
+          f->func_type->getParamType(i)));
+  }
+  if(aborted) return nullptr;
+
+  memo_key_t key = make_key(f, vals);
+  if(failed.count(key)) return nullptr;
+  const_t r = invoke(f, vals);
+  if(aborted) {
+    frames.clear();
+    memory.clear();
+    failed.insert(key); // don't pay for it again at the next call site
+    return nullptr;
+  }
+  return r.is_float ? new NumberAST(r.f_number) : new NumberAST(r.i_number);
+}
+
+bool ConstEval::is_pure(const std::string &name) {
+  auto p = purity.find(name);
+  if(p != purity.end()) return p->second >= 0; // still being checked: assume pure (recursion)
+  if(!func_defs.count(name)) return false;
+  purity[name] = 0;
+  FunctionDefAST *f = func_defs[name];
+  bool pure = check_signature(f) && ((func_attrs[name] & FUNC_ATTR_CONST) || check_pure(f));
+  purity[name] = pure ? 1 : -1;
+  return pure;
+}
+
+bool ConstEval::check_signature(FunctionDefAST *f) {
+  llvm::FunctionType *fty = f->func_type;
+  if(fty->isVarArg() || !is_scalar(fty->getReturnType())) return false;
+  // the interpreter only knows signed i32
+  if(f->ret_qual & QUAL_UNSIGNED) return false;
+  for(auto q : f->args_qual)
+    if(q & QUAL_UNSIGNED) return false;
+  for(unsigned i = 0; i < fty->getNumParams(); i++)
+    if(!is_scalar(fty->getParamType(i))) return false;
+  return true;
+}
+
+// a cheap filter only: the interpreter itself refuses anything impure when it
+// gets there, so a wrong 'pure' here just costs an evaluation attempt.
+bool ConstEval::check_pure(FunctionDefAST *f) {
+  std::set<std::string> locals(f->args_name.begin(), f->args_name.end());
+  for(auto st : f->body)
+    if(!check_pure(st, locals)) return false;
+  return true;
+}
+
+bool ConstEval::check_pure(AST *st, std::set<std::string> &locals) {
+  if(!st) return true;
+  switch(st->get_type()) {
+    case AST_NUMBER:
+    case AST_BREAK:
+    case AST_CONTINUE:
+      return true;
+    case AST_VARIABLE:
+      return locals.count(static_cast<VariableAST *>(st)->name);
+    case AST_UNARY: {
+      UnaryAST *u = static_cast<UnaryAST *>(st);
+      return u->op != "&" && u->op != "*" && check_pure(u->expr, locals);
+    }
+    case AST_BINARY: {
+      BinaryAST *b = static_cast<BinaryAST *>(st);
+      return check_pure(b->lhs, locals) && check_pure(b->rhs, locals);
+    }
+    case AST_TERNARY: {
+      TernaryAST *t = static_cast<TernaryAST *>(st);
+      return check_pure(t->cond, locals) && check_pure(t->then_expr, locals) && check_pure(t->else_expr, locals);
+    }
+    case AST_TYPECAST: {
+      TypeCastAST *c = static_cast<TypeCastAST *>(st);
+      return is_scalar(c->cast_to) && !(c->qual & QUAL_UNSIGNED) && check_pure(c->expr, locals);
+    }
+    case AST_INDEX: {
+      IndexAST *i = static_cast<IndexAST *>(st);
+      return check_pure(i->ary, locals) && check_pure(i->idx, locals);
+    }
+    case AST_ASGMT: {
+      AsgmtAST *a = static_cast<AsgmtAST *>(st);
+      return check_pure(a->dst, locals) && check_pure(a->src, locals);
+    }
+    case AST_ARRAY:
+      for(auto e : static_cast<ArrayAST *>(st)->elems)
+        if(!check_pure(e, locals)) return false;
+      return true;
+    case AST_FUNCTION_CALL: {
+      FunctionCallAST *c = static_cast<FunctionCallAST *>(st);
+      if(c->callee->get_type() != AST_VARIABLE) return false;
+      const std::string &name = static_cast<VariableAST *>(c->callee)->name;
+      if(locals.count(name) || !is_pure(name)) return false;
+      for(auto a : c->args)
+        if(!check_pure(a, locals)) return false;
+      return true;
+    }
+    case AST_VAR_DECLARATION: {
+      VarDeclarationAST *v = static_cast<VarDeclarationAST *>(st);
+      if(v->stg != 0) return false; // a static local is state
+      for(auto d : v->decls) {
+        if(!is_supported(d->type) && !d->type->isPointerTy()) return false;
+        if(d->qual & QUAL_UNSIGNED) return false;
+        if(!check_pure(d->init_expr, locals)) return false;
+        locals.insert(d->name);
+      }
+      return true;
+    }
+    case AST_BLOCK:
+      for(auto a : static_cast<BlockAST *>(st)->body)
+        if(!check_pure(a, locals)) return false;
+      return true;
+    case AST_IF: {
+      IfAST *i = static_cast<IfAST *>(st);
+      return check_pure(i->cond, locals) && check_pure(i->b_then, locals) && check_pure(i->b_else, locals);
+    }
+    case AST_WHILE: {
+      WhileAST *w = static_cast<WhileAST *>(st);
+      return check_pure(w->cond, locals) && check_pure(w->body, locals);
+    }
+    case AST_FOR: {
+      ForAST *f = static_cast<ForAST *>(st);
+      return check_pure(f->init, locals) && check_pure(f->cond, locals) &&
+        check_pure(f->reinit, locals) && check_pure(f->body, locals);
+    }
+    case AST_RETURN:
+      return static_cast<ReturnAST *>(st)->expr && check_pure(static_cast<ReturnAST *>(st)->expr, locals);
+  }
+  return false;
+}
+
+bool ConstEval::is_scalar(llvm::Type *ty) {
+  return ty->isIntegerTy(32) || ty->isDoubleTy();
+}
+
+bool ConstEval::is_supported(llvm::Type *ty) {
+  return is_scalar(ty) || (ty->isArrayTy() && is_supported(ty->getArrayElementType()));
+}
+
+size_t ConstEval::cells_of(llvm::Type *ty) {
+  if(ty->isArrayTy())
+    return ty->getArrayNumElements() * cells_of(ty->getArrayElementType());
+  return 1;
+}
+
+bool ConstEval::step() {
+  if(++steps > max_steps) aborted = true;
+  return !aborted;
+}
+
+const_t ConstEval::fail() {
+  aborted = true;
+  return const_t(0);
+}
+
+const_t ConstEval::convert(const_t v, llvm::Type *ty) {
+  if(ty->isDoubleTy()) return const_t(v.to_double());
+  if(ty->isIntegerTy(32)) {
+    if(!v.is_float) return v;
+    if(v.f_number > INT_MIN - 1.0 && v.f_number < INT_MAX + 1.0)
+      return const_t((int)v.f_number);
+  }
+  return fail();
+}
+
+ConstEval::memo_key_t ConstEval::make_key(FunctionDefAST *f, std::vector<const_t> &args) {
+  memo_key_t key{f, {}};
+  for(auto a : args) {
+    uint64_t bits = (uint32_t)a.i_number;
+    if(a.is_float) memcpy(&bits, &a.f_number, sizeof(bits));
+    key.args.push_back(bits);
+  }
+  return key;
+}
+
+const_t ConstEval::invoke(FunctionDefAST *f, std::vector<const_t> &args) {
+  memo_key_t key = make_key(f, args);
+  auto m = memo.find(key);
+  if(m != memo.end()) return m->second;
+
+  if(frames.size() >= max_depth || !step()) return fail();
+  size_t mem_top = memory.size();
+  frames.push_back(frame_t{f, std::vector<scope_t>(1)});
+  for(size_t i = 0; i < args.size() && !aborted; i++) {
+    local_t l = declare(f->args_name[i], f->func_type->getParamType(i));
+    if(aborted) break;
+    memory[l.addr].val = args[i];
+    memory[l.addr].init = true;
+  }
+  int r = aborted ? EXEC_ABORT : exec(f->body);
+  frames.pop_back();
+  memory.resize(mem_top);
+  if(r != EXEC_RETURN) return fail(); // aborted, or fell off the end
+
+  // pure: the result only depends on the arguments
+  if(memo.size() * (args.size() + 1) < max_memory) memo[key] = ret_val;
+  return ret_val;
+}
+
+ConstEval::local_t *ConstEval::lookup(const std::string &name) {
+  auto &scopes = frames.back().scopes;
+  for(auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+    auto l = s->find(name);
+    if(l != s->end()) return &l->second;
+  }
+  return nullptr;
+}
+
+ConstEval::local_t ConstEval::declare(const std::string &name, llvm::Type *ty) {
+  size_t n = cells_of(ty);
+  if(!is_supported(ty) || memory.size() + n > max_memory) {
+    aborted = true;
+    return local_t{0, nullptr};
+  }
+  local_t l{memory.size(), ty};
+  memory.resize(memory.size() + n);
+  frames.back().scopes.back()[name] = l;
+  return l;
+}
+
+// check 'aborted' before using the result
+ConstEval::local_t ConstEval::lvalue(AST *st) {
+  if(st->get_type() == AST_VARIABLE) {
+    local_t *l = lookup(static_cast<VariableAST *>(st)->name);
+    if(l) return *l; // otherwise a global or a function
+  } else if(st->get_type() == AST_INDEX) {
+    IndexAST *i = static_cast<IndexAST *>(st);
+    local_t ary = lvalue(i->ary);
+    if(aborted || !ary.type->isArrayTy()) return fail(), local_t{0, nullptr};
+    const_t idx = eval(i->idx);
+    if(aborted || idx.is_float || idx.i_number < 0 || (uint64_t)idx.i_number >= ary.type->getArrayNumElements())
+      return fail(), local_t{0, nullptr};
+    llvm::Type *elemty = ary.type->getArrayElementType();
+    return local_t{ary.addr + idx.i_number * cells_of(elemty), elemty};
+  }
+  fail();
+  return local_t{0, nullptr};
+}
+
+const_t ConstEval::load(local_t l) {
+  if(aborted || l.type->isArrayTy() || !memory[l.addr].init) return fail();
+  return memory[l.addr].val;
+}
+
+void ConstEval::store(local_t l, const_t v) {
+  if(aborted || l.type->isArrayTy()) { fail(); return; }
+  v = convert(v, l.type);
+  memory[l.addr].val = v;
+  memory[l.addr].init = true;
+}
+
+// like codegen, elements without an initializer are zero
+void ConstEval::init_array(local_t l, AST *init) {
+  if(!l.type->isArrayTy()) {
+    store(l, init ? eval(init) : const_t(0));
+    return;
+  }
+  ArrayAST *ary = nullptr;
+  if(init) {
+    if(init->get_type() != AST_ARRAY) { fail(); return; }
+    ary = static_cast<ArrayAST *>(init);
+    if(ary->elems.size() > l.type->getArrayNumElements()) { fail(); return; }
+  }
+  llvm::Type *elemty = l.type->getArrayElementType();
+  for(size_t i = 0; i < l.type->getArrayNumElements() && !aborted; i++)
+    init_array(local_t{l.addr + i * cells_of(elemty), elemty},
+        ary && i < ary->elems.size() ? ary->elems[i] : nullptr);
+}
+
+int ConstEval::exec(AST_vec &body) {
+  for(auto st : body) {
+    int r = exec(st);
+    if(r != EXEC_NEXT) return r;
+  }
+  return EXEC_NEXT;
+}
+
+int ConstEval::exec(AST *st) {
+  if(!st) return EXEC_NEXT;
+  if(!step()) return EXEC_ABORT;
+  switch(st->get_type()) {
+    case AST_BLOCK: {
+      size_t mem_top = memory.size();
+      frames.back().scopes.push_back(scope_t());
+      int r = exec(static_cast<BlockAST *>(st)->body);
+      frames.back().scopes.pop_back();
+      memory.resize(mem_top);
+      return r;
+    }
+    case AST_VAR_DECLARATION: {
+      VarDeclarationAST *v = static_cast<VarDeclarationAST *>(st);
+      if(v->stg != 0) return EXEC_ABORT;
+      for(auto d : v->decls) {
+        if(d->qual & QUAL_UNSIGNED) return EXEC_ABORT;
+        llvm::Type *ty = d->type;
+        // int a[] = {1, 2}; -->> int a[2] = {1, 2};
+        if(ty->isPointerTy() && d->init_expr && d->init_expr->get_type() == AST_ARRAY) {
+          types_guard guard; // the parser may be making types, see unit.hpp
+          ty = llvm::ArrayType::get(ty->getPointerElementType(), static_cast<ArrayAST *>(d->init_expr)->elems.size());
+        }
+        if(ty->isArrayTy()) {
+          local_t l = declare(d->name, ty);
+          if(!aborted && d->init_expr) init_array(l, d->init_expr);
+        } else {
+          const_t init;
+          if(d->init_expr) init = eval(d->init_expr);
+          local_t l = declare(d->name, ty);
+          if(d->init_expr) store(l, init);
+        }
+        if(aborted) return EXEC_ABORT;
+      }
+      return EXEC_NEXT;
+    }
+    case AST_IF: {
+      IfAST *i = static_cast<IfAST *>(st);
+      bool cond = eval(i->cond).is_true();
+      if(aborted) return EXEC_ABORT;
+      return exec(cond ? i->b_then : i->b_else);
+    }
+    case AST_WHILE: {
+      WhileAST *w = static_cast<WhileAST *>(st);
+      for(;;) {
+        bool cond = eval(w->cond).is_true();
+        if(aborted) return EXEC_ABORT;
+        if(!cond) break;
+        int r = exec(w->body);
+        if(r == EXEC_BREAK) break;
+        if(r == EXEC_RETURN || r == EXEC_ABORT) return r;
+      }
+      return EXEC_NEXT;
+    }
+    case AST_FOR: {
+      ForAST *f = static_cast<ForAST *>(st);
+      if(exec(f->init) == EXEC_ABORT) return EXEC_ABORT;
+      for(;;) {
+        bool cond = !f->cond || eval(f->cond).is_true();
+        if(aborted) return EXEC_ABORT;
+        if(!cond) break;
+        int r = exec(f->body);
+        if(r == EXEC_BREAK) break;
+        if(r == EXEC_RETURN || r == EXEC_ABORT) return r;
+        if(f->reinit) eval(f->reinit);
+        if(!step()) return EXEC_ABORT;
+      }
+      return EXEC_NEXT;
+    }
+    case AST_RETURN: {
+      ReturnAST *r = static_cast<ReturnAST *>(st);
+      if(!r->expr) return EXEC_ABORT;
+      ret_val = convert(eval(r->expr), frames.back().func->func_type->getReturnType());
+      return aborted ? EXEC_ABORT : EXEC_RETURN;
+    }
+    case AST_BREAK:
+      return EXEC_BREAK;
+    case AST_CONTINUE:
+      return EXEC_CONTINUE;
+  }
+  eval(st);
+  return aborted ? EXEC_ABORT : EXEC_NEXT;
+}
+
+const_t ConstEval::eval(AST *st) {
+  if(!st || aborted) return fail();
+  switch(st->get_type()) {
+    case AST_NUMBER: {
+      NumberAST *n = static_cast<NumberAST *>(st);
+      return n->is_float ? const_t(n->f_number) : const_t(n->i_number);
+    }
+    case AST_VARIABLE:
+    case AST_INDEX:
+      return load(lvalue(st));
+    case AST_ASGMT:
+      return eval(static_cast<AsgmtAST *>(st));
+    case AST_UNARY:
+      return eval(static_cast<UnaryAST *>(st));
+    case AST_BINARY:
+      return eval(static_cast<BinaryAST *>(st));
+    case AST_TERNARY: {
+      TernaryAST *t = static_cast<TernaryAST *>(st);
+      bool cond = eval(t->cond).is_true();
+      return eval(cond ? t->then_expr : t->else_expr);
+    }
+    case AST_TYPECAST: {
+      TypeCastAST *c = static_cast<TypeCastAST *>(st);
+      if(c->qual & QUAL_UNSIGNED) return fail();
+      return convert(eval(c->expr), c->cast_to);
+    }
+    case AST_FUNCTION_CALL:
+      return eval(static_cast<FunctionCallAST *>(st));
+  }
+  return fail();
+}
+
+const_t ConstEval::eval(UnaryAST *st) {
+  const_t r;
+  if(st->op == "++" || st->op == "--") {
+    local_t l = lvalue(st->expr);
+    const_t v = load(l);
+    if(aborted || !const_binary(st->op == "++" ? "+" : "-", v, const_t(1), r)) return fail();
+    store(l, r);
+    return st->postfix ? v : convert(r, l.type);
+  }
+  if(!const_unary(st->op, eval(st->expr), r)) return fail();
+  return r;
+}
+
+const_t ConstEval::eval(BinaryAST *st) {
+  const_t lhs = eval(st->lhs), r;
+  if(st->op == "&&" && !lhs.is_true()) return const_t(0);
+  if(st->op == "||" &&  lhs.is_true()) return const_t(1);
+  if(!const_binary(st->op, lhs, eval(st->rhs), r)) return fail();
+  return r;
+}
+
+const_t ConstEval::eval(AsgmtAST *st) {
+  const_t v = eval(st->src);
+  local_t l = lvalue(st->dst);
+  store(l, v);
+  return aborted ? fail() : convert(v, l.type);
+}
+
+const_t ConstEval::eval(FunctionCallAST *st) {
+  if(st->callee->get_type() != AST_VARIABLE) return fail();
+  const std::string &name = static_cast<VariableAST *>(st->callee)->name;
+  if(lookup(name) || !func_defs.count(name) || !is_pure(name)) return fail();
+  FunctionDefAST *f = func_defs[name];
+  if(f->func_type->getNumParams() != st->args.size()) return fail();
+  std::vector<const_t> args;
+  for(size_t i = 0; i < st->args.size(); i++)
+    args.push_back(convert(eval(st->args[i]), f->func_type->getParamType(i)));
+  if(aborted) return fail();
+  return invoke(f, args);
+}
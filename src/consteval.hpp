@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.hpp"
+#include "ast.hpp"
+
+// a compile-time value, int and double as codegen emits them (i32/double)
+struct const_t {
+  const_t(int n = 0): is_float(false), i_number(n) {};
+  const_t(double n): is_float(true), f_number(n) {};
+  bool is_float;
+  union {
+    int i_number;
+    double f_number;
+  };
+  double to_double() const { return is_float ? f_number : (double)i_number; }
+  bool is_true() const { return to_double() != 0; }
+};
+
+// false when the result is not defined at compile time (e.g. division by zero)
+bool const_unary(const std::string &, const_t, const_t &);
+bool const_binary(const std::string &, const_t, const_t, const_t &);
+
+// interpreter evaluating calls to pure functions with constant arguments.
+// a function is pure if it is marked __attribute__((const)) or if its body
+// only touches its own i32/double scalars and arrays and calls pure functions.
+// anything the interpreter can't do, or running out of budget, leaves the call
+// to run time.
+class ConstEval {
+  private:
+    struct cell_t {
+      const_t val;
+      bool init = false;
+    };
+    struct local_t {
+      size_t addr;
+      llvm::Type *type;
+    };
+    typedef std::map<std::string, local_t> scope_t;
+    struct frame_t {
+      FunctionDefAST *func;
+      std::vector<scope_t> scopes;
+    };
+    struct memo_key_t {
+      FunctionDefAST *func;
+      std::vector<uint64_t> args;
+      bool operator<(const memo_key_t &k) const {
+        return func != k.func ? func < k.func : args < k.args;
+      }
+    };
+    enum { EXEC_NEXT, EXEC_BREAK, EXEC_CONTINUE, EXEC_RETURN, EXEC_ABORT };
+
+    std::map<std::string, FunctionDefAST *> func_defs;
+    std::map<std::string, int> func_attrs;
+    std::map<std::string, int> purity; // 1: pure, -1: not pure, 0: being checked
+    std::map<memo_key_t, const_t> memo;
+    std::set<memo_key_t> failed;
+
+    std::vector<cell_t> memory;
+    std::vector<frame_t> frames;
+    const_t ret_val;
+    size_t steps;
+    bool aborted; // set on anything not evaluable, unwinds everything
+
+    bool check_signature(FunctionDefAST *);
+    bool check_pure(FunctionDefAST *);
+    bool check_pure(AST *, std::set<std::string> &);
+    bool is_scalar(llvm::Type *);
+    bool is_supported(llvm::Type *);
+    size_t cells_of(llvm::Type *);
+
+    memo_key_t make_key(FunctionDefAST *, std::vector<const_t> &);
+    bool step();
+    const_t fail();
+    const_t convert(const_t, llvm::Type *);
+    const_t invoke(FunctionDefAST *, std::vector<const_t> &);
+    local_t *lookup(const std::string &);
+    local_t declare(const std::string &, llvm::Type *);
+    local_t lvalue(AST *);
+    const_t load(local_t);
+    void store(local_t, const_t);
+    void init_array(local_t, AST *);
+
+    int exec(AST *);
+    int exec(AST_vec &);
+    const_t eval(AST *);
+    const_t eval(UnaryAST *);
+    const_t eval(BinaryAST *);
+    const_t eval(AsgmtAST *);
+    const_t eval(FunctionCallAST *);
+  public:
+    size_t max_steps  = 1 << 24;
+    size_t max_memory = 1 << 20; // cells for locals and memoized results
+    size_t max_depth  = 1000;
+
+    void add(AST *);
+    void forget(const std::string &); // the function's AST is going away
+    bool is_pure(const std::string &);
+    AST *call(const std::string &, AST_vec &); // NumberAST, or nullptr if not evaluable
+};
@@ -0,0 +1,266 @@
+#include "constfold.hpp"
+
+static bool is_number(AST *st) {
+  return st && st->get_type() == AST_NUMBER;
+}
+static bool is_int(AST *st) {
+  return is_number(st) && !static_cast<NumberAST *>(st)->is_float;
+}
+static bool is_int(AST *st, int n) {
+  return is_int(st) && static_cast<NumberAST *>(st)->i_number == n;
+}
+static const_t to_const(AST *st) {
+  NumberAST *n = static_cast<NumberAST *>(st);
+  return n->is_float ? const_t(n->f_number) : const_t(n->i_number);
+}
+static NumberAST *to_number(const_t c) {
+  return c.is_float ? new NumberAST(c.f_number) : new NumberAST(c.i_number);
+}
+
+AST_vec ConstFold::run(AST_vec ast) {
+  for(auto st : ast) eval.add(st);
+  fold_body(ast);
+  return ast;
+}
+
+void ConstFold::fold_body(AST_vec &body) {
+  AST_vec folded;
+  for(auto st : body) {
+    st = fold(st);
+    // a constant alone in statement position has no effect
+    if(st && !is_number(st)) folded.push_back(st);
+  }
+  body = folded;
+}
+
+// for statement positions that must not be empty, e.g. 'while(x) if(0) f();'
+AST *ConstFold::fold_stmt(AST *st) {
+  st = fold(st);
+  return st ? st : new BlockAST(AST_vec());
+}
+
+bool ConstFold::has_jump(AST *st) {
+  if(!st) return false;
+  switch(st->get_type()) {
+    case AST_BREAK:
+    case AST_CONTINUE:
+    case AST_RETURN:
+      return true;
+    case AST_BLOCK:
+      for(auto a : static_cast<BlockAST *>(st)->body)
+        if(has_jump(a)) return true;
+      return false;
+    case AST_IF: {
+      IfAST *i = static_cast<IfAST *>(st);
+      return has_jump(i->b_then) || has_jump(i->b_else);
+    }
+    case AST_WHILE:
+      return has_jump(static_cast<WhileAST *>(st)->body);
+    case AST_FOR:
+      return has_jump(static_cast<ForAST *>(st)->body);
+  }
+  return false;
+}
+
+AST *ConstFold::fold(AST *st) {
+  if(!st) return nullptr;
+  switch(st->get_type()) {
+    case AST_FUNCTION_DEF:
+      return fold((FunctionDefAST *)st);
+    case AST_BLOCK:
+      return fold((BlockAST *)st);
+    case AST_FUNCTION_CALL:
+      return fold((FunctionCallAST *)st);
+    case AST_VAR_DECLARATION:
+      return fold((VarDeclarationAST *)st);
+    case AST_INDEX:
+      return fold((IndexAST *)st);
+    case AST_IF:
+      return fold((IfAST *)st);
+    case AST_WHILE:
+      return fold((WhileAST *)st);
+    case AST_FOR:
+      return fold((ForAST *)st);
+    case AST_RETURN:
+      return fold((ReturnAST *)st);
+    case AST_ASGMT:
+      return fold((AsgmtAST *)st);
+    case AST_ARRAY:
+      return fold((ArrayAST *)st);
+    case AST_TYPECAST:
+      return fold((TypeCastAST *)st);
+    case AST_UNARY:
+      return fold((UnaryAST *)st);
+    case AST_BINARY:
+      return fold((BinaryAST *)st);
+    case AST_TERNARY:
+      return fold((TernaryAST *)st);
+    case AST_DOT:
+      return fold((DotOpAST *)st);
+    case AST_SIZEOF:
+      return fold((SizeofAST *)st);
+  }
+  return st;
+}
+
+AST *ConstFold::fold(FunctionDefAST *st) {
+  locals = std::set<std::string>(st->args_name.begin(), st->args_name.end());
+  fold_body(st->body);
+  locals.clear();
+  return st;
+}
+
+AST *ConstFold::fold(BlockAST *st) {
+  fold_body(st->body);
+  return st;
+}
+
+AST *ConstFold::fold(FunctionCallAST *st) {
+  st->callee = fold(st->callee);
+  for(auto &a : st->args) a = fold(a);
+  // pure function with constant arguments, e.g. fibo(30)
+  if(st->callee->get_type() == AST_VARIABLE && std::all_of(st->args.begin(), st->args.end(), is_number)) {
+    const std::string &name = static_cast<VariableAST *>(st->callee)->name;
+    AST *ret = locals.count(name) ? nullptr : eval.call(name, st->args);
+    if(ret) return ret;
+  }
+  return st;
+}
+
+AST *ConstFold::fold(VarDeclarationAST *st) {
+  for(auto d : st->decls) {
+    d->init_expr = fold(d->init_expr);
+    locals.insert(d->name);
+  }
+  return st;
+}
+
+AST *ConstFold::fold(IndexAST *st) {
+  st->ary = fold(st->ary);
+  st->idx = fold(st->idx);
+  return st;
+}
+
+AST *ConstFold::fold(IfAST *st) {
+  st->cond = fold(st->cond);
+  if(!is_number(st->cond)) {
+    st->b_then = fold(st->b_then);
+    st->b_else = fold(st->b_else);
+    return st;
+  }
+  // if(0) ..., if(1) ...: drop the dead branch.
+  // the live one stays under 'if' when it jumps, codegen tracks break/return per branch.
+  bool cond = to_const(st->cond).is_true();
+  AST *live = fold(cond ? st->b_then : st->b_else);
+  if(!live) return nullptr;
+  if(has_jump(live)) return new IfAST(new NumberAST(1), live);
+  return live;
+}
+
+AST *ConstFold::fold(WhileAST *st) {
+  st->cond = fold(st->cond);
+  if(is_number(st->cond) && !to_const(st->cond).is_true())
+    return nullptr;
+  st->body = fold_stmt(st->body);
+  return st;
+}
+
+AST *ConstFold::fold(ForAST *st) {
+  st->init = fold(st->init);
+  st->cond = fold(st->cond);
+  if(is_number(st->cond) && !to_const(st->cond).is_true())
+    return st->init;
+  st->reinit = fold(st->reinit);
+  st->body = fold_stmt(st->body);
+  return st;
+}
+
+AST *ConstFold::fold(ReturnAST *st) {
+  st->expr = fold(st->expr);
+  return st;
+}
+
+AST *ConstFold::fold(AsgmtAST *st) {
+  st->dst = fold(st->dst);
+  st->src = fold(st->src);
+  return st;
+}
+
+AST *ConstFold::fold(ArrayAST *st) {
+  for(auto &e : st->elems) e = fold(e);
+  return st;
+}
+
+AST *ConstFold::fold(TypeCastAST *st) {
+  st->expr = fold(st->expr);
+  if(!is_number(st->expr)) return st;
+  if(st->cast_to->isDoubleTy())
+    return new NumberAST(to_const(st->expr).to_double());
+  // constants are signed ints, (unsigned)-1 has to stay a cast
+  if(st->cast_to->isIntegerTy(32) && !(st->qual & QUAL_UNSIGNED)) {
+    const_t n = to_const(st->expr);
+    if(!n.is_float) return st->expr;
+    if(n.f_number > INT_MIN - 1.0 && n.f_number < INT_MAX + 1.0)
+      return new NumberAST((int)n.f_number);
+  }
+  return st;
+}
+
+AST *ConstFold::fold(UnaryAST *st) {
+  st->expr = fold(st->expr);
+  const_t r;
+  if(is_number(st->expr) && const_unary(st->op, to_const(st->expr), r))
+    return to_number(r);
+  return st;
+}
+
+AST *ConstFold::fold(BinaryAST *st) {
+  st->lhs = fold(st->lhs);
+  // 0 && x, 1 || x: x is never evaluated
+  if(is_number(st->lhs) && (st->op == "&&" || st->op == "||")) {
+    bool lhs = to_const(st->lhs).is_true();
+    if(st->op == "&&" && !lhs) return new NumberAST(0);
+    if(st->op == "||" &&  lhs) return new NumberAST(1);
+  }
+  st->rhs = fold(st->rhs);
+  const_t r;
+  if(is_number(st->lhs) && is_number(st->rhs) &&
+      const_binary(st->op, to_const(st->lhs), to_const(st->rhs), r))
+    return to_number(r);
+  return fold_identity(st);
+}
+
+// x-0, x*1, x/1, x|0, x^0, x<<0, x>>0 -> x.
+// only the constant-on-the-right forms: codegen gives the result the type of lhs.
+// x+0 is kept, it is not an identity for x = -0.0.
+AST *ConstFold::fold_identity(BinaryAST *st) {
+  const std::string &op = st->op;
+  if(is_int(st->rhs, 0) &&
+      (op == "-" || op == "|" || op == "^" || op == "<<" || op == ">>"))
+    return st->lhs;
+  if(is_int(st->rhs, 1) && (op == "*" || op == "/"))
+    return st->lhs;
+  return st;
+}
+
+AST *ConstFold::fold(TernaryAST *st) {
+  st->cond = fold(st->cond);
+  if(is_number(st->cond))
+    return fold(to_const(st->cond).is_true() ? st->then_expr : st->else_expr);
+  st->then_expr = fold(st->then_expr);
+  st->else_expr = fold(st->else_expr);
+  return st;
+}
+
+AST *ConstFold::fold(DotOpAST *st) {
+  st->lhs = fold(st->lhs);
+  return st;
+}
+
+AST *ConstFold::fold(SizeofAST *st) {
+  // the operand is not evaluated, but a literal's size is known here
+  st->expr = fold(st->expr);
+  if(is_number(st->expr))
+    return new NumberAST(static_cast<NumberAST *>(st->expr)->is_float ? 8 : 4);
+  return st;
+}
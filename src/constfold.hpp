@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common.hpp"
+#include "ast.hpp"
+#include "consteval.hpp"
+
+// constant folding and algebraic simplification on AST.
+// runs between Parser::run and Codegen::run.
+class ConstFold {
+  private:
+    std::set<std::string> locals; // names that shadow functions in the current function
+    AST *fold(AST *);
+    AST *fold(FunctionDefAST *);
+    AST *fold(BlockAST *);
+    AST *fold(FunctionCallAST *);
+    AST *fold(VarDeclarationAST *);
+    AST *fold(IndexAST *);
+    AST *fold(IfAST *);
+    AST *fold(WhileAST *);
+    AST *fold(ForAST *);
+    AST *fold(ReturnAST *);
+    AST *fold(AsgmtAST *);
+    AST *fold(ArrayAST *);
+    AST *fold(TypeCastAST *);
+    AST *fold(UnaryAST *);
+    AST *fold(BinaryAST *);
+    AST *fold(TernaryAST *);
+    AST *fold(DotOpAST *);
+    AST *fold(SizeofAST *);
+
+    void fold_body(AST_vec &);
+    AST *fold_stmt(AST *);
+    AST *fold_identity(BinaryAST *);
+    bool has_jump(AST *);
+  public:
+    ConstEval eval;
+    AST_vec run(AST_vec);
+};
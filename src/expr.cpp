@@ -96,10 +96,11 @@ AST *Parser::expr_unary() {
   } else if(op_cast) {
     token.expect_skip("(");
     llvm::Type *cast_to = read_type_spec();
+    int qual = type_qual;
     std::string _; cast_to = read_declarator(_, cast_to);
     token.expect_skip(")");
     expr = expr_unary();
-    return new TypeCastAST(expr, cast_to);
+    return new TypeCastAST(expr, cast_to, qual);
   } else 
     expr = expr_func_call();
   return expr_unary_postfix(expr);
@@ -165,7 +166,6 @@ AST *Parser::expr_index() {
 
 
 AST *Parser::expr_primary() {
-  std::cout << token.get().type << " : " << token.get().line << " " << token.get().val << std::endl;
   if(token.get().type == TOK_TYPE_NUMBER) {
     return read_number();
   } else if(token.get().type == TOK_TYPE_STRING) {
@@ -179,7 +179,8 @@ AST *Parser::expr_primary() {
       std::string _; 
       type = read_declarator(_, type);
       token.expect_skip(")");
-      return new NumberAST((int)data_layout->getTypeAllocSize(type));
+      types_guard guard; // see parse.cpp
+      return new NumberAST((int)unit->data_layout->getTypeAllocSize(type));
     } else {
       AST *expr = expr_entry();
       token.expect_skip(")");
@@ -190,7 +191,7 @@ AST *Parser::expr_primary() {
   } else if(token.get().type == TOK_TYPE_IDENT) {
     std::string name = token.next().val;
     if(enum_list.count(name)) {
-      return enum_list[name];
+      return new NumberAST(*enum_list[name]); // each use its own, see delete_ast()
     } else { // variable
       return new VariableAST(name);
     }
@@ -1,44 +1,24 @@
 #include "func.hpp"
 
-block_t *BlockList::create_new_block() {
-  block_t *newb = new block_t;
-  newb->parent = current;
-  if(current) current->children.push_back(newb);
-  current = newb;
-  return newb;
-}
-
-block_t *BlockList::escape_block() {
-  if(current->parent) {
-    current = current->parent;
-    return current;
+func_t *FunctionList::add(const std::string &name, int id) {
+  func_t *&f = by_name[name];
+  if(!f) {
+    funcs.push_back(func_t());
+    f = &funcs.back();
+    f->name = name;
   }
-  return nullptr;
-}
-
-block_t *BlockList::get_current() {
-  return current;
-}
-
-VariableList *BlockList::get_varlist() {
-  return &current->var_list;
-}
-
-var_t *BlockList::lookup_var(std::string name) {
-  block_t *cur = current;
-  var_t *v = cur->var_list.get(name);
-  while(!v) {
-    cur = cur->parent;
-    if(!cur) break;
-    v = cur->var_list.get(name);
+  if(id >= 0) {
+    if((size_t)id >= by_id.size()) by_id.resize(id + 1, nullptr);
+    by_id[id] = f;
   }
-  return v;
+  return f;
 }
 
-void FunctionList::add(func_t f) {
-  func_map[f.name] = (f);
+func_t *FunctionList::get(const std::string &name) {
+  auto f = by_name.find(name);
+  return f == by_name.end() ? nullptr : f->second;
 }
 
-func_t *FunctionList::get(std::string name) {
-  return func_map.count(name) ? &(func_map[name]) : nullptr;
+func_t *FunctionList::get(int id) {
+  return id >= 0 && (size_t)id < by_id.size() ? by_id[id] : nullptr;
 }
@@ -3,39 +3,33 @@
 #include "common.hpp"
 #include "var.hpp"
 
-struct block_t {
-  VariableList var_list;
-  block_t *parent = nullptr;
-  std::vector<block_t *> children;
-};
-
-class BlockList {
-  public:
-    // block_t block;
-    block_t *current = nullptr;
-    block_t *create_new_block(); // create new block and set it 'current'
-    block_t *escape_block();
-    block_t *get_current(); 
-    VariableList *get_varlist();
-    var_t   *lookup_var(std::string);
-};
+class FunctionDefAST;
 
 struct func_t {
   std::string name;
-  llvm::Type *ret_type;
+  llvm::Type *ret_type = nullptr;
   // std::vector<Type *> args_type;
   std::vector<std::string> args_name;
   std::stack<bool> br_list;
   std::stack<llvm::BasicBlock *> 
     break_list, continue_list;
-  llvm::Function *llvm_function;
-  BlockList block_list;
+  llvm::Function *llvm_function = nullptr; // null until referenced or defined
+  // how to declare it once it's referenced, see Codegen::function_of
+  llvm::FunctionType *type = nullptr;
+  bool is_static = false;
+  FunctionDefAST *pending = nullptr; // a static definition nothing referred to yet
 };
 
+// every function is stored once; the deque keeps func_t pointers valid as
+// more are added. Sema numbers the functions, so a call reaches its callee
+// by that id and the name is hashed only where Sema left no id.
 class FunctionList {
   private:
-    std::map<std::string, func_t> func_map;
+    std::deque<func_t> funcs;
+    std::unordered_map<std::string, func_t *> by_name;
+    std::vector<func_t *> by_id;
   public:
-    void add(func_t);
-    func_t *get(std::string);
+    func_t *add(const std::string &, int id = -1); // returns the earlier one if declared before
+    func_t *get(const std::string &);
+    func_t *get(int id);
 };
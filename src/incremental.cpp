@@ -0,0 +1,220 @@
+#include "codegen.hpp"
+#include "serialize.hpp"
+
+// -incremental: functions that haven't changed since the last compilation to
+// the same output aren't generated again.
+// next to the output, <output>.qdb keeps for each function a fingerprint of
+// what its IR was generated from and the unoptimized IR itself: a module with
+// the function, the constants only it uses, and declarations of everything
+// else it refers to. the fingerprint covers the function's AST, the
+// declarations of every name it mentions and the structs and unions of the
+// file. a function whose fingerprint is in the database is only declared,
+// and its IR is linked back in before the module is optimized.
+//
+//   "QDB1", qcc_binary_id() and the target triple, then for each function
+//   its name, fingerprint and bitcode. every field is a 32-bit length and
+//   the bytes
+
+namespace {
+  const char qdb_magic[] = "QDB1";
+
+  std::string md5_hex(llvm::MD5 &md5) {
+    llvm::MD5::MD5Result result;
+    md5.final(result);
+    llvm::SmallString<32> hex;
+    llvm::MD5::stringifyResult(result, hex);
+    return hex.str().str();
+  }
+
+  void put(std::string &out, const std::string &s) {
+    uint32_t len = s.size();
+    out.append((const char *)&len, sizeof(len));
+    out += s;
+  }
+
+  bool get(llvm::StringRef &in, std::string &s) {
+    uint32_t len;
+    if(in.size() < sizeof(len)) return false;
+    memcpy(&len, in.data(), sizeof(len));
+    in = in.drop_front(sizeof(len));
+    if(in.size() < len) return false;
+    s = in.substr(0, len).str();
+    in = in.drop_front(len);
+    return true;
+  }
+
+  // every use of v is in f, directly or through constant expressions
+  bool only_used_by(const llvm::Value *v, const llvm::Function *f) {
+    for(auto *u : v->users()) {
+      if(auto *inst = llvm::dyn_cast<llvm::Instruction>(u)) {
+        if(inst->getParent()->getParent() != f) return false;
+      } else if(llvm::isa<llvm::Constant>(u) && !llvm::isa<llvm::GlobalValue>(u)) {
+        if(!only_used_by(u, f)) return false;
+      } else return false;
+    }
+    return true;
+  }
+
+  // f alone, as bitcode. false when f refers to something the fragment
+  // can't declare, which has no name to be linked by.
+  // f takes along the private constants it made, strings and arrays. a
+  // static variable is declared like anything else: it's the file's, and
+  // other functions may start to use it
+  bool extract(llvm::Module &m, llvm::Function &f, std::string &bitcode) {
+    std::set<const llvm::GlobalValue *> own{ &f };
+    for(auto &gv : m.globals())
+      if(gv.hasPrivateLinkage() && !gv.use_empty() && only_used_by(&gv, &f)) own.insert(&gv);
+    llvm::ValueToValueMapTy vmap;
+    // what isn't cloned becomes an external declaration
+    auto part = llvm::CloneModule(&m, vmap, [&](const llvm::GlobalValue *gv) { return own.count(gv) > 0; });
+    llvm::cast<llvm::Function>(vmap[&f])->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    for(auto it = part->begin(); it != part->end(); ) {
+      llvm::Function &g = *it++;
+      if(!g.isDeclaration()) continue;
+      if(g.use_empty()) g.eraseFromParent();
+      else if(!g.hasName()) return false;
+    }
+    for(auto it = part->global_begin(); it != part->global_end(); ) {
+      llvm::GlobalVariable &gv = *it++;
+      if(!gv.isDeclaration()) continue;
+      if(gv.use_empty()) gv.eraseFromParent();
+      else if(!gv.hasName()) return false;
+    }
+    bitcode.clear();
+    llvm::raw_string_ostream out(bitcode);
+    llvm::WriteBitcodeToFile(part.get(), out);
+    out.flush();
+    return true;
+  }
+}
+
+void Codegen::reuse_functions(AST_vec &ast) {
+  std::string header = qcc_binary_id() + "\n" + unit->mod->getTargetTriple();
+  auto buf = llvm::MemoryBuffer::getFile(incremental_db);
+  if(buf) {
+    llvm::StringRef in = (*buf)->getBuffer();
+    std::string h, name, fp, bc;
+    bool ok = in.startswith(qdb_magic) && (in = in.drop_front(strlen(qdb_magic)), get(in, h)) && h == header;
+    while(ok && !in.empty()) {
+      if(!get(in, name) || !get(in, fp) || !get(in, bc)) break; // the rest is broken, do it again
+      fragments[name] = fragment_t{ fp, bc };
+    }
+  }
+
+  // what every function depends on: the file's structs and unions...
+  StructList no_structs;
+  UnionList no_unions;
+  std::string layouts;
+  {
+    AST_vec none;
+    llvm::MD5 md5;
+    md5.update(header);
+    md5.update(ASTWriter().write(none, struct_list, union_list));
+    layouts = md5_hex(md5);
+  }
+  // ...and what it depends on by name: how the functions and globals it
+  // uses are declared
+  std::map<std::string, std::string> decls;
+  for(auto st : ast) {
+    if(st->get_type() == AST_FUNCTION_DEF) {
+      FunctionDefAST *def = (FunctionDefAST *)st;
+      FunctionProtoAST proto(def->name, def->func_type, def->stg, def->attr);
+      proto.ret_qual = def->ret_qual, proto.args_qual = def->args_qual;
+      AST_vec v{ &proto };
+      decls[def->name] += ASTWriter().write(v, no_structs, no_unions);
+    } else if(st->get_type() == AST_FUNCTION_PROTO) {
+      AST_vec v{ st };
+      decls[((FunctionProtoAST *)st)->name] += ASTWriter().write(v, no_structs, no_unions);
+    } else if(st->get_type() == AST_VAR_DECLARATION) {
+      AST_vec v{ st };
+      std::string bytes = ASTWriter().write(v, no_structs, no_unions);
+      for(auto d : ((VarDeclarationAST *)st)->decls) decls[d->name] += bytes;
+    }
+  }
+
+  for(auto st : ast) {
+    if(st->get_type() != AST_FUNCTION_DEF) continue;
+    FunctionDefAST *def = (FunctionDefAST *)st;
+    AST_vec v{ def };
+    ASTWriter writer;
+    llvm::MD5 md5;
+    md5.update(layouts);
+    md5.update(writer.write(v, no_structs, no_unions));
+    // a local that shadows a global only makes this more cautious
+    for(auto &name : writer.interned()) {
+      auto d = decls.find(name);
+      if(d == decls.end() || name == def->name) continue;
+      md5.update(name);
+      md5.update(d->second);
+    }
+    std::string fp = md5_hex(md5);
+    fingerprints.push_back({ def, fp });
+    auto f = fragments.find(def->name);
+    if(f != fragments.end() && f->second.fingerprint == fp) reused.insert(def);
+  }
+}
+
+void Codegen::relink_functions() {
+  // what was generated this time goes to the database, before the reused
+  // functions come back
+  std::map<std::string, fragment_t> kept;
+  for(auto &f : fingerprints) {
+    const std::string &name = f.first->name;
+    if(reused.count(f.first)) {
+      kept[name] = fragments[name];
+      continue;
+    }
+    llvm::Function *func = unit->mod->getFunction(name);
+    std::string bc;
+    if(func && !func->isDeclaration() && extract(*unit->mod, *func, bc))
+      kept[name] = fragment_t{ f.second, bc };
+  }
+
+  if(!reused.empty()) {
+    // the fragments refer to local functions and globals by name, so those
+    // are visible while they're linked
+    std::map<std::string, llvm::GlobalValue::LinkageTypes> locals;
+    auto externalize = [&](llvm::GlobalValue &gv) {
+      if(!gv.hasLocalLinkage() || !gv.hasName()) return;
+      locals[gv.getName().str()] = gv.getLinkage();
+      gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    };
+    for(auto &f : *unit->mod) externalize(f);
+    for(auto &gv : unit->mod->globals()) externalize(gv);
+    for(auto &f : fingerprints) { // in the order of the file
+      FunctionDefAST *def = f.first;
+      if(!reused.count(def)) continue;
+      fragment_t &frag = kept[def->name];
+      llvm::StringRef bc(frag.bitcode);
+      auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bc, def->name), unit->context);
+      if(!part) error("error: '%s' is broken, remove it: %s", incremental_db.c_str(), part.getError().message().c_str());
+      if(llvm::Linker::linkModules(*unit->mod, std::move(*part)))
+        error("error: can't link '%s' from '%s', remove it", def->name.c_str(), incremental_db.c_str());
+    }
+    for(auto &l : locals)
+      if(llvm::GlobalValue *gv = unit->mod->getNamedValue(l.first)) gv->setLinkage(l.second);
+  }
+
+  // written aside and renamed, so an interrupted qcc leaves the old database
+  std::string out(qdb_magic);
+  put(out, qcc_binary_id() + "\n" + unit->mod->getTargetTriple());
+  for(auto &k : kept) {
+    put(out, k.first);
+    put(out, k.second.fingerprint);
+    put(out, k.second.bitcode);
+  }
+  std::string tmp = incremental_db + "." + std::to_string(getpid());
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(tmp, EC, llvm::sys::fs::F_None);
+    if(EC) error("error: can't write '%s': %s", tmp.c_str(), EC.message().c_str());
+    os << out;
+  }
+  if(rename(tmp.c_str(), incremental_db.c_str())) {
+    unlink(tmp.c_str());
+    error("error: can't write '%s'", incremental_db.c_str());
+  }
+
+  if(time_report)
+    llvm::errs() << "incremental: " << reused.size() << " of " << fingerprints.size() << " functions reused\n";
+}
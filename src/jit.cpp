@@ -0,0 +1,144 @@
+#include "jit.hpp"
+#include "codegen.hpp"
+
+static double ms_since(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+int JIT::run(llvm::Module *m, const std::vector<std::string> &args) {
+  llvm::Function *main_func = m->getFunction("main");
+  if(!main_func || main_func->isDeclaration()) error("error: no main() to run");
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+  // symbols the program doesn't define are looked up in qcc's own process
+  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  if(!cache_dir.empty()) cache.reset(new DiskObjectCache(cache_dir, cache_size, opt_level));
+  return lazy ? run_lazy(m, args) : run_eager(m, args);
+}
+
+int JIT::run_eager(llvm::Module *m, const std::vector<std::string> &args) {
+  auto begin = std::chrono::steady_clock::now();
+  llvm::Function *main_func = m->getFunction("main");
+  std::string err;
+  std::unique_ptr<llvm::ExecutionEngine> ee(llvm::EngineBuilder(std::unique_ptr<llvm::Module>(m))
+      .setEngineKind(llvm::EngineKind::JIT)
+      .setErrorStr(&err)
+      .setOptLevel(codegen_opt_level(opt_level))
+      .setMCPU(llvm::sys::getHostCPUName())
+      .create());
+  if(!ee) error("error: can't create the JIT: %s", err.c_str());
+  if(cache) ee->setObjectCache(cache.get());
+  ee->finalizeObject();
+  double codegen_ms = ms_since(begin);
+
+  auto exec_begin = std::chrono::steady_clock::now();
+  fflush(stdout);
+  int ret = ee->runFunctionAsMain(main_func, args, environ);
+  fflush(stdout);
+  if(time_report)
+    fprintf(stderr, "-run: compile %.3f ms (front end %.3f ms, machine code %.3f ms), execution %.3f ms\n",
+        frontend_ms + codegen_ms, frontend_ms, codegen_ms, ms_since(exec_begin));
+  report_cache();
+  return ret;
+}
+
+void JIT::report_cache() {
+  if(time_report && cache)
+    fprintf(stderr, "-run: object cache '%s': %zu hit(s), %zu miss(es)\n", 
+        cache_dir.c_str(), cache->hits, cache->misses);
+}
+
+typedef llvm::orc::ObjectLinkingLayer<> ObjectLayer;
+typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
+typedef std::function<std::unique_ptr<llvm::Module>(std::unique_ptr<llvm::Module>)> ModuleTransform;
+typedef llvm::orc::IRTransformLayer<CompileLayer, ModuleTransform> CountLayer;
+typedef llvm::orc::CompileOnDemandLayer<CountLayer> LazyLayer;
+
+int JIT::run_lazy(llvm::Module *m, const std::vector<std::string> &args) {
+  auto begin = std::chrono::steady_clock::now();
+  // the stubs and the compile callbacks are written for each architecture
+  if(llvm::Triple(m->getTargetTriple()).getArch() != llvm::Triple::x86_64)
+    error("error: -lazy is only supported on x86-64");
+
+  std::unique_ptr<llvm::TargetMachine> tm(llvm::EngineBuilder()
+      .setOptLevel(codegen_opt_level(opt_level))
+      .setMCPU(llvm::sys::getHostCPUName())
+      .selectTarget());
+  if(!tm) error("error: can't create the JIT");
+  llvm::DataLayout dl = tm->createDataLayout();
+
+  size_t defined = 0, compiled = 0;
+  for(auto &f : *m) if(!f.isDeclaration()) defined++;
+
+  llvm::orc::LocalJITCompileCallbackManager<llvm::orc::OrcX86_64> callbacks(0);
+  ObjectLayer objects;
+  CompileLayer compiler(objects, llvm::orc::SimpleCompiler(*tm));
+  if(cache) compiler.setObjectCache(cache.get()); // per function, as they're compiled
+  // every module reaching here holds what one first call needs compiled
+  CountLayer counter(compiler, [&](std::unique_ptr<llvm::Module> part) {
+    for(auto &f : *part) if(!f.isDeclaration()) compiled++;
+    return part;
+  });
+  // the one module set's stubs, kept to find main()'s below
+  llvm::orc::LocalIndirectStubsManager<llvm::orc::OrcX86_64> *stubs = nullptr;
+  LazyLayer functions(counter, 
+      [](llvm::Function &f) { return std::set<llvm::Function *>{&f}; }, // one function at a time
+      callbacks,
+      [&stubs]() {
+        auto s = llvm::make_unique<llvm::orc::LocalIndirectStubsManager<llvm::orc::OrcX86_64>>();
+        stubs = s.get();
+        return s;
+      });
+
+  auto resolver = llvm::orc::createLambdaResolver(
+      [&](const std::string &name) {
+        if(auto sym = functions.findSymbol(name, true))
+          return llvm::RuntimeDyld::SymbolInfo(sym.getAddress(), sym.getFlags());
+        if(auto addr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+          return llvm::RuntimeDyld::SymbolInfo(addr, llvm::JITSymbolFlags::Exported);
+        return llvm::RuntimeDyld::SymbolInfo(nullptr);
+      },
+      [](const std::string &) { return llvm::RuntimeDyld::SymbolInfo(nullptr); });
+  std::vector<std::unique_ptr<llvm::Module>> modules;
+  modules.push_back(std::unique_ptr<llvm::Module>(m));
+  auto handle = functions.addModuleSet(std::move(modules), 
+      llvm::make_unique<llvm::SectionMemoryManager>(), std::move(resolver));
+
+  std::string main_name;
+  {
+    llvm::raw_string_ostream os(main_name);
+    llvm::Mangler::getNameWithPrefix(os, "main", dl);
+  }
+  auto main_sym = functions.findSymbolIn(handle, main_name, true);
+  if(!main_sym) error("error: no main() to run");
+  // the stub of main(), which compiles main() itself when called
+  typedef int (*main_t)(int, char **, char **);
+  main_t main_func = (main_t)main_sym.getAddress();
+  double setup_ms = ms_since(begin);
+
+  // compile main() now, through the callback its stub would call, so that
+  // the first call is timed with main() compiled and the execution without
+  auto main_begin = std::chrono::steady_clock::now();
+  auto main_ptr = stubs->findPointer(main_name, true);
+  if(!main_ptr || !callbacks.executeCompileCallback(*(llvm::orc::TargetAddress *)main_ptr.getAddress()))
+    error("error: can't compile main()");
+  double main_ms = ms_since(main_begin);
+
+  std::vector<char *> argv;
+  for(auto &a : args) argv.push_back(const_cast<char *>(a.c_str()));
+  argv.push_back(nullptr);
+  auto exec_begin = std::chrono::steady_clock::now();
+  fflush(stdout);
+  int ret = main_func((int)args.size(), argv.data(), environ);
+  fflush(stdout);
+  if(time_report)
+    fprintf(stderr, "-run -lazy: compiled %zu of %zu functions, first call after %.3f ms "
+        "(front end %.3f ms, JIT setup %.3f ms, main() %.3f ms), "
+        "execution %.3f ms including compiling the rest\n",
+        compiled, defined, frontend_ms + setup_ms + main_ms, frontend_ms, setup_ms, main_ms, 
+        ms_since(exec_begin));
+  report_cache();
+  return ret;
+}
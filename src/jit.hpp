@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.hpp"
+#include "objcache.hpp"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/OrcArchitectureSupport.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Mangler.h"
+
+// runs main() of a module in this process, for -run.
+// the program calls into the libc (and anything else) qcc itself is linked with.
+//
+// MCJIT compiles the whole module before main() starts. with -lazy, ORC's
+// CompileOnDemandLayer puts each function behind a stub instead and compiles
+// it on its first call, so functions a run never calls are never compiled.
+class JIT {
+  private:
+    int run_eager(llvm::Module *, const std::vector<std::string> &);
+    int run_lazy (llvm::Module *, const std::vector<std::string> &);
+    std::unique_ptr<DiskObjectCache> cache;
+    void report_cache();
+  public:
+    int opt_level = 0;
+    bool lazy = false;
+    bool time_report = false;
+    double frontend_ms = 0; // reported along with the JIT's own times
+    std::string cache_dir;  // objects are reused from here unless empty
+    uint64_t cache_size = 64 << 20;
+
+    int run(llvm::Module *, const std::vector<std::string> &args); // takes the module
+};
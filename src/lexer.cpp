@@ -1,11 +1,17 @@
 #include "lexer.hpp"
 #include "token.hpp"
 #include "parse.hpp"
+#include "unit.hpp"
 
-std::map<std::string, macro_t> macro_map;
 Token Lexer::run(std::string file_name) {
-  ifs_src.open(file_name);
-  if(ifs_src.fail()) error("file not found %s", file_name.c_str());
+  auto mem = unit->files.find(file_name);
+  if(mem != unit->files.end()) ifs_src.str(mem->second);
+  else {
+    std::ifstream ifs(file_name);
+    if(ifs.fail()) error("file not found %s", file_name.c_str());
+    ifs_src.str(std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()));
+  }
+  ifs_src.clear();
   while(1) {
     auto t = read_token();
     if(t.type == TOK_TYPE_END) break;
@@ -26,15 +32,21 @@ Token Lexer::run(std::string file_name) {
       else if(s == "warning") skip_line();
       else if(s == "pragma" ) skip_line();
       else error("PREPROCESSOR ERR '%s'", t.val.c_str());
+    } else if(t.type == TOK_TYPE_IDENT && t.val == "__attribute__") {
+      read_attribute(t);
     } else if(t.type == TOK_TYPE_IDENT && !t.hideset.count(t.val) && is_defined(t.val)) {
       replace_macro(t.val);
     } else if(t.type != TOK_TYPE_NEWLINE)
       token.token.push_back(t);
+    if(on_chunk && token.token.size() >= chunk_size) {
+      on_chunk(token.token);
+      token.token.clear();
+    }
   }
 
   token.add_end_tok();
   cur_line = 1;
-  ifs_src.close();
+  ifs_src.str("");
   // token.show();
 
   return token;
@@ -143,6 +155,34 @@ void Lexer::skip_line() {
   while(t.type != TOK_TYPE_NEWLINE && t.type != TOK_TYPE_END) t = read_token();
 }
 
+// __attribute__((...)): keep 'const' and 'pure' for the parser, drop anything else
+// (this is what sys/cdefs.h does for a compiler that is not GNU C).
+void Lexer::read_attribute(token_t attr_tok) {
+  std::vector<token_t> body;
+  int nest = 0;
+  for(;;) {
+    auto t = read_token();
+    if(t.type == TOK_TYPE_END) error("error(%d): unterminated __attribute__", attr_tok.line);
+    if(t.type == TOK_TYPE_NEWLINE) continue;
+    if(body.empty() && t.val != "(") { buffer.insert(buffer.begin(), t); return; }
+    if(t.val == "(") nest++;
+    else if(t.val == ")") nest--;
+    body.push_back(t);
+    if(nest == 0) break;
+  }
+  if(body.size() != 5) return; // ( ( name ) )
+  std::string name = body[2].val;
+  if(name == "__const__") name = "const";
+  if(name == "__pure__")  name = "pure";
+  if(name != "const" && name != "pure") return;
+  token.add_ident_tok("__attribute__", attr_tok.line, attr_tok.space);
+  token.add_symbol_tok("(", attr_tok.line);
+  token.add_symbol_tok("(", attr_tok.line);
+  token.add_ident_tok(name, attr_tok.line);
+  token.add_symbol_tok(")", attr_tok.line);
+  token.add_symbol_tok(")", attr_tok.line);
+}
+
 char Lexer::replace_escape() {
   char c = ifs_src.get();
   switch(c) {
@@ -171,6 +211,7 @@ void Lexer::read_include() {
     file_name = t.val;
   }
   std::function<std::string(int)> find_include_file = [&](size_t incl_n) -> std::string {
+    if(unit->files.count(file_name)) return file_name; // given in memory
     if(incl_n == default_include_path.size()) { error("error: not found such file '%s'", file_name.c_str()); }
     std::ifstream ifs_src(default_include_path[incl_n] + file_name);
     if(!ifs_src) { return find_include_file(incl_n+1); }
@@ -179,8 +220,10 @@ void Lexer::read_include() {
   };
   Lexer lex; auto tok = lex.run(find_include_file(0));
   tok.token.pop_back(); // delete TOK_TYPE_END
-  for(auto t : tok.token)
+  for(auto t : tok.token) {
+    t.included = true;
     token.token.push_back(t);
+  }
   // std::copy(token.token.begin(), token.token.end(), std::back_inserter(tok.token));
 }
 
@@ -220,9 +263,9 @@ void Lexer::read_undef() {
   auto t = read_token();
   if(t.type == TOK_TYPE_IDENT)
     macro = t.val;
-  auto it = macro_map.find(macro);
-  if(it != macro_map.end()) // if macro was declared
-    macro_map.erase(it);
+  auto it = unit->macro_map.find(macro);
+  if(it != unit->macro_map.end()) // if macro was declared
+    unit->macro_map.erase(it);
 }
 
 token_t Lexer::read_defined_op() {
@@ -266,7 +309,6 @@ bool Lexer::read_constexpr() {
   auto tok = read_expr_line();
   tok.add_symbol_tok(";", 0);
   tok.add_end_tok();
-  puts("EVAL");
   // tok.show();
   tok.seek(0);
   Parser parser;
@@ -331,15 +373,13 @@ void Lexer::skip_cond_include() {
 
 bool Lexer::is_defined(std::string name) {
   // std::cout << name << " " << macro_map.count(name) << std::endl;
-  return macro_map.count(name);
+  return unit->macro_map.count(name);
 }
 
 void Lexer::replace_macro(std::string macro_name) {
-  auto macro = macro_map[macro_name];
-  puts("macro-entry");
+  auto macro = unit->macro_map[macro_name];
   // std::cout << macro.name << std::endl;
   // macro.rep.show();
-  puts("END");
   switch(macro.type) {
     case DEFINE_MACRO:          replace_macro_object(macro);
                                 break;
@@ -367,10 +407,10 @@ void Lexer::subst_macro(Token &tok, Token args, macro_t macro) {
 
 void Lexer::replace_macro_object(macro_t macro) {
   auto rep_tok = macro.rep;
-  puts("macro-object");
   // rep_tok.show();
   auto push_to_buffer = [&](token_t t) {
     t.hideset[macro.name] = true;
+    t.line = cur_line; // where it's used, not where it's defined
     buffer.push_back(t);
   };
   while(!rep_tok.is_end()) {
@@ -409,6 +449,7 @@ void Lexer::replace_macro_funclike(macro_t macro) {
   // TODO: implement subst and remove this redundancy code!
   auto push_to_buffer = [&](token_t t) {
     t.hideset[macro.name] = true;
+    t.line = cur_line; // where it's used, not where it's defined
     buffer.push_back(t);
   };
   for(; !tok.is_end();) {
@@ -454,7 +495,7 @@ void Lexer::add_macro_object(std::string name, std::vector<token_t> rep) {
   def.name = name;
   def.type = DEFINE_MACRO;
   def.rep = Token(rep);
-  macro_map[name] = def;
+  unit->macro_map[name] = def;
 }
 
 void Lexer::add_macro_funclike(std::string name, std::vector<std::string> args_name, std::vector<token_t> rep) {
@@ -463,5 +504,5 @@ void Lexer::add_macro_funclike(std::string name, std::vector<std::string> args_n
   def.type = DEFINE_FUNCLIKE_MACRO;
   def.args = args_name;
   def.rep = Token(rep);
-  macro_map[name] = def;
+  unit->macro_map[name] = def;
 }
@@ -22,14 +22,12 @@ struct macro_t {
   std::vector<std::string> args; // for function like macro
 };
 
-extern std::map<std::string, macro_t> macro_map;
-
 class Lexer {
   private:
     int cur_line = 1;
     Token token;
     std::string line;
-    std::ifstream ifs_src;
+    std::istringstream ifs_src; // the whole file, from unit->files or the disk
     std::vector<token_t> buffer;
 
     token_t read_token();
@@ -40,6 +38,7 @@ class Lexer {
     token_t tok_char  ();
     token_t tok_symbol();
     void skip_line    ();
+    void read_attribute(token_t);
 
     char replace_escape();
 
@@ -79,4 +78,8 @@ class Lexer {
     void add_macro_funclike(std::string name, std::vector<std::string> args_name, std::vector<token_t> rep);
   public:
     Token run(std::string);
+    // when set, run() hands over the tokens read so far each time there are
+    // chunk_size of them, and returns only the rest (see QCC::run_pipeline)
+    std::function<void(std::vector<token_t> &)> on_chunk;
+    size_t chunk_size = 1024;
 };
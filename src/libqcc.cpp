@@ -0,0 +1,91 @@
+#include "libqcc.hpp"
+#include "qcc.hpp"
+
+static const std::map<std::string, macro_t> no_macros;
+
+// "error: ..." without the "error: "
+static std::string strip_kind(const std::string &msg) {
+  for(const char *kind : { "error: ", "warning: " })
+    if(msg.compare(0, strlen(kind), kind) == 0) return msg.substr(strlen(kind));
+  return msg;
+}
+
+uint64_t JITModule::address(const std::string &name) {
+  if(uint64_t addr = engine->getFunctionAddress(name)) return addr;
+  return engine->getGlobalValueAddress(name);
+}
+
+// the pipeline of 'qcc -O<n>' up to the optimized module, in a new unit.
+// then() runs on the result, and may report errors with error() as well
+bool Compiler::compile(const std::string &name, const std::string &source, std::function<void()> then) {
+  diags.clear();
+  UNIT.reset(new unit_t);
+  unit_t *outer = unit;
+  unit = UNIT.get();
+  std::vector<std::string> warnings;
+  UNIT->warnings = &warnings;
+  UNIT->files = headers;
+  UNIT->files[name] = source;
+
+  std::string err;
+  { // gone before the unit its stages point into
+    QCC qcc(0, nullptr);
+    qcc.set_opt_level(opt_level, size_level);
+    qcc.set_output(OUTPUT_NONE);
+    qcc.set_quiet(true);
+    if(!UNIT->files.count("./include/qcc.h") && access("./include/qcc.h", R_OK) != 0)
+      qcc.set_prelude(&no_macros);
+    try {
+      qcc.run(name);
+      if(then) then();
+    } catch(compile_error &e) {
+      err = e.what();
+    }
+  }
+  if(UNIT) UNIT->warnings = nullptr; // then() may have taken it
+  unit = outer;
+
+  for(auto &w : warnings) diags.push_back({ DIAG_WARNING, name, strip_kind(w) });
+  if(!err.empty()) diags.push_back({ DIAG_ERROR, name, strip_kind(err) });
+  return err.empty();
+}
+
+llvm::Module *Compiler::compile_module(const std::string &name, const std::string &source) {
+  return compile(name, source) ? UNIT->mod : nullptr;
+}
+
+bool Compiler::compile_object(const std::string &name, const std::string &source, llvm::SmallVectorImpl<char> &obj) {
+  obj.clear();
+  return compile(name, source, [&]() {
+      llvm::raw_svector_ostream out(obj);
+      emit_native(*unit->mod, out, llvm::TargetMachine::CGFT_ObjectFile);
+  });
+}
+
+std::unique_ptr<JITModule> Compiler::compile_jit(const std::string &name, const std::string &source) {
+  std::unique_ptr<JITModule> jit;
+  bool ok = compile(name, source, [&]() {
+      static std::once_flag init; // the targets themselves are registered by now
+      std::call_once(init, []() {
+        llvm::InitializeNativeTargetAsmParser();
+        // symbols the code doesn't define are looked up in this process
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+      });
+      llvm::Module *m = unit->mod;
+      unit->mod = nullptr; // the engine's now
+      std::string err;
+      jit.reset(new JITModule);
+      jit->engine.reset(llvm::EngineBuilder(std::unique_ptr<llvm::Module>(m))
+          .setEngineKind(llvm::EngineKind::JIT)
+          .setErrorStr(&err)
+          .setOptLevel(codegen_opt_level(opt_level))
+          .setMCPU(llvm::sys::getHostCPUName())
+          .create());
+      if(!jit->engine) error("error: can't create the JIT: %s", err.c_str());
+      jit->engine->finalizeObject();
+      UNIT->warnings = nullptr;
+      jit->UNIT = std::move(UNIT);
+  });
+  if(!ok) jit.reset();
+  return jit;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.hpp"
+#include "unit.hpp"
+
+// libqcc: qcc as a library, for programs that build C at run time.
+// sources and headers come from memory and results stay in memory: nothing
+// is read from or written to disk but the headers a source includes and
+// doesn't supply. errors and warnings end up in Compiler::diags instead of
+// on stdout, and nothing calls exit().
+//
+// one thread at a time per Compiler. separate Compilers share nothing, so
+// they can compile on separate threads at once.
+
+enum DiagKind {
+  DIAG_ERROR,
+  DIAG_WARNING,
+};
+
+struct diag_t {
+  DiagKind kind;
+  std::string file; // the name the source was compiled as
+  std::string message;
+};
+
+// a module loaded for execution, along with its llvm context.
+// what it compiled stays callable as long as it lives
+class JITModule {
+  private:
+    std::unique_ptr<unit_t> UNIT; // first, so it goes after the engine
+    std::unique_ptr<llvm::ExecutionEngine> engine;
+    friend class Compiler;
+  public:
+    // the address of a function or global variable, 0 if there's none
+    uint64_t address(const std::string &name);
+};
+
+class Compiler {
+  private:
+    std::unique_ptr<unit_t> UNIT; // of the last compilation
+    bool compile(const std::string &name, const std::string &source, std::function<void()> then = nullptr);
+  public:
+    int opt_level = 0, size_level = 0;
+    // by the name #include "..." or <...> gives, found before anything on disk.
+    // "./include/qcc.h" replaces qcc's predefined macros, which are otherwise
+    // read from ./include/qcc.h if there is one
+    std::map<std::string, std::string> headers;
+    std::vector<diag_t> diags; // of the last compilation
+
+    // null on errors. the module is the compiler's, valid until the next call
+    llvm::Module *compile_module(const std::string &name, const std::string &source);
+    // a relocatable object for the host, false on errors
+    bool compile_object(const std::string &name, const std::string &source, llvm::SmallVectorImpl<char> &obj);
+    // null on errors
+    std::unique_ptr<JITModule> compile_jit(const std::string &name, const std::string &source);
+};
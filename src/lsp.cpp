@@ -0,0 +1,668 @@
+#include "lsp.hpp"
+#include "codegen.hpp"
+#include <fcntl.h>
+
+// ---- json
+
+json_t json_t::array() { json_t j; j.kind = ARRAY; return j; }
+json_t json_t::object() { json_t j; j.kind = OBJECT; return j; }
+
+const json_t &json_t::operator[](const std::string &key) const {
+  static const json_t null;
+  if(kind != OBJECT) return null;
+  auto it = o.find(key);
+  return it == o.end() ? null : it->second;
+}
+
+json_t &json_t::operator[](const std::string &key) {
+  kind = OBJECT;
+  return o[key];
+}
+
+static void dump_string(const std::string &s, std::string &out) {
+  out += '"';
+  for(unsigned char c : s) {
+    switch(c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if(c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else out += c;
+    }
+  }
+  out += '"';
+}
+
+static void dump(const json_t &j, std::string &out) {
+  switch(j.kind) {
+    case json_t::NUL: out += "null"; break;
+    case json_t::BOOL: out += j.b ? "true" : "false"; break;
+    case json_t::NUMBER: {
+      char buf[32];
+      if(j.n == (int64_t)j.n) snprintf(buf, sizeof(buf), "%lld", (long long)j.n);
+      else snprintf(buf, sizeof(buf), "%.17g", j.n);
+      out += buf;
+      break;
+    }
+    case json_t::STRING: dump_string(j.s, out); break;
+    case json_t::ARRAY:
+      out += '[';
+      for(size_t i = 0; i < j.a.size(); i++) {
+        if(i) out += ',';
+        dump(j.a[i], out);
+      }
+      out += ']';
+      break;
+    case json_t::OBJECT: {
+      out += '{';
+      bool first = true;
+      for(auto &m : j.o) {
+        if(!first) out += ',';
+        first = false;
+        dump_string(m.first, out);
+        out += ':';
+        dump(m.second, out);
+      }
+      out += '}';
+      break;
+    }
+  }
+}
+
+std::string json_t::dump() const {
+  std::string out;
+  ::dump(*this, out);
+  return out;
+}
+
+namespace {
+  struct json_reader {
+    const std::string &in;
+    size_t pos = 0;
+    json_reader(const std::string &s): in(s) {}
+
+    void space() { while(pos < in.size() && isspace((unsigned char)in[pos])) pos++; }
+    bool literal(const char *word) {
+      size_t len = strlen(word);
+      if(in.compare(pos, len, word) != 0) return false;
+      pos += len;
+      return true;
+    }
+    static void utf8(unsigned cp, std::string &out) {
+      if(cp < 0x80) out += (char)cp;
+      else if(cp < 0x800) out += (char)(0xc0 | cp >> 6), out += (char)(0x80 | (cp & 0x3f));
+      else if(cp < 0x10000) out += (char)(0xe0 | cp >> 12), out += (char)(0x80 | (cp >> 6 & 0x3f)), out += (char)(0x80 | (cp & 0x3f));
+      else out += (char)(0xf0 | cp >> 18), out += (char)(0x80 | (cp >> 12 & 0x3f)),
+           out += (char)(0x80 | (cp >> 6 & 0x3f)), out += (char)(0x80 | (cp & 0x3f));
+    }
+    bool hex4(unsigned &cp) {
+      if(pos + 4 > in.size()) return false;
+      cp = 0;
+      for(int i = 0; i < 4; i++) {
+        char c = in[pos++];
+        cp <<= 4;
+        if(c >= '0' && c <= '9') cp |= c - '0';
+        else if(c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+        else return false;
+      }
+      return true;
+    }
+    bool string(std::string &out) {
+      if(pos >= in.size() || in[pos] != '"') return false;
+      pos++;
+      while(pos < in.size()) {
+        char c = in[pos++];
+        if(c == '"') return true;
+        if(c != '\\') { out += c; continue; }
+        if(pos >= in.size()) return false;
+        switch(in[pos++]) {
+          case '"': out += '"'; break;
+          case '\\': out += '\\'; break;
+          case '/': out += '/'; break;
+          case 'b': out += '\b'; break;
+          case 'f': out += '\f'; break;
+          case 'n': out += '\n'; break;
+          case 'r': out += '\r'; break;
+          case 't': out += '\t'; break;
+          case 'u': {
+            unsigned cp;
+            if(!hex4(cp)) return false;
+            if(cp >= 0xd800 && cp < 0xdc00 && literal("\\u")) { // a surrogate pair
+              unsigned lo;
+              if(!hex4(lo)) return false;
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            utf8(cp, out);
+            break;
+          }
+          default: return false;
+        }
+      }
+      return false;
+    }
+    bool value(json_t &j) {
+      space();
+      if(pos >= in.size()) return false;
+      char c = in[pos];
+      if(c == '{') {
+        pos++;
+        j = json_t::object();
+        space();
+        if(pos < in.size() && in[pos] == '}') { pos++; return true; }
+        for(;;) {
+          std::string key;
+          space();
+          if(!string(key)) return false;
+          space();
+          if(pos >= in.size() || in[pos++] != ':') return false;
+          if(!value(j.o[key])) return false;
+          space();
+          if(pos >= in.size()) return false;
+          if(in[pos] == ',') { pos++; continue; }
+          if(in[pos++] == '}') return true;
+          return false;
+        }
+      }
+      if(c == '[') {
+        pos++;
+        j = json_t::array();
+        space();
+        if(pos < in.size() && in[pos] == ']') { pos++; return true; }
+        for(;;) {
+          j.a.push_back(json_t());
+          if(!value(j.a.back())) return false;
+          space();
+          if(pos >= in.size()) return false;
+          if(in[pos] == ',') { pos++; continue; }
+          if(in[pos++] == ']') return true;
+          return false;
+        }
+      }
+      if(c == '"') {
+        j = json_t("");
+        return string(j.s);
+      }
+      if(literal("true")) { j = json_t(true); return true; }
+      if(literal("false")) { j = json_t(false); return true; }
+      if(literal("null")) { j = json_t(); return true; }
+      const char *begin = in.c_str() + pos;
+      char *end;
+      double n = strtod(begin, &end);
+      if(end == begin) return false;
+      pos += end - begin;
+      j = json_t(n);
+      return true;
+    }
+  };
+}
+
+bool json_t::parse(const std::string &s, json_t &j) {
+  json_reader reader(s);
+  if(!reader.value(j)) return false;
+  reader.space();
+  return reader.pos == s.size();
+}
+
+// ---- the protocol
+
+namespace {
+  const int parse_error = -32700, method_not_found = -32601, internal_error = -32603;
+
+  double ms_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+  }
+
+  std::string path_of(const std::string &uri) {
+    std::string p = uri.compare(0, 7, "file://") == 0 ? uri.substr(7) : uri;
+    std::string out;
+    for(size_t i = 0; i < p.size(); i++) {
+      if(p[i] == '%' && i + 2 < p.size() && isxdigit((unsigned char)p[i + 1]) && isxdigit((unsigned char)p[i + 2])) {
+        out += (char)strtol(p.substr(i + 1, 2).c_str(), nullptr, 16);
+        i += 2;
+      } else out += p[i];
+    }
+    return out;
+  }
+
+  // the line "error(<line>): ..." names, 0 when it doesn't
+  int line_of(const std::string &msg) {
+    int line;
+    return sscanf(msg.c_str(), "error(%d)", &line) == 1 ? line : 0;
+  }
+
+  // "error(<line>): ..." and "error: ..." without the kind
+  std::string message_of(const std::string &msg) {
+    size_t colon = msg.find(": ");
+    if(msg.compare(0, 5, "error") == 0 && colon != std::string::npos) return msg.substr(colon + 2);
+    return msg;
+  }
+
+  json_t position(int line, int character) {
+    json_t p = json_t::object();
+    p["line"] = json_t(line - 1);
+    p["character"] = json_t(character);
+    return p;
+  }
+
+  json_t range(int line, int from, int to) {
+    json_t r = json_t::object();
+    r["start"] = position(line, from);
+    r["end"] = position(line, to);
+    return r;
+  }
+
+  bool ident_char(char c) { return isalnum((unsigned char)c) || c == '_'; }
+}
+
+bool LanguageServer::read_message(std::string &body) {
+  size_t length = 0;
+  bool any = false;
+  char line[1024];
+  while(fgets(line, sizeof(line), stdin)) {
+    if(!strcmp(line, "\r\n") || !strcmp(line, "\n")) {
+      if(!any) continue;
+      body.assign(length, '\0');
+      return fread(&body[0], 1, length, stdin) == length;
+    }
+    any = true;
+    unsigned long n;
+    if(sscanf(line, "Content-Length: %lu", &n) == 1) length = n;
+  }
+  return false;
+}
+
+void LanguageServer::send(const json_t &msg) {
+  json_t m = msg;
+  m["jsonrpc"] = json_t("2.0");
+  std::string body = m.dump();
+  std::string data = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  const char *p = data.c_str();
+  size_t n = data.size();
+  while(n > 0) {
+    ssize_t w = write(out, p, n);
+    if(w < 0 && errno == EINTR) continue;
+    if(w <= 0) return; // the editor went away, and stdin ends soon
+    p += w, n -= w;
+  }
+}
+
+void LanguageServer::publish(const std::string &uri, const document_t &d) {
+  json_t diags = json_t::array();
+  auto add = [&](int line, const std::string &msg) {
+    if(line < 1 || line > (int)d.lines.size()) line = 1;
+    size_t begin = d.lines[line - 1];
+    size_t end = line < (int)d.lines.size() ? d.lines[line] - 1 : d.text.size();
+    json_t diag = json_t::object();
+    diag["range"] = range(line, 0, (int)(end - begin));
+    diag["severity"] = json_t(1);
+    diag["source"] = json_t("qcc");
+    diag["message"] = json_t(message_of(msg));
+    diags.a.push_back(diag);
+  };
+  for(auto &e : d.errors) add(line_of(e), e);
+  for(auto &decl : d.decls)
+    if(!decl.error.empty()) add(decl.first + decl.error_line, decl.error);
+  json_t params = json_t::object();
+  params["uri"] = json_t(uri);
+  params["diagnostics"] = diags;
+  json_t msg = json_t::object();
+  msg["method"] = json_t("textDocument/publishDiagnostics");
+  msg["params"] = params;
+  send(msg);
+}
+
+// ---- analysis
+
+static void index_lines(const std::string &text, std::vector<size_t> &lines) {
+  lines.assign(1, 0);
+  for(size_t i = 0; i < text.size(); i++)
+    if(text[i] == '\n') lines.push_back(i + 1);
+}
+
+// what's left of p's declarations in tok, into out. false on an error when
+// stop_on_error, otherwise the parser skips what it couldn't read and the
+// error stays with that declaration
+bool LanguageServer::parse_decls(Parser &p, Token tok, std::vector<decl_t> &out, bool stop_on_error,
+                                 std::vector<std::string> *header_errors) {
+  std::vector<Parser::site_t> sites;
+  p.sites = &sites;
+  p.nest = 0;
+  p.start(std::move(tok));
+  for(;;) {
+    unsigned types = p.type_decls;
+    size_t typedefs = p.typedef_map.size(), enums = p.enum_list.size();
+    std::string error;
+    sites.clear();
+    try {
+      AST *st;
+      if(!p.next(st)) break;
+      if(st) delete_ast(AST_vec{ st });
+    } catch(compile_error &e) {
+      if(stop_on_error) {
+        p.sites = nullptr;
+        return false;
+      }
+      error = e.what();
+      p.recover();
+    }
+    // where it is in the file. what came from headers has lines of its own
+    int first = INT_MAX, last = 0;
+    for(auto &t : p.last_declaration()) {
+      if(t.included || t.line <= 0) continue;
+      first = std::min(first, t.line);
+      last = std::max(last, t.line);
+    }
+    if(!last) {
+      if(!error.empty() && header_errors) header_errors->push_back(error);
+      continue;
+    }
+    decl_t d;
+    d.first = first, d.last = last;
+    d.types = p.type_decls != types || p.typedef_map.size() != typedefs || p.enum_list.size() != enums;
+    for(auto &s : sites)
+      if(s.line >= first && s.line <= last) d.sites.push_back(Parser::site_t{ s.name, s.line - first, s.global });
+    if(!error.empty()) {
+      d.error = error;
+      int line = line_of(error);
+      d.error_line = line >= first && line <= last ? line - first : 0;
+    }
+    out.push_back(d);
+  }
+  p.sites = nullptr;
+  return true;
+}
+
+// the whole file, in a unit of its own
+void LanguageServer::analyze(document_t &d) {
+  d.parser.reset(); // before the unit its types are in
+  d.UNIT.reset(new unit_t);
+  d.decls.clear();
+  d.errors.clear();
+  index_lines(d.text, d.lines);
+  unit = d.UNIT.get();
+  unit->target_machine = create_target_machine(0);
+  unit->mod = new llvm::Module("QCC", unit->context);
+  unit->mod->setDataLayout(unit->target_machine->createDataLayout());
+  unit->data_layout = new llvm::DataLayout(unit->mod);
+  unit->files[d.path] = d.text;
+  if(has_prelude) unit->macro_map = prelude;
+
+  Token tok;
+  try {
+    Lexer lex;
+    tok = lex.run(d.path);
+  } catch(compile_error &e) {
+    d.errors.push_back(e.what());
+    unit = nullptr;
+    return;
+  }
+  d.parser.reset(new Parser);
+  parse_decls(*d.parser, std::move(tok), d.decls, false, &d.errors);
+  unit = nullptr;
+
+  d.macros_stable = true;
+  if(!d.decls.empty())
+    for(size_t l = d.decls[0].first; l <= d.lines.size(); l++) {
+      size_t i = d.lines[l - 1];
+      while(i < d.text.size() && (d.text[i] == ' ' || d.text[i] == '\t')) i++;
+      if(i < d.text.size() && d.text[i] == '#') { d.macros_stable = false; break; }
+    }
+}
+
+// text in place of range, re-parsing what it touched when reparse. false
+// when the file has to be analyzed again instead, which the text is ready for
+bool LanguageServer::edit(document_t &d, const json_t &r, const std::string &text, bool reparse, size_t &reparsed) {
+  auto offset = [&](const json_t &pos) {
+    size_t line = (size_t)pos["line"].n, character = (size_t)pos["character"].n;
+    if(line >= d.lines.size()) return d.text.size();
+    size_t end = line + 1 < d.lines.size() ? d.lines[line + 1] - 1 : d.text.size();
+    return std::min(d.lines[line] + character, end);
+  };
+  int a = (int)r["start"]["line"].n + 1, b = (int)r["end"]["line"].n + 1; // in the old text
+  size_t from = offset(r["start"]), to = std::max(from, offset(r["end"]));
+  std::string old = d.text.substr(from, to - from);
+  int added = (int)std::count(text.begin(), text.end(), '\n') - (int)std::count(old.begin(), old.end(), '\n');
+  int old_lines = (int)d.lines.size();
+  d.text.replace(from, to - from, text);
+  index_lines(d.text, d.lines);
+
+  auto &ds = d.decls;
+  size_t n = ds.size();
+  if(!reparse || !d.parser || !d.errors.empty() || !d.macros_stable || !n) return false;
+  if(old.find('#') != std::string::npos || text.find('#') != std::string::npos) return false;
+  // the declarations the edit touched, [lo, hi), those sharing a line with
+  // them, and the broken ones right after: what recovery made of their tail
+  size_t lo = 0;
+  while(lo < n && ds[lo].last < a) lo++;
+  size_t hi = lo;
+  while(hi < n && ds[hi].first <= b) hi++;
+  while(lo > 0 && lo < hi && ds[lo - 1].last >= ds[lo].first) lo--;
+  while(hi < n && hi > lo && (ds[hi].first <= ds[hi - 1].last || !ds[hi].error.empty())) hi++;
+  if(lo == 0 && a < ds[0].first) return false; // above the first: #includes and such
+  for(size_t i = lo; i < hi; i++)
+    if(ds[i].types) return false;
+
+  // the lines between the declarations kept, in the new text
+  int start = lo > 0 ? ds[lo - 1].last + 1 : ds[0].first;
+  int end = (hi < n ? ds[hi].first - 1 : old_lines) + added;
+  std::string part;
+  if(start <= end && start <= (int)d.lines.size()) {
+    size_t begin = d.lines[start - 1];
+    size_t stop = end < (int)d.lines.size() ? d.lines[end] : d.text.size();
+    part = d.text.substr(begin, stop - begin);
+  }
+  // a comment left open around it would change what it means
+  auto opens = [](const std::string &s) {
+    int open = 0;
+    for(size_t i = 0; i + 1 < s.size(); i++) {
+      if(s[i] == '/' && s[i + 1] == '*') open++, i++;
+      else if(s[i] == '*' && s[i + 1] == '/') open--, i++;
+    }
+    return open;
+  };
+  if(opens(part) != 0) return false;
+  if(lo > 0) {
+    int l = ds[lo - 1].last;
+    size_t e = l < (int)d.lines.size() ? d.lines[l] : d.text.size();
+    if(opens(d.text.substr(d.lines[l - 1], e - d.lines[l - 1])) != 0) return false;
+  }
+
+  // with recovery, as the whole file is: what's being typed is mostly broken,
+  // and its errors stay with the declarations they're in
+  unit = d.UNIT.get();
+  std::vector<decl_t> fresh;
+  Token tok;
+  try {
+    unit->files["<edit>"] = part;
+    Lexer lex;
+    tok = lex.run("<edit>");
+    unit->files.erase("<edit>");
+    for(auto &t : tok.token) t.line += start - 1;
+    parse_decls(*d.parser, std::move(tok), fresh, false, nullptr);
+  } catch(compile_error &e) {
+    // the lexer's, on lines of the part: the whole part is one broken declaration
+    unit->files.erase("<edit>");
+    decl_t broken;
+    broken.first = start, broken.last = std::max(start, end);
+    broken.error = e.what();
+    broken.error_line = std::min(std::max(line_of(broken.error) - 1, 0), broken.last - broken.first);
+    fresh.assign(1, broken);
+  }
+  unit = nullptr;
+  for(auto &f : fresh) if(f.types) return false;
+
+  for(size_t i = hi; i < n; i++) ds[i].first += added, ds[i].last += added;
+  ds.erase(ds.begin() + lo, ds.begin() + hi);
+  ds.insert(ds.begin() + lo, fresh.begin(), fresh.end());
+  reparsed = fresh.size();
+  return true;
+}
+
+// where the name at line (from 1) and character is declared: in the
+// declaration around it before that line, or else at the top level
+json_t LanguageServer::definition(const std::string &uri, const document_t &d, int line, int character) {
+  if(line < 1 || line > (int)d.lines.size()) return json_t();
+  size_t begin = d.lines[line - 1];
+  size_t end = line < (int)d.lines.size() ? d.lines[line] - 1 : d.text.size();
+  size_t at = std::min(begin + character, end);
+  size_t s = at, e = at;
+  while(s > begin && ident_char(d.text[s - 1])) s--;
+  while(e < end && ident_char(d.text[e])) e++;
+  if(s == e) return json_t();
+  std::string name = d.text.substr(s, e - s);
+
+  auto location = [&](int l) {
+    // tokens have lines only: the first time the name is on that line
+    size_t b = d.lines[l - 1], f = b;
+    size_t le = l < (int)d.lines.size() ? d.lines[l] - 1 : d.text.size();
+    for(f = d.text.find(name, b); f != std::string::npos && f < le; f = d.text.find(name, f + 1))
+      if((f == b || !ident_char(d.text[f - 1])) && (f + name.size() >= le || !ident_char(d.text[f + name.size()]))) break;
+    int col = f != std::string::npos && f < le ? (int)(f - b) : 0;
+    json_t loc = json_t::object();
+    loc["uri"] = json_t(uri);
+    loc["range"] = range(l, col, col + (int)name.size());
+    return loc;
+  };
+
+  for(auto &decl : d.decls) {
+    if(line < decl.first || line > decl.last) continue;
+    const Parser::site_t *nearest = nullptr;
+    for(auto &site : decl.sites)
+      if(!site.global && site.name == name && decl.first + site.line <= line) nearest = &site;
+    if(nearest) return location(decl.first + nearest->line);
+  }
+  json_t locs = json_t::array();
+  for(auto &decl : d.decls)
+    for(auto &site : decl.sites)
+      if(site.global && site.name == name) locs.a.push_back(location(decl.first + site.line));
+  return locs.a.empty() ? json_t() : locs;
+}
+
+int LanguageServer::run() {
+  out = dup(1);
+  int null = open("/dev/null", O_WRONLY);
+  if(out < 0 || null < 0) error("error: --lsp: can't set up stdout");
+  dup2(null, 1); // warnings, and the tokens around a syntax error, print there
+  close(null);
+  delete create_target_machine(0); // registers the targets
+  if(access("./include/qcc.h", R_OK) == 0) {
+    unit_t u;
+    unit = &u;
+    try {
+      Lexer lex; lex.run("./include/qcc.h");
+      prelude = std::move(u.macro_map);
+      has_prelude = true;
+    } catch(compile_error &) {}
+    unit = nullptr;
+  }
+
+  bool shutdown = false;
+  for(std::string body; read_message(body); ) {
+    json_t msg;
+    if(!json_t::parse(body, msg)) {
+      json_t err = json_t::object(), reply = json_t::object();
+      err["code"] = json_t(parse_error);
+      err["message"] = json_t("can't parse the message");
+      reply["id"] = json_t();
+      reply["error"] = err;
+      send(reply);
+      continue;
+    }
+    const std::string &method = msg["method"].s;
+    const json_t &params = msg["params"];
+    bool request = msg.has("id");
+    if(method == "exit") break;
+    json_t result;
+    try {
+      auto begin = std::chrono::steady_clock::now();
+      if(method == "initialize") {
+        json_t sync = json_t::object(), caps = json_t::object(), info = json_t::object();
+        sync["openClose"] = json_t(true);
+        sync["change"] = json_t(2); // incremental
+        caps["textDocumentSync"] = sync;
+        caps["definitionProvider"] = json_t(true);
+        info["name"] = json_t("qcc");
+        info["version"] = json_t(qcc_build());
+        result["capabilities"] = caps;
+        result["serverInfo"] = info;
+      } else if(method == "shutdown") {
+        shutdown = true;
+      } else if(method == "textDocument/didOpen") {
+        const std::string &uri = params["textDocument"]["uri"].s;
+        document_t &d = documents[uri];
+        d.path = path_of(uri);
+        d.text = params["textDocument"]["text"].s;
+        analyze(d);
+        llvm::errs() << "qcc --lsp: " << d.path << ": " << d.decls.size() << " declarations parsed in "
+                     << ms_since(begin) << " ms\n";
+        publish(uri, d);
+      } else if(method == "textDocument/didChange") {
+        const std::string &uri = params["textDocument"]["uri"].s;
+        auto it = documents.find(uri);
+        if(it != documents.end()) {
+          document_t &d = it->second;
+          bool again = false;
+          size_t reparsed = 0;
+          for(auto &change : params["contentChanges"].a) {
+            size_t r = 0;
+            if(!change.has("range")) {
+              d.text = change["text"].s;
+              again = true;
+            } else if(!edit(d, change["range"], change["text"].s, !again, r)) {
+              again = true;
+            } else reparsed += r;
+          }
+          if(again) analyze(d);
+          llvm::errs() << "qcc --lsp: " << d.path << ": ";
+          if(again) llvm::errs() << d.decls.size() << " declarations parsed";
+          else llvm::errs() << reparsed << " of " << d.decls.size() << " declarations re-parsed";
+          llvm::errs() << " in " << ms_since(begin) << " ms\n";
+          publish(uri, d);
+        }
+      } else if(method == "textDocument/didClose") {
+        const std::string &uri = params["textDocument"]["uri"].s;
+        documents.erase(uri);
+        document_t none;
+        publish(uri, none);
+      } else if(method == "textDocument/definition") {
+        auto it = documents.find(params["textDocument"]["uri"].s);
+        if(it != documents.end())
+          result = definition(it->first, it->second, (int)params["position"]["line"].n + 1,
+                              (int)params["position"]["character"].n);
+      } else if(request) {
+        json_t err = json_t::object(), reply = json_t::object();
+        err["code"] = json_t(method_not_found);
+        err["message"] = json_t("not supported: " + method);
+        reply["id"] = msg["id"];
+        reply["error"] = err;
+        send(reply);
+        continue;
+      }
+    } catch(compile_error &e) { // not of the file: the target, say
+      unit = nullptr;
+      if(request) {
+        json_t err = json_t::object(), reply = json_t::object();
+        err["code"] = json_t(internal_error);
+        err["message"] = json_t(std::string(e.what()));
+        reply["id"] = msg["id"];
+        reply["error"] = err;
+        send(reply);
+      }
+      continue;
+    }
+    if(request) {
+      json_t reply = json_t::object();
+      reply["id"] = msg["id"];
+      reply["result"] = result;
+      send(reply);
+    }
+  }
+  return shutdown ? 0 : 1;
+}
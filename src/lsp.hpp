@@ -0,0 +1,81 @@
+#pragma once
+
+#include "common.hpp"
+#include "unit.hpp"
+#include "parse.hpp"
+
+// just enough JSON for the language server protocol
+struct json_t {
+  enum kind_t { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } kind = NUL;
+  bool b = false;
+  double n = 0;
+  std::string s;
+  std::vector<json_t> a;
+  std::map<std::string, json_t> o;
+
+  json_t() {}
+  json_t(bool v): kind(BOOL), b(v) {}
+  json_t(int v): kind(NUMBER), n(v) {}
+  json_t(double v): kind(NUMBER), n(v) {}
+  json_t(const char *v): kind(STRING), s(v) {}
+  json_t(const std::string &v): kind(STRING), s(v) {}
+  static json_t array();
+  static json_t object();
+
+  bool has(const std::string &key) const { return kind == OBJECT && o.count(key); }
+  const json_t &operator[](const std::string &key) const; // null when it isn't there
+  json_t &operator[](const std::string &key); // added when it isn't there
+  std::string dump() const;
+  static bool parse(const std::string &, json_t &);
+};
+
+// qcc --lsp: a language server on stdin and stdout, for editors. it reports
+// what the lexer and the parser find wrong as a file is edited, and where
+// the names in it are declared. stdout is the protocol's alone: whatever
+// else would print there goes to /dev/null, and stderr gets how long each
+// analysis took.
+//
+// each open file keeps its top-level declarations: their lines, and the
+// names each declares at lines relative to its first, so an edit above a
+// declaration only moves its first line. an edit re-lexes and re-parses the
+// declarations it touched, with the parser as it was after the whole file,
+// recovering from errors as it does there: a declaration being typed is
+// re-parsed on its own however broken it is. the whole file is analyzed
+// again when that can't be trusted: preprocessor lines in or after the
+// edit, or structs, unions, enums or typedefs declared in it.
+// positions count bytes, where LSP counts UTF-16 code units: the same for
+// ASCII sources.
+class LanguageServer {
+  private:
+    struct decl_t {
+      int first, last; // lines in the file, from 1
+      bool types = false; // declares structs, unions, enums or typedefs
+      std::vector<Parser::site_t> sites; // lines relative to first
+      std::string error; // the parser's, when it failed on this one
+      int error_line = 0; // relative to first
+    };
+    struct document_t {
+      std::string path, text;
+      std::vector<size_t> lines; // where each line starts in text, from line 1
+      std::unique_ptr<unit_t> UNIT; // before the parser, whose types live in it
+      std::unique_ptr<Parser> parser; // as it was after the whole file
+      std::vector<decl_t> decls; // of the file itself, not of its headers
+      std::vector<std::string> errors; // of the lexer or of headers, on line 1
+      bool macros_stable = false; // no preprocessor lines after the first declaration
+    };
+    std::map<std::string, document_t> documents; // by uri
+    std::map<std::string, macro_t> prelude; // of ./include/qcc.h
+    bool has_prelude = false;
+    int out = -1; // the real stdout
+
+    bool read_message(std::string &);
+    void send(const json_t &);
+    void publish(const std::string &uri, const document_t &);
+
+    void analyze(document_t &);
+    bool edit(document_t &, const json_t &range, const std::string &text, bool reparse, size_t &reparsed);
+    bool parse_decls(Parser &, Token, std::vector<decl_t> &, bool stop_on_error, std::vector<std::string> *header_errors);
+    json_t definition(const std::string &uri, const document_t &, int line, int character);
+  public:
+    int run();
+};
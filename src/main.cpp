@@ -5,5 +5,10 @@
 
 int main(int argc, char *argv[]) {
   QCC qcc(argc, argv);
-  qcc.run();
+  try {
+    return qcc.run();
+  } catch(compile_error &e) { // bad options, before any file
+    puts(e.what());
+    return 1;
+  }
 }
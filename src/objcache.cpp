@@ -0,0 +1,138 @@
+#include "objcache.hpp"
+
+DiskObjectCache::DiskObjectCache(const std::string &_dir, uint64_t _max_size, int opt_level):
+  dir(_dir), max_size(_max_size) {
+  llvm::sys::fs::create_directories(dir);
+  llvm::StringMap<bool> features;
+  llvm::sys::getHostCPUFeatures(features);
+  std::vector<std::string> enabled;
+  for(auto &f : features) if(f.second) enabled.push_back(f.first().str());
+  std::sort(enabled.begin(), enabled.end());
+  salt = "O" + std::to_string(opt_level) + ";" + llvm::sys::getHostCPUName().str();
+  for(auto &f : enabled) salt += ",+" + f;
+}
+
+std::string DiskObjectCache::key(const llvm::Module *m) {
+  auto k = keys.find(m);
+  if(k != keys.end()) return k->second;
+  llvm::SmallString<0> bitcode;
+  {
+    llvm::raw_svector_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(m, os);
+  }
+  llvm::MD5 md5;
+  md5.update(salt);
+  md5.update(bitcode.str());
+  llvm::MD5::MD5Result result;
+  md5.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return keys[m] = hex.str().str();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(const llvm::Module *m) {
+  std::string path = dir + "/" + key(m) + ".o";
+  auto buf = llvm::MemoryBuffer::getFile(path);
+  if(!buf) {
+    misses++;
+    return nullptr;
+  }
+  hits++;
+  keys.erase(m);
+  utime(path.c_str(), nullptr); // recently used
+  return std::move(*buf);
+}
+
+// written aside, hidden, and renamed, so another qcc never reads half a file
+static bool write_file(const std::string &dir, const std::string &name, llvm::StringRef data) {
+  std::string path = dir + "/" + name, tmp = dir + "/." + name + "." + std::to_string(getpid());
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream out(tmp, EC, llvm::sys::fs::F_None);
+    if(EC) return false;
+    out << data;
+  }
+  if(rename(tmp.c_str(), path.c_str())) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module *m, llvm::MemoryBufferRef obj) {
+  std::string name = key(m) + ".o";
+  keys.erase(m);
+  if(write_file(dir, name, obj.getBuffer())) evict_lru(dir, max_size); // or no cache this time
+}
+
+// <32 hex digits> of OutputCache, or <32 hex digits>.o of DiskObjectCache.
+// the directory may be shared with anything else, which isn't ours to remove
+static bool is_entry(const std::string &name) {
+  if(name.size() != 32 && !(name.size() == 34 && !name.compare(32, 2, ".o"))) return false;
+  for(size_t i = 0; i < 32; i++)
+    if(!isxdigit((unsigned char)name[i])) return false;
+  return true;
+}
+
+void evict_lru(const std::string &dir, uint64_t max_size) {
+  struct entry_t { std::string path; time_t used; uint64_t size; };
+  std::vector<entry_t> entries;
+  uint64_t total = 0;
+  DIR *d = opendir(dir.c_str());
+  if(!d) return;
+  while(struct dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if(!is_entry(name)) continue;
+    struct stat st;
+    std::string path = dir + "/" + name;
+    if(stat(path.c_str(), &st) || !S_ISREG(st.st_mode)) continue;
+    entries.push_back(entry_t{path, st.st_mtime, (uint64_t)st.st_size});
+    total += st.st_size;
+  }
+  closedir(d);
+  if(total <= max_size) return;
+  std::sort(entries.begin(), entries.end(), 
+      [](const entry_t &a, const entry_t &b) { return a.used < b.used; });
+  for(auto &e : entries) {
+    if(total <= max_size) break;
+    if(!unlink(e.path.c_str())) total -= e.size;
+  }
+}
+
+uint64_t cache_size_limit() {
+  if(const char *size = getenv("QCC_CACHE_SIZE")) return strtoull(size, nullptr, 10) << 20;
+  return 64 << 20;
+}
+
+OutputCache::OutputCache(const std::string &_dir, uint64_t _max_size):
+  dir(_dir), max_size(_max_size) {
+  llvm::sys::fs::create_directories(dir);
+}
+
+bool OutputCache::fetch(const std::string &key, const std::string &file) {
+  std::string path = dir + "/" + key;
+  auto buf = llvm::MemoryBuffer::getFile(path);
+  if(!buf) {
+    misses++;
+    return false;
+  }
+  std::error_code EC;
+  llvm::raw_fd_ostream out(file, EC, llvm::sys::fs::F_None);
+  if(EC) error("error: can't write '%s': %s", file.c_str(), EC.message().c_str());
+  out << (*buf)->getBuffer();
+  hits++;
+  utime(path.c_str(), nullptr); // recently used
+  return true;
+}
+
+void OutputCache::store(const std::string &key, const std::string &file) {
+  auto buf = llvm::MemoryBuffer::getFile(file);
+  if(buf && write_file(dir, key, (*buf)->getBuffer())) evict_lru(dir, max_size);
+}
+
+std::string DiskObjectCache::default_dir() {
+  if(const char *d = getenv("QCC_CACHE_DIR")) return d;
+  if(const char *d = getenv("XDG_CACHE_HOME")) return std::string(d) + "/qcc";
+  if(const char *d = getenv("HOME")) return std::string(d) + "/.cache/qcc";
+  return "";
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.hpp"
+
+// llvm::ObjectCache on disk, so -run doesn't compile unchanged code again.
+// an object is keyed by the MD5 of its module's bitcode, the optimization
+// level and the host cpu with its features: it's only reused for the same IR
+// on the same kind of machine.
+// files are <key>.o in one directory. a hit touches the file, and after every
+// store the least recently used ones are removed until they fit in max_size
+// bytes. other files in the directory are left alone.
+class DiskObjectCache : public llvm::ObjectCache {
+  private:
+    std::string dir;
+    uint64_t max_size;
+    std::string salt; // what besides the IR decides the object
+    std::map<const llvm::Module *, std::string> keys; // computed in getObject, reused when stored
+
+    std::string key(const llvm::Module *);
+  public:
+    size_t hits = 0, misses = 0;
+
+    DiskObjectCache(const std::string &dir, uint64_t max_size, int opt_level);
+    void notifyObjectCompiled(const llvm::Module *, llvm::MemoryBufferRef) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) override;
+
+    // $QCC_CACHE_DIR, or qcc/ in $XDG_CACHE_HOME or ~/.cache
+    static std::string default_dir();
+};
+
+// qcc -cache: outputs (bitcode, assembly or objects) by a key that
+// QCC::cache_key computes from the preprocessed source and the options.
+// a hit is copied to the output and nothing is parsed or compiled.
+// entries are files named by their key in one directory, kept to max_size
+// bytes like DiskObjectCache's
+class OutputCache {
+  private:
+    std::string dir;
+    uint64_t max_size;
+  public:
+    size_t hits = 0, misses = 0;
+
+    OutputCache(const std::string &dir, uint64_t max_size);
+    // copies the entry for key to file, false if there's none
+    bool fetch(const std::string &key, const std::string &file);
+    void store(const std::string &key, const std::string &file);
+};
+
+// removes the least recently used entries in dir until they take up no more
+// than max_size bytes. only files named like a cache key count: others, and
+// hidden ones being written, are left alone
+void evict_lru(const std::string &dir, uint64_t max_size);
+
+// $QCC_CACHE_SIZE MiB, or 64
+uint64_t cache_size_limit();
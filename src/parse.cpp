@@ -1,8 +1,22 @@
 #include "parse.hpp"
 #include "codegen.hpp"
 
+// types are made under unit->types_lock, since codegen may be making its own
+// on another thread (-pipeline)
+
+static llvm::Type *pointer_to(llvm::Type *t) {
+  types_guard guard;
+  return t->getPointerTo();
+}
+
 AST_vec Parser::run(Token tok, bool isexpr) {
-  token = tok;
+  start(std::move(tok));
+  if(isexpr) return AST_vec{expr_entry()};
+  return eval();
+}
+
+void Parser::start(Token tok) {
+  token = std::move(tok);
   op_prec["."] =  600;  
   op_prec["*"] =  500;
   op_prec["/"] =  500;
@@ -23,20 +37,57 @@ AST_vec Parser::run(Token tok, bool isexpr) {
   op_prec["&&"] = 200;
   op_prec["||"] = 200;
   op_prec["?"] =  100;
-  if(isexpr) return AST_vec{expr_entry()};
-  return eval();
 }
 
 AST_vec Parser::eval() {
   AST_vec program;
-  while(token.get().type != TOK_TYPE_END) {
-    auto st = statement_top();
+  for(AST *st; next(st); )
     if(st) program.push_back(st);
-    while(token.skip(";"));
-  }
   return program;
 }
 
+bool Parser::next(AST *&st) {
+  token.drop_consumed(); // nothing looks back past a top-level declaration
+  if(token.get().type == TOK_TYPE_END) return false;
+  decl_begin = token.pos;
+  st = statement_top();
+  while(token.skip(";"));
+  no_progress(decl_begin);
+  return true;
+}
+
+void Parser::no_progress(size_t pos) {
+  if(token.pos != pos) return;
+  if(token.get().type == TOK_TYPE_END) error("error: program reached EOF");
+  error("error(%d): unexpected '%s'", token.get().line, token.get().val.c_str());
+}
+
+void Parser::recover() {
+  nest = 0;
+  token.pos = decl_begin;
+  int depth = 0;
+  while(token.get().type != TOK_TYPE_END) {
+    token_t t = token.next();
+    if(t.type != TOK_TYPE_SYMBOL) continue;
+    if(t.val == "(" || t.val == "[" || t.val == "{") depth++;
+    else if(t.val == ")" || t.val == "]") depth = std::max(depth - 1, 0);
+    else if(t.val == "}" && --depth <= 0) break;
+    else if(t.val == ";" && depth == 0) break;
+  }
+  while(token.skip(";"));
+}
+
+std::vector<token_t> Parser::last_declaration() {
+  return std::vector<token_t>(token.token.begin() + decl_begin, token.token.begin() + token.pos);
+}
+
+void Parser::declared(const token_t &t) {
+  if(!sites) return;
+  // declarators in parentheses are read twice, see read_declarator
+  if(!sites->empty() && sites->back().name == t.val && sites->back().line == t.line) return;
+  sites->push_back(site_t{ t.val, t.line, nest == 0 });
+}
+
 AST *Parser::statement_top() {
   if(is_function_def()) return make_function();
   if(is_function_proto()) return make_function_proto();
@@ -63,15 +114,17 @@ AST *Parser::statement() {
 AST *Parser::read_declaration() {
   int stg = STG_NONE;
   llvm::Type *basety = read_type_spec(stg);
+  int qual = type_qual;
   if(token.skip(";")) return nullptr;
   std::vector<declarator_t *> decls;
   while(1) {
     std::string name;
     llvm::Type *type = read_declarator(name, basety);
+    read_attribute();
     AST *init_expr = nullptr;
     if(token.skip("=")) 
       init_expr = expr_entry();
-    decls.push_back(new declarator_t(type, name, init_expr));
+    decls.push_back(new declarator_t(type, name, init_expr, qual));
     if(token.skip(";")) break;
     token.expect_skip(",");
   }
@@ -85,7 +138,7 @@ llvm::Type *Parser::read_declarator(std::string &name, llvm::Type *basety) {
 llvm::Type *Parser::read_declarator(std::string &name, llvm::Type *basety, std::vector<argument_t *> &param) {
   if(token.skip("(")) { // TODO: WHAT A F**K CODE??!! FIXME!!
     int pos_bgn = token.pos;
-    llvm::Type *s = builder.getVoidTy();
+    llvm::Type *s = unit->builder.getVoidTy();
     llvm::Type *type = read_declarator(name, s);  
     token.expect_skip(")");
     auto ft = read_declarator_tail(basety, param);
@@ -98,18 +151,23 @@ llvm::Type *Parser::read_declarator(std::string &name, llvm::Type *basety, std::
   }
   if(token.skip("*")) {
     while(token.skip("const") || token.skip("volatile"));
-    return read_declarator(name, basety->isVoidTy() ? builder.getInt8PtrTy() : basety->getPointerTo(), param);
+    return read_declarator(name, pointer_to(basety->isVoidTy() ? unit->builder.getInt8Ty() : basety), param);
   }
   if(token.get().type == TOK_TYPE_IDENT) {
-    name = token.next().val;
+    token_t t = token.next();
+    name = t.val;
+    declared(t);
     return read_declarator_tail(basety, param);
   }
   return read_declarator_tail(basety, param);
 }
 
 llvm::Type *Parser::read_declarator_tail(llvm::Type *basety, std::vector<argument_t *> &param) {
-  if(token.skip(":")) 
-    return builder.getIntNTy(static_cast<NumberAST *>(read_number())->i_number);
+  if(token.skip(":")) {
+    unsigned bits = static_cast<NumberAST *>(read_number())->i_number;
+    types_guard guard;
+    return unit->builder.getIntNTy(bits);
+  }
   if(token.skip("[")) 
     return read_declarator_array(basety);
   if(token.skip("(")) {
@@ -129,12 +187,15 @@ llvm::Type *Parser::read_declarator_array(llvm::Type *basety) {
   }
   std::vector<argument_t *> _;
   llvm::Type *t = read_declarator_tail(basety, _);
-  if(len == -1) return t->getPointerTo();
+  if(len == -1) return pointer_to(t);
+  types_guard guard;
   return llvm::ArrayType::get(t, len);
 }
 
 llvm::Type *Parser::read_declarator_func(llvm::Type *basety, std::vector<argument_t *> &param) {
+  nest++;
   param = read_declarator_param();
+  nest--;
 
   bool has_vararg = false;
   std::vector<llvm::Type *> llvm_param;
@@ -142,18 +203,19 @@ llvm::Type *Parser::read_declarator_func(llvm::Type *basety, std::vector<argumen
     if(a->type == nullptr) has_vararg = true;
     else llvm_param.push_back(a->type); 
   }
+  types_guard guard;
   llvm::FunctionType *llvm_func_type = 
     llvm::FunctionType::get(basety, llvm_param, has_vararg); 
   return llvm_func_type;
 }
 
-llvm::Type *Parser::read_func_param(std::string &name) {
-  llvm::Type *basety = builder.getInt32Ty();
-  if(is_type()) basety = read_type_spec();
+llvm::Type *Parser::read_func_param(std::string &name, int &qual) {
+  llvm::Type *basety = unit->builder.getInt32Ty();
+  if(is_type()) basety = read_type_spec(), qual = type_qual;
   else error("error(%d): expected type specify", token.get().line);
   if(basety == nullptr) return basety;
   llvm::Type *type = read_declarator(name, basety);
-  if(type->isArrayTy()) type = type->getArrayElementType()->getPointerTo();
+  if(type->isArrayTy()) type = pointer_to(type->getArrayElementType());
   return type;
 }
 
@@ -168,8 +230,9 @@ std::vector<argument_t *> Parser::read_declarator_param() {
 
   for(;;) {
     std::string name;
-    llvm::Type *type = read_func_param(name);
-    args.push_back(new argument_t(type, name));
+    int qual = 0;
+    llvm::Type *type = read_func_param(name, qual);
+    args.push_back(new argument_t(type, name, qual));
     if(token.skip(")")) return args;
     token.expect_skip(",");
   }
@@ -177,11 +240,14 @@ std::vector<argument_t *> Parser::read_declarator_param() {
 }
 
 AST *Parser::make_function() {
-  int stg;
+  int stg = STG_NONE;
+  func_attr = 0;
   llvm::Type *ret_type = read_type_spec(stg);
+  int ret_qual = type_qual;
   std::string name;// = token.next().val;
   std::vector<argument_t *> args;
   auto fty = static_cast<llvm::FunctionType *>(read_declarator(name, ret_type, args));
+  read_attribute();
   std::vector<std::string> args_name = [&]() {
     std::vector<std::string> a;
     for(auto arg : args) {
@@ -189,33 +255,66 @@ AST *Parser::make_function() {
     }
     return a;
   }();
+  std::vector<int> args_qual;
+  for(auto arg : args) if(arg->type) args_qual.push_back(arg->qual);
   cur_func = name;
   AST_vec body;
   token.expect_skip("{");
+  nest++;
   while(!token.skip("}")) {
+    size_t pos = token.pos;
     auto st = statement();
     if(st) body.push_back(st);
     while(token.skip(";"));
+    no_progress(pos);
   }
-  return new FunctionDefAST(name, fty, args_name, body, stg);
+  nest--;
+  auto func = new FunctionDefAST(name, fty, args_name, body, stg, func_attr);
+  func->ret_qual = ret_qual;
+  func->args_qual = args_qual;
+  return func;
 }
 
 AST *Parser::make_function_proto() {
-  int stg;
+  int stg = STG_NONE;
+  func_attr = 0;
   llvm::Type *ret_type = read_type_spec(stg);
+  int ret_qual = type_qual;
   std::string name;
-  llvm::FunctionType *fty = static_cast<llvm::FunctionType *>(read_declarator(name, ret_type));
-  return new FunctionProtoAST(name, fty, stg);
+  std::vector<argument_t *> args;
+  llvm::FunctionType *fty = static_cast<llvm::FunctionType *>(read_declarator(name, ret_type, args));
+  read_attribute();
+  auto proto = new FunctionProtoAST(name, fty, stg, func_attr);
+  proto->ret_qual = ret_qual;
+  for(auto arg : args) if(arg->type) proto->args_qual.push_back(arg->qual);
+  return proto;
+}
+
+// the lexer only passes __attribute__((const)) and __attribute__((pure)) through
+void Parser::read_attribute() {
+  while(token.skip("__attribute__")) {
+    token.expect_skip("(");
+    token.expect_skip("(");
+    std::string attr = token.next().val;
+         if(attr == "const") func_attr |= FUNC_ATTR_CONST;
+    else if(attr == "pure")  func_attr |= FUNC_ATTR_PURE;
+    token.expect_skip(")");
+    token.expect_skip(")");
+  }
 }
 
 AST *Parser::make_block() { 
   AST_vec body;
   if(token.skip("{")) {
+    nest++;
     while(!token.skip("}")) {
+      size_t pos = token.pos;
       auto st = statement();
       while(token.skip(";"));
       if(st) body.push_back(st);
+      no_progress(pos);
     }
+    nest--;
     return new BlockAST(body);
   }
   return nullptr;
@@ -272,22 +371,28 @@ AST *Parser::make_return() {
 llvm::Type *Parser::make_struct_declaration() {
   std::string name;
 
-  if(token.get().type == TOK_TYPE_IDENT) 
-    name = token.next().val;
+  if(token.get().type == TOK_TYPE_IDENT) {
+    token_t t = token.next();
+    name = t.val;
+    if(token.is("{")) declared(t); // not where it's only used
+  }
 
-  if(name.empty()) [](std::string &str) { // if name is empty, generate random name
-    int len = 8; while(len--)
-      str += (rand() % 26) + 65;
-  }(name);
+  if(name.empty()) name = "anon." + std::to_string(anon_count++); // the same in every run
 
   llvm::StructType *new_struct = nullptr;
-  auto t_strct = this->struct_list.get("struct." + name);
-  if(!t_strct) { // if not declared
-    // create empty struct
-    new_struct = llvm::StructType::create(context, "struct." + name);
-    this->struct_list.add("struct." + name, std::vector<std::string>(), new_struct);
+  struct_t *t_strct;
+  {
+    // codegen copies struct_list under the lock as well
+    types_guard guard;
+    type_decls++;
     t_strct = this->struct_list.get("struct." + name);
-  } else new_struct = t_strct->llvm_struct;
+    if(!t_strct) { // if not declared
+      // create empty struct
+      new_struct = llvm::StructType::create(unit->context, "struct." + name);
+      this->struct_list.add("struct." + name, std::vector<std::string>(), new_struct);
+      t_strct = this->struct_list.get("struct." + name);
+    } else new_struct = t_strct->llvm_struct;
+  }
   // this if block should be function. not beautiful
   if(token.is("{")) {
     BlockAST *decls = (BlockAST *)statement();
@@ -300,6 +405,8 @@ llvm::Type *Parser::make_struct_declaration() {
           members_name.push_back(v->name);
       } else error("error: struct fields must be varaible declaration");
     }
+    types_guard guard;
+    type_decls++; // completed
     t_strct = this->struct_list.get("struct." + name);
     t_strct->members_name = members_name;
 
@@ -312,6 +419,7 @@ llvm::Type *Parser::make_struct_declaration() {
     }
     if(new_struct->isOpaque())
       new_struct->setBody(field, false);
+    t_strct->index_members();
   } 
   return new_struct;
 }
@@ -319,22 +427,27 @@ llvm::Type *Parser::make_struct_declaration() {
 llvm::Type *Parser::make_union_declaration() {
   std::string name;
 
-  if(token.get().type == TOK_TYPE_IDENT) 
-    name = token.next().val;
+  if(token.get().type == TOK_TYPE_IDENT) {
+    token_t t = token.next();
+    name = t.val;
+    if(token.is("{")) declared(t); // not where it's only used
+  }
 
-  if(name.empty()) [](std::string &str) { // if name is empty, generate random name
-    int len = 8; while(len--)
-      str += (rand() % 26) + 65;
-  }(name);
+  if(name.empty()) name = "anon." + std::to_string(anon_count++); // the same in every run
 
   llvm::StructType *new_union = nullptr;
-  auto t_strct = this->union_list.get("union." + name);
-  if(!t_strct) { // if not declared
-    // create empty union
-    new_union = llvm::StructType::create(context, "union." + name);
-    this->union_list.add("union." + name, std::vector<union_elem_t>(), new_union);
+  union_t *t_strct;
+  {
+    types_guard guard;
+    type_decls++;
     t_strct = this->union_list.get("union." + name);
-  } else new_union = t_strct->llvm_union;
+    if(!t_strct) { // if not declared
+      // create empty union
+      new_union = llvm::StructType::create(unit->context, "union." + name);
+      this->union_list.add("union." + name, std::vector<union_elem_t>(), new_union);
+      t_strct = this->union_list.get("union." + name);
+    } else new_union = t_strct->llvm_union;
+  }
   // this if block should be function. not beautiful
   if(token.is("{")) {
     BlockAST *decls = (BlockAST *)statement();
@@ -345,8 +458,11 @@ llvm::Type *Parser::make_union_declaration() {
       for(auto v : decl->decls)
         members.push_back(union_elem_t(v->name, v->type));
     }
+    types_guard guard;
+    type_decls++; // completed
     t_strct = this->union_list.get("union." + name);
     t_strct->members = members;
+    t_strct->index_members();
 
     Type_vec field;
     llvm::Type *last = nullptr;
@@ -354,7 +470,7 @@ llvm::Type *Parser::make_union_declaration() {
       VarDeclarationAST *decl = (VarDeclarationAST *)a;
       for(auto v : decl->decls)
         if(last == nullptr) last = v->type;
-        else if(data_layout->getTypeAllocSize(last) < data_layout->getTypeAllocSize(v->type))
+        else if(unit->data_layout->getTypeAllocSize(last) < unit->data_layout->getTypeAllocSize(v->type))
           last = v->type;
     }
     field.push_back(last);
@@ -366,15 +482,20 @@ llvm::Type *Parser::make_union_declaration() {
 
 llvm::Type *Parser::make_enum_declaration() {
   std::string name;
-  if(token.get().type == TOK_TYPE_IDENT) 
-    name = token.next().val;
+  if(token.get().type == TOK_TYPE_IDENT) {
+    token_t t = token.next();
+    name = t.val;
+    if(token.is("{")) declared(t); // not where it's only used
+  }
   if(token.skip("{")) {
     std::vector<std::string> consts;
     int enum_n = 0;
     while(!token.skip("}")) {
       if(token.get().type != TOK_TYPE_IDENT) 
         error("error(%d): enum field must contain only identifiers", token.get().line);
-      consts.push_back(token.next().val);
+      token_t t = token.next();
+      consts.push_back(t.val);
+      declared(t);
       if(token.skip("=")) {
         auto n = new NumberAST(eval_constexpr(expr_entry()));
         enum_list[ consts.back() ] = n;
@@ -386,14 +507,16 @@ llvm::Type *Parser::make_enum_declaration() {
       token.expect_skip(",");
     }
   }
-  return builder.getInt32Ty();
+  return unit->builder.getInt32Ty();
 }
 
 void Parser::read_typedef() {
   llvm::Type *basety = read_type_spec();
+  int qual = type_qual;
   std::string name; auto from = read_declarator(name, basety); 
   if(name.empty()) error("error(%d): expected identifier", token.get().line);
   typedef_map[name] = from;
+  typedef_qual[name] = qual;
   return;
 }
 
@@ -414,11 +537,13 @@ bool Parser::is_function_proto() {
     if(token.skip(";")) break;
     if(is_type()) { token.skip(); continue; }
     if(token.skip("(")) { skip_brackets(); continue; }
+    if(token.skip("__attribute__")) { token.skip("("); skip_brackets(); continue; }
     if(token.get().type != TOK_TYPE_IDENT) {
       token.skip(); continue; }
     token.skip(); // func name
     if(!token.skip("(")) break;//;continue;
     skip_brackets();
+    while(token.skip("__attribute__")) { token.skip("("); skip_brackets(); }
     f = token.skip(";");
     break;
   }
@@ -442,11 +567,13 @@ bool Parser::is_function_def() {
     if(token.skip(";")) break;
     if(is_type()) { token.skip(); continue; }
     if(token.skip("(")) { skip_brackets(); continue; }
+    if(token.skip("__attribute__")) { token.skip("("); skip_brackets(); continue; }
     if(token.get().type != TOK_TYPE_IDENT) {
       token.skip(); continue; }
     token.skip(); // func name
     if(!token.skip("(")) break;//;continue;
     skip_brackets();
+    while(token.skip("__attribute__")) { token.skip("("); skip_brackets(); }
     f = token.skip("{");
     break;
   }
@@ -459,7 +586,9 @@ bool Parser::is_type() {
   if(
       cur == "static"   ||
       cur == "const"    ||
+      cur == "volatile" ||
       cur == "register" ||
+      cur == "inline"   ||
       cur == "extern"   ||
       cur == "void"     ||
       cur == "unsigned" ||
@@ -490,20 +619,31 @@ llvm::Type *Parser::read_type_spec(int &stg) {
   enum { tsigned, tunsigned } sign = tsigned;
   enum { tnon, tvoid, tchar, tint, tdouble } type = tnon;
   enum { tshort, tdefault, tlong, tllong } size = tdefault;
+  // struct bodies read declarations too, so type_qual is only set on the way out
+  int qual = 0;
 
   for(;;) {
     if(type == tnon && typedef_map.count(token.get().val)) {
-      std::string t = token.next().val; return typedef_map[t];
+      std::string t = token.next().val;
+      type_qual = qual | typedef_qual[t];
+      return typedef_map[t];
     }
          if(token.skip("extern")) stg = STG_EXTERN;
     else if(token.skip("static")) stg = STG_STATIC;
-    else if(token.skip("const")) ;//stg = STG_EXTERN;
+    else if(token.skip("const"))    qual |= QUAL_CONST;
+    else if(token.skip("volatile")) qual |= QUAL_VOLATILE;
     else if(token.skip("register")) ;// stg = STG_STATIC;
+    else if(token.skip("inline"))   ; // static inline is static, see Codegen::function_of
+    else if(token.is("__attribute__")) read_attribute();
 
     // TODO: wanna use skip(), not is().
     else if(token.is("struct") ||
-            token.is("union"))    return read_struct_union_type();
-    else if(token.skip("enum"))   return read_enum_type();
+            token.is("union"))    {
+      llvm::Type *t = read_struct_union_type();
+      type_qual = qual;
+      return t;
+    }
+    else if(token.skip("enum"))   { type_qual = qual; return read_enum_type(); }
 
     else if(token.skip("..."))    return nullptr;
 
@@ -522,18 +662,20 @@ llvm::Type *Parser::read_type_spec(int &stg) {
     } else break;
   }
 
+  // INQCC: char is signed
+  type_qual = sign == tunsigned && type != tdouble ? qual | QUAL_UNSIGNED : qual;
   switch(type) {
-    case tvoid:   return builder.getVoidTy();
-    case tchar:   return builder.getInt8Ty();
-    case tdouble: return builder.getDoubleTy();
+    case tvoid:   return unit->builder.getVoidTy();
+    case tchar:   return unit->builder.getInt8Ty();
+    case tdouble: return unit->builder.getDoubleTy();
     default: break;
   }
 
   switch(size) {
-    case tshort: return builder.getInt16Ty();
-    case tlong:  return builder.getInt32Ty();
-    case tllong: return builder.getInt64Ty();
-    default:     return builder.getInt32Ty();
+    case tshort: return unit->builder.getInt16Ty();
+    case tlong:  return unit->builder.getInt32Ty();
+    case tllong: return unit->builder.getInt64Ty();
+    default:     return unit->builder.getInt32Ty();
   }
 
   return nullptr;
@@ -552,7 +694,7 @@ llvm::Type *Parser::read_enum_type() {
     return make_enum_declaration();
   if(token.get().type == TOK_TYPE_IDENT)
     token.skip();
-  return builder.getInt32Ty(); // INQCC: enum is integer
+  return unit->builder.getInt32Ty(); // INQCC: enum is integer
 }
 
 int eval_constexpr(AST *expr) {
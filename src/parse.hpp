@@ -14,8 +14,27 @@ enum StorageType {
 class Parser {
   private:
     Token token;
+    int anon_count = 0; // names untagged structs and unions
+    size_t decl_begin = 0; // of the declaration next() reads
+    void no_progress(size_t pos); // error() unless the tokens moved on from pos
   public:
     AST_vec run(Token, bool isexpr = false);
+    // one top-level declaration at a time instead: start(), then next()
+    // until it's false. the declaration is null for what has no AST (typedef...)
+    void start(Token);
+    bool next(AST *&);
+    unsigned type_decls = 0; // struct and union declarations read so far
+    // qcc --lsp: after next() threw, skips the rest of that declaration so
+    // that the ones after it can still be read
+    void recover();
+    std::vector<token_t> last_declaration(); // the tokens next() read last
+
+    // qcc --lsp: where names are declared, when set. global is false for
+    // parameters, locals and members
+    struct site_t { std::string name; int line; bool global; };
+    std::vector<site_t> *sites = nullptr;
+    int nest = 0; // blocks and parameter lists being read
+    void declared(const token_t &);
 
     AST_vec eval();
     AST *statement_top();
@@ -23,11 +42,14 @@ class Parser {
 
     std::string cur_func;
     std::map<std::string, llvm::Type *> typedef_map;
+    std::map<std::string, int> typedef_qual;
     bool is_function_def();
     bool is_function_proto();
     bool is_type();
     AST *make_function();
     AST *make_function_proto();
+    int func_attr = 0;
+    void read_attribute();
     AST *make_var_declaration();
     AST *read_declaration();
     llvm::Type *read_declarator(std::string &, llvm::Type *);
@@ -35,7 +57,7 @@ class Parser {
     llvm::Type *read_declarator_func(llvm::Type *, std::vector<argument_t *> &);
     llvm::Type *read_declarator_tail(llvm::Type *, std::vector<argument_t *> &);
     llvm::Type *read_declarator_array(llvm::Type *);
-    llvm::Type *read_func_param(std::string &);
+    llvm::Type *read_func_param(std::string &, int &);
     std::vector<argument_t *> read_declarator_param();
     // Type_vec read_field();
     StructList struct_list;
@@ -53,6 +75,7 @@ class Parser {
     AST *make_for();
     AST *make_return();
 
+    int type_qual = 0; // TypeQual of the last type read by read_type_spec
     llvm::Type *read_type_spec();
     llvm::Type *read_type_spec(int &);
     llvm::Type *read_struct_union_type();
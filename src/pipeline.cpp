@@ -0,0 +1,109 @@
+#include "qcc.hpp"
+#include "queue.hpp"
+
+// -pipeline: -stream with each stage on a thread of its own. the lexer hands
+// the parser its tokens a chunk at a time, the parser hands this thread each
+// top-level declaration once it's parsed, and this thread folds, checks and
+// generates it as -stream does. the queues are bounded, so a stage that's
+// ahead waits for the next one instead of filling memory.
+// the parser and codegen share the unit's llvm context, which isn't
+// thread-safe: the parser locks unit->types_lock where it makes types, and
+// codegen for Sema and then each statement of a function, letting the
+// parser in between (see generate_decl and types_guard).
+// an error on any thread cancels the queues, and is reported from here once
+// the threads are done.
+
+thread_local int types_guard::depth = 0;
+thread_local double types_guard::wait_ms = 0;
+
+namespace {
+  typedef std::vector<token_t> chunk_t;
+  // thrown on a stage that was stopped by an error on another
+  struct cancelled_t {};
+
+  double ms_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+  }
+}
+
+void QCC::run_pipeline(const std::string &source) {
+  auto begin = std::chrono::steady_clock::now();
+  read_prelude();
+  SPSCQueue<chunk_t> tokens(16);
+  SPSCQueue<AST *> decls(64);
+  std::mutex failure_lock;
+  std::exception_ptr failure; // the first error. the others come from it
+  auto fail = [&]() {
+    {
+      std::lock_guard<std::mutex> guard(failure_lock);
+      if(!failure) failure = std::current_exception();
+    }
+    tokens.cancel();
+    decls.cancel();
+  };
+  unit_t *u = unit;
+  double lex_ms = 0, parse_ms = 0, gen_ms = 0;
+  double parse_locked_ms = 0, gen_locked_ms = 0; // blocked on unit->types_lock
+
+  std::thread lexer([&]() {
+      unit = u;
+      auto start = std::chrono::steady_clock::now();
+      try {
+        LEX.on_chunk = [&](chunk_t &chunk) {
+          if(!tokens.push(std::move(chunk))) throw cancelled_t();
+        };
+        // the rest, up to the end
+        if(!tokens.push(LEX.run(source).token)) throw cancelled_t();
+        tokens.close();
+      } catch(cancelled_t &) {
+      } catch(...) { fail(); }
+      lex_ms = ms_since(start);
+  });
+  std::thread parser([&]() {
+      unit = u;
+      auto start = std::chrono::steady_clock::now();
+      try {
+        Token tok;
+        tok.more = [&](chunk_t &to) {
+          chunk_t chunk;
+          if(!tokens.pop(chunk)) {
+            if(tokens.cancelled()) throw cancelled_t();
+            return false;
+          }
+          to.insert(to.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+          return true;
+        };
+        PARSE.start(std::move(tok));
+        for(AST *st; PARSE.next(st); )
+          if(st && !decls.push(st)) throw cancelled_t();
+        decls.close();
+      } catch(cancelled_t &) {
+      } catch(...) { fail(); }
+      parse_ms = ms_since(start);
+      parse_locked_ms = types_guard::wait_ms;
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  double locked_before = types_guard::wait_ms;
+  try {
+    CODEGEN.begin();
+    for(AST *st; decls.pop(st); ) generate_decl(st);
+  } catch(...) { fail(); }
+  gen_ms = ms_since(start);
+  gen_locked_ms = types_guard::wait_ms - locked_before;
+  lexer.join();
+  parser.join();
+  LEX.on_chunk = nullptr;
+  if(failure) std::rethrow_exception(failure);
+  if(!run_jit && !quiet) puts("parser process exited successfully");
+
+  if(time_report) {
+    double total = ms_since(begin);
+    // what a stage didn't spend waiting on its queues or on the other's
+    // types, of the whole time
+    auto busy = [&](double ms, double waited) { return (int)(100 * std::max(ms - waited, 0.0) / total); };
+    llvm::errs() << "pipeline: " << total << " ms, lex " << busy(lex_ms, tokens.push_wait_ms)
+                 << "% busy, parse " << busy(parse_ms, tokens.pop_wait_ms + decls.push_wait_ms + parse_locked_ms)
+                 << "% busy, codegen " << busy(gen_ms, decls.pop_wait_ms + gen_locked_ms) << "% busy\n";
+  }
+}
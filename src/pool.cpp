@@ -0,0 +1,46 @@
+#include "pool.hpp"
+
+Pool::Pool(unsigned threads) {
+  for(unsigned i = 0; i < std::max(1u, threads); i++)
+    queues.emplace_back(new queue_t);
+}
+
+void Pool::add(std::function<void(unsigned)> task) {
+  queues[next++ % queues.size()]->tasks.push_back(std::move(task));
+}
+
+bool Pool::pop(unsigned self, std::function<void(unsigned)> &task) {
+  queue_t &q = *queues[self];
+  std::lock_guard<std::mutex> guard(q.lock);
+  if(q.tasks.empty()) return false;
+  task = std::move(q.tasks.front());
+  q.tasks.pop_front();
+  return true;
+}
+
+bool Pool::steal(unsigned self, std::function<void(unsigned)> &task) {
+  for(size_t i = 1; i < queues.size(); i++) {
+    queue_t &q = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if(q.tasks.empty()) continue;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+  return false;
+}
+
+// nothing is added while the pool runs, so once every deque is empty
+// there's nothing left to wait for
+void Pool::work(unsigned self) {
+  std::function<void(unsigned)> task;
+  while(pop(self, task) || steal(self, task)) task(self);
+}
+
+void Pool::run() {
+  if(queues.size() == 1) return work(0);
+  std::vector<std::thread> threads;
+  for(unsigned i = 0; i < queues.size(); i++)
+    threads.emplace_back(&Pool::work, this, i);
+  for(auto &t : threads) t.join();
+}
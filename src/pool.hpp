@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.hpp"
+
+// a fixed number of threads, each with its own deque of tasks. a thread takes
+// tasks from the front of its own deque, and once that's empty steals from
+// the back of the others', so one big task doesn't leave the rest idle.
+// tasks get the index of the thread running them, 0 to threads - 1.
+class Pool {
+  private:
+    struct queue_t {
+      std::mutex lock;
+      std::deque<std::function<void(unsigned)>> tasks;
+    };
+    std::vector<std::unique_ptr<queue_t>> queues;
+    size_t next = 0;
+
+    bool pop(unsigned, std::function<void(unsigned)> &);
+    bool steal(unsigned, std::function<void(unsigned)> &);
+    void work(unsigned);
+  public:
+    Pool(unsigned threads);
+    // handed out round-robin, in the order added
+    void add(std::function<void(unsigned)>);
+    // runs every task added so far and returns when all are done.
+    // with one thread, on the calling thread
+    void run();
+};
@@ -1,13 +1,325 @@
 #include "qcc.hpp"
+#include "pool.hpp"
 
 int QCC::run(std::string source) {
-  mod = new llvm::Module("QCC", context);
-  data_layout = new llvm::DataLayout(mod);
+  auto begin = std::chrono::steady_clock::now();
+  unit->mod = new llvm::Module("QCC", unit->context);
+  // sizes and offsets are those of the host from the start
+  if(interp) { // a target machine takes longer to make than most programs take to run there
+    unit->mod->setTargetTriple(llvm::sys::getProcessTriple());
+    unit->mod->setDataLayout(host_data_layout);
+  } else {
+    unit->target_machine = create_target_machine(opt_level);
+    unit->mod->setTargetTriple(unit->target_machine->getTargetTriple().str());
+    unit->mod->setDataLayout(unit->target_machine->createDataLayout());
+  }
+  unit->data_layout = new llvm::DataLayout(unit->mod);
+
+  if(run_jit || interp || !link) return generate(source, out_file_name, begin);
+  char obj[] = "/tmp/qcc-XXXXXX.o";
+  int fd = mkstemps(obj, 2);
+  if(fd < 0) error("error: can't create a temporary file");
+  close(fd);
+  try {
+    generate(source, obj, begin);
+  } catch(compile_error &) {
+    unlink(obj);
+    throw;
+  }
+  bool linked = run_linker({obj}, out_file_name);
+  unlink(obj);
+  if(!linked) error("error: linking '%s' failed", out_file_name.c_str());
+  return 0;
+}
+
+// source to out (or run under -run), from the cache when it can be
+int QCC::generate(const std::string &source, const std::string &out, std::chrono::steady_clock::time_point begin) {
+  AST_vec ast;
+  std::unique_ptr<OutputCache> cache;
+  std::string key;
+  bool streaming = false, piped = false;
+  // a .qast file written by -emit-ast goes straight to codegen
+  if(source.size() > 5 && source.compare(source.size() - 5, 5, ".qast") == 0) {
+    ASTReader reader;
+    if(!reader.run(source, ast, PARSE.struct_list, PARSE.union_list))
+      error("error: can't load '%s' (missing, broken or from another version of qcc)", source.c_str());
+  } else if(pipeline && !interp && !compile_cache && !emit_ast && !(incremental && !run_jit)) {
+    // lexed on the way, but the cache's key and -emit-ast need every token
+    // or the whole AST first
+    piped = true;
+  } else {
+    lex(source);
+    // -emit-ir prints what the cache doesn't keep. shards of an -exe are
+    // named after its temporary object, which is never the same twice
+    if(compile_cache && !run_jit && !interp && !emit_ast && !emit_llvm_ir && !(link && jobs > 1)) {
+      cache.reset(new OutputCache(DiskObjectCache::default_dir() + "/out", cache_size_limit()));
+      key = cache_key(out);
+      bool hit = cache->fetch(key, out);
+      if(time_report) llvm::errs() << "cache: " << (hit ? "hit" : "miss") << " (" << key << ")\n";
+      if(hit) return 0;
+    }
+    // -emit-ast and -incremental need the whole AST at once
+    streaming = stream && !interp && !emit_ast && !(incremental && !run_jit);
+    if(!streaming) ast = parse();
+    if(emit_ast) {
+      ASTWriter writer;
+      if(!writer.run(out, ast, PARSE.struct_list, PARSE.union_list))
+        error("error: can't write '%s'", out.c_str());
+      return 0;
+    }
+  }
+  if(interp) return run_interp(ast, begin);
+  CODEGEN.opt_level  = opt_level;
+  CODEGEN.size_level = size_level;
+  CODEGEN.time_report = time_report;
+  CODEGEN.jobs = jobs;
+  CODEGEN.output = run_jit ? OUTPUT_NONE : output;
+  // next to what's written, an executable too
+  if(incremental && !run_jit) CODEGEN.incremental_db = out_file_name + ".qdb";
+  if(piped) {
+    run_pipeline(source);
+    CODEGEN.finish(run_jit ? "" : out, emit_llvm_ir);
+  } else if(streaming) {
+    run_stream();
+    CODEGEN.finish(run_jit ? "" : out, emit_llvm_ir);
+  } else {
+    ast = FOLD.run(ast);
+    SEMA.struct_list = PARSE.struct_list;
+    SEMA. union_list = PARSE. union_list;
+    SEMA.run(ast);
+    CODEGEN.struct_list = PARSE.struct_list;
+    CODEGEN. union_list = PARSE. union_list;
+    CODEGEN.run(ast, run_jit ? "" : out, emit_llvm_ir);
+  }
+  if(run_jit) {
+    JIT jit;
+    jit.opt_level = opt_level;
+    jit.lazy = lazy_jit;
+    if(jit_cache) {
+      jit.cache_dir = DiskObjectCache::default_dir();
+      jit.cache_size = cache_size_limit();
+    }
+    jit.time_report = time_report;
+    jit.frontend_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    llvm::Module *m = unit->mod;
+    unit->mod = nullptr; // the JIT owns it now
+    return jit.run(m, run_args);
+  }
+  if(bitcode) {
+    llvm::raw_svector_ostream os(*bitcode);
+    llvm::WriteBitcodeToFile(unit->mod, os);
+  }
+  if(cache) cache->store(key, out);
+  return 0;
+}
+
+// -interp: no llvm past the types. the VM compiles what it runs itself
+int QCC::run_interp(AST_vec &ast, std::chrono::steady_clock::time_point begin) {
+  // the bridge into C is written for its calling convention
+  if(llvm::Triple(unit->mod->getTargetTriple()).getArch() != llvm::Triple::x86_64)
+    error("error: -interp is only supported on x86-64");
+  ast = FOLD.run(ast);
+  SEMA.struct_list = PARSE.struct_list;
+  SEMA. union_list = PARSE. union_list;
+  SEMA.run(ast);
+  VM vm;
+  vm.struct_list = PARSE.struct_list;
+  vm. union_list = PARSE. union_list;
+  vm.time_report = time_report;
+  vm.frontend_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  // returning from main() is calling exit(), as in C. it's called here, with
+  // the VM and the unit its functions come from still alive, so that
+  // functions the program gave atexit() can still be run on the VM
+  exit(vm.run(ast, run_args));
+}
+
+// -stream: each top-level declaration is folded, checked and generated as
+// soon as it's parsed, then freed. what stays is the module, the pure
+// functions ConstEval may still run, and the tokens not parsed yet
+void QCC::run_stream() {
+  CODEGEN.begin();
+  PARSE.start(std::move(token));
+  for(AST *st; PARSE.next(st); )
+    if(st) generate_decl(st);
+  if(!run_jit && !quiet) puts("parser process exited successfully");
+}
+
+// one declaration of -stream or -pipeline, freed after
+void QCC::generate_decl(AST *st) {
+  int kind = st->get_type();
+  AST_vec decl = FOLD.run(AST_vec{ st });
+  {
+    // under -pipeline, the parser goes on meanwhile: its structs and types
+    // are read under the lock, and codegen takes it a statement at a time
+    types_guard guard;
+    // structs declared or completed since, for what may use them
+    if(PARSE.type_decls != synced_type_decls && (kind == AST_FUNCTION_DEF || kind == AST_VAR_DECLARATION)) {
+      SEMA.struct_list = CODEGEN.struct_list = PARSE.struct_list;
+      SEMA. union_list = CODEGEN. union_list = PARSE. union_list;
+      synced_type_decls = PARSE.type_decls;
+    }
+    SEMA.run(decl);
+  }
+  for(auto d : decl) CODEGEN.generate(d);
+  if(kind == AST_FUNCTION_DEF) {
+    const std::string &name = ((FunctionDefAST *)st)->name;
+    // a static function nothing calls yet is generated once something does
+    if(FOLD.eval.is_pure(name) || CODEGEN.is_pending(name)) return;
+    FOLD.eval.forget(name);
+  }
+  decl.push_back(st);
+  delete_ast(decl);
+}
 
-  // token = LEX.run(source);
+// what decides the output besides the source: the qcc binary, the options
+// and the target. then the preprocessed tokens, so that comments, the layout
+// of the file and which headers it came from don't matter, but what they
+// expand to does. line numbers are left out, since they only show up in errors
+std::string QCC::cache_key(const std::string &out) {
+  llvm::MD5 md5;
+  auto add = [&](const std::string &s) { md5.update(s); md5.update(llvm::StringRef("", 1)); };
+  add(qcc_binary_id());
+  add("O" + std::to_string(opt_level) + "s" + std::to_string(size_level));
+  add(std::to_string(link ? OUTPUT_OBJ : output));
+  // shards name their locals after the output, see shard.cpp
+  add(jobs > 1 ? "j " + out : "");
+  add(unit->target_machine->getTargetTriple().str());
+  add(unit->target_machine->getTargetCPU().str());
+  add(unit->target_machine->getTargetFeatureString().str());
+  for(auto &t : token.token) {
+    add(std::to_string(t.type) + (t.space ? " " : ""));
+    add(t.val);
+  }
+  llvm::MD5::MD5Result result;
+  md5.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return hex.str().str();
+}
+
+// cc knows where the C runtime and libc are
+bool QCC::run_linker(const std::vector<std::string> &objs, const std::string &exe) {
+  std::vector<std::string> cc{"cc"};
+  cc.insert(cc.end(), objs.begin(), objs.end());
+  cc.insert(cc.end(), {"-o", exe, "-lm"});
+  return run_program(cc);
+}
+
+// one file in a unit of its own. an error ends this file only
+int QCC::compile(const std::string &source) {
+  static std::mutex output_lock;
+  UNIT.reset(new unit_t);
+  unit = UNIT.get();
+  int status;
+  try {
+    status = run(source);
+  } catch(compile_error &e) {
+    std::lock_guard<std::mutex> guard(output_lock);
+    if(batch) printf("%s: ", source.c_str());
+    puts(e.what());
+    status = 1;
+  }
+  unit = nullptr;
+  return status;
+}
+
+// what 'cc -c' calls it: the file's name, without directories, and ext
+static std::string output_name(const std::string &file, const char *ext) {
+  std::string name = file.substr(file.find_last_of('/') + 1);
+  return name.substr(0, name.find_last_of('.')) + ext;
+}
+
+static off_t file_size(const std::string &file) {
+  struct stat st;
+  return stat(file.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// several files at once, each on its own QCC and unit, spread over -j<n>
+// threads. a file with errors is reported and the others go on
+int QCC::run_batch(const std::vector<std::string> &files) {
+  std::vector<std::string> outs;
+  for(auto &file : files) {
+    if(link) {
+      char obj[] = "/tmp/qcc-XXXXXX.o";
+      int fd = mkstemps(obj, 2);
+      if(fd < 0) error("error: can't create a temporary file");
+      close(fd);
+      outs.push_back(obj);
+    } else {
+      outs.push_back(output_name(file, emit_ast ? ".qast" : output == OUTPUT_ASM ? ".s" : 
+                                       output == OUTPUT_OBJ ? ".o" : ".bc"));
+    }
+  }
+
+  // biggest first, so that no big file starts last
+  std::vector<size_t> order(files.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return file_size(files[a]) > file_size(files[b]);
+  });
+  std::vector<int> status(files.size(), 1);
+  Pool pool(std::min<size_t>(jobs, files.size()));
+  for(size_t i : order) {
+    pool.add([&, i](unsigned) {
+        auto begin = std::chrono::steady_clock::now();
+        QCC job(argc, argv);
+        job.copy_options(*this);
+        job.batch = true;
+        job.jobs = 1;              // the threads have files to do already
+        job.time_report = false;   // pass timers are shared by the whole process
+        job.set_out_file_name(outs[i]);
+        if(link) job.set_output(OUTPUT_OBJ, false);
+        status[i] = job.compile(files[i]);
+        if(time_report)
+          llvm::errs() << files[i] << ": "
+                       << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count()
+                       << " ms\n";
+    });
+  }
+  pool.run();
+
+  bool failed = std::any_of(status.begin(), status.end(), [](int s) { return s != 0; });
+  if(link) {
+    if(!failed && !run_linker(outs, out_file_name)) {
+      printf("error: linking '%s' failed\n", out_file_name.c_str());
+      failed = true;
+    }
+    for(auto &obj : outs) unlink(obj.c_str());
+  }
+  return failed ? 1 : 0;
+}
+
+void QCC::copy_options(const QCC &q) {
+  out_file_name = q.out_file_name;
+  emit_llvm_ir = q.emit_llvm_ir;
+  emit_ast = q.emit_ast;
+  opt_level = q.opt_level, size_level = q.size_level;
+  time_report = q.time_report;
+  jobs = q.jobs;
+  output = q.output, link = q.link;
+  run_jit = q.run_jit, lazy_jit = q.lazy_jit, jit_cache = q.jit_cache;
+  run_args = q.run_args;
+  interp = q.interp;
+  compile_cache = q.compile_cache;
+  incremental = q.incremental;
+  stream = q.stream;
+  pipeline = q.pipeline;
+  whole_program = q.whole_program, exports = q.exports;
+  prelude = q.prelude;
+  quiet = q.quiet;
+}
 
-  Lexer lex; Token include_tok = lex.run("./include/qcc.h");
+void QCC::lex(const std::string &source) {
+  read_prelude();
   token = LEX.run(source);
+}
+
+void QCC::read_prelude() {
+  if(prelude) unit->macro_map = *prelude; // the server lexed it once
+  else { Lexer lex; Token include_tok = lex.run("./include/qcc.h"); }
+}
+
+AST_vec QCC::parse() {
   // clock_t b = clock();
   // include_tok = pp.run(include_tok);
   // token = PP.run(token);
@@ -16,28 +328,96 @@ int QCC::run(std::string source) {
   // token.add_end_tok();
   // puts("after preprocess:");
   // token.show(); getchar();
-  auto ast = PARSE.run(token); puts("parser process exited successfully");
-  CODEGEN.struct_list = PARSE.struct_list;
-  CODEGEN. union_list = PARSE. union_list;
-  CODEGEN.run(ast, out_file_name, emit_llvm_ir);
-  return 0;
+  auto ast = PARSE.run(token); 
+  if(!run_jit && !interp && !quiet) puts("parser process exited successfully"); // the program owns stdout under -run
+  return ast;
 }
 
 int QCC::run() {
   // TODO: FIXME: Here is a simple option parser.
-  std::string ofile, infile; 
-  bool emit_llvm_ir = false;
+  std::string ofile;
+  std::vector<std::string> infiles;
+  bool emit_llvm_ir = false, emit_ast = false, time_report = false, link = false, run_jit = false, interp = false, lazy_jit = false, jit_cache = true, compile_cache = false, incremental = false, whole_program = false, stream = false, pipeline = false;
+  std::vector<std::string> exports;
+  std::vector<std::string> run_args;
+  OutputKind output = OUTPUT_BITCODE;
+  int opt_level = 0, size_level = 0;
+  unsigned jobs = 1;
   if(argc < 2) show_usage();
-  for(int i = 0; i < argc; i++) {
+  if(!strcmp(argv[1], "--server") || !strcmp(argv[1], "-server")) {
+    Server server;
+    return server.run();
+  }
+  if(!strcmp(argv[1], "--lsp") || !strcmp(argv[1], "-lsp")) {
+    LanguageServer lsp;
+    return lsp.run();
+  }
+  if(!strcmp(argv[1], "--client") || !strcmp(argv[1], "-client")) {
+    argv[1] = argv[0], argc--, argv++;
+    int status = run_client(Server::default_socket(), argc, argv);
+    if(status >= 0) return status;
+    // no server, compile here
+  }
+  for(int i = 1; i < argc; i++) {
     if(!strcmp(argv[i], "-o")) {
       ofile = argv[++i]; 
     } else if(!strcmp(argv[i], "-emit-ir")) {
       emit_llvm_ir = true;
+    } else if(!strcmp(argv[i], "-emit-ast")) {
+      emit_ast = true;
+    } else if(!strcmp(argv[i], "-S")) {
+      output = OUTPUT_ASM, link = false;
+    } else if(!strcmp(argv[i], "-c")) {
+      output = OUTPUT_OBJ, link = false;
+    } else if(!strcmp(argv[i], "-exe")) {
+      output = OUTPUT_OBJ, link = true;
+    } else if(!strcmp(argv[i], "-Os")) {
+      opt_level = 2, size_level = 1;
+    } else if(argv[i][0] == '-' && argv[i][1] == 'O') {
+      if(argv[i][2] < '0' || argv[i][2] > '3' || argv[i][3]) 
+        error("error: unknown optimization level '%s'", argv[i]);
+      opt_level = argv[i][2] - '0', size_level = 0;
+    } else if(argv[i][0] == '-' && argv[i][1] == 'j') {
+      char *end;
+      long n = strtol(argv[i] + 2, &end, 10);
+      if(argv[i][2] == 0) n = std::max(1u, std::thread::hardware_concurrency()), end = argv[i] + 2;
+      if(*end || n < 1) error("error: bad number of jobs '%s'", argv[i]);
+      jobs = n;
+    } else if(!strcmp(argv[i], "-run")) {
+      run_jit = true;
+    } else if(!strcmp(argv[i], "-interp")) {
+      interp = true;
+    } else if(!strcmp(argv[i], "-lazy")) {
+      lazy_jit = true;
+    } else if(!strcmp(argv[i], "-no-jit-cache")) {
+      jit_cache = false;
+    } else if(!strcmp(argv[i], "-cache")) {
+      compile_cache = true;
+    } else if(!strcmp(argv[i], "-incremental")) {
+      incremental = true;
+    } else if(!strcmp(argv[i], "-whole-program") || !strcmp(argv[i], "--whole-program")) {
+      whole_program = true;
+    } else if(!strncmp(argv[i], "-export=", 8)) {
+      std::istringstream names(argv[i] + 8);
+      for(std::string name; std::getline(names, name, ','); )
+        if(!name.empty()) exports.push_back(name);
+    } else if(!strcmp(argv[i], "-stream")) {
+      stream = true;
+    } else if(!strcmp(argv[i], "-pipeline")) {
+      pipeline = true;
+    } else if(!strcmp(argv[i], "-ftime-report")) {
+      time_report = true;
     } else if(!strcmp(argv[i], "-h")) {
       show_usage();
     } else if(!strcmp(argv[i], "-v")) {
       show_version(); exit(0);
-    } else infile = argv[i];
+    } else {
+      infiles.push_back(argv[i]);
+      if(run_jit || interp) { // the rest is the program's argv
+        run_args.assign(argv + i, argv + argc);
+        break;
+      }
+    }
   }
 
   // std::string source = [&]() -> std::string {
@@ -49,15 +429,114 @@ int QCC::run() {
   // }();
 
   if(!ofile.empty()) set_out_file_name(ofile);
+  else if(emit_ast) set_out_file_name("a.qast");
+  else if(link) set_out_file_name("a.out");
+  else if(output == OUTPUT_ASM) set_out_file_name("a.s");
+  else if(output == OUTPUT_OBJ) set_out_file_name("a.o");
   set_emit_llvm_ir(emit_llvm_ir);
-  run(infile);
-  return 0;
+  set_emit_ast(emit_ast);
+  set_opt_level(opt_level, size_level);
+  set_time_report(time_report);
+  set_jobs(jobs);
+  set_output(output, link);
+  set_run(run_jit, run_args, lazy_jit, jit_cache);
+  set_interp(interp);
+  set_compile_cache(compile_cache);
+  set_incremental(incremental);
+  set_stream(stream);
+  set_pipeline(pipeline);
+  set_whole_program(whole_program, exports);
+  if(infiles.empty()) error("error: no input files");
+  if(whole_program) {
+    if(interp) error("error: -whole-program can't be used with -interp");
+    return run_whole_program(infiles);
+  }
+  if(infiles.size() > 1) {
+    if(!ofile.empty() && !link) error("error: -o can't name the outputs of several files");
+    return run_batch(infiles);
+  }
+  return compile(infiles[0]);
 }
 
 void QCC::set_out_file_name(std::string name) { out_file_name = name; }
 
 void QCC::set_emit_llvm_ir(bool e) { emit_llvm_ir = e; }
 
+void QCC::set_emit_ast(bool e) { emit_ast = e; }
+
+void QCC::set_opt_level(int o, int s) { opt_level = o; size_level = s; }
+
+void QCC::set_time_report(bool t) { time_report = t; }
+
+void QCC::set_jobs(unsigned j) { jobs = j; }
+
+void QCC::set_output(OutputKind o, bool l) { output = o; link = l; }
+
+void QCC::set_run(bool r, std::vector<std::string> args, bool l, bool c) { 
+  run_jit = r; run_args = args; lazy_jit = l; jit_cache = c; 
+}
+
+void QCC::set_interp(bool i) { interp = i; }
+
+void QCC::set_compile_cache(bool c) { compile_cache = c; }
+
+void QCC::set_incremental(bool i) { incremental = i; }
+
+void QCC::set_whole_program(bool w, std::vector<std::string> e) { whole_program = w; exports = e; }
+
+void QCC::set_stream(bool s) { stream = s; }
+
+void QCC::set_pipeline(bool p) { pipeline = p; }
+
+void QCC::set_prelude(const std::map<std::string, macro_t> *p) { prelude = p; }
+
+void QCC::set_quiet(bool q) { quiet = q; }
+
+void QCC::set_bitcode(llvm::SmallVectorImpl<char> *b) { bitcode = b; }
+
+std::string qcc_build() { return QCC_VERSION " " __DATE__ " " __TIME__; }
+
+// the build id the linker put in the program, or else the MD5 of the whole
+// binary, which takes longer
+static std::string binary_id() {
+  std::string id;
+  dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) {
+    // the first object is the program itself
+    for(int i = 0; i < info->dlpi_phnum; i++) {
+      const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+      if(ph.p_type != PT_NOTE) continue;
+      const char *p = (const char *)(info->dlpi_addr + ph.p_vaddr), *end = p + ph.p_memsz;
+      while(p + sizeof(ElfW(Nhdr)) <= end) {
+        auto note = (const ElfW(Nhdr) *)p;
+        const char *name = p + sizeof(*note), *desc = name + ((note->n_namesz + 3) & ~3);
+        if(note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && !memcmp(name, "GNU", 4)) {
+          auto hex = (std::string *)data;
+          for(unsigned j = 0; j < note->n_descsz; j++)
+            *hex += "0123456789abcdef"[(unsigned char)desc[j] >> 4], *hex += "0123456789abcdef"[desc[j] & 15];
+          return 1;
+        }
+        p = desc + ((note->n_descsz + 3) & ~3);
+      }
+    }
+    return 1;
+  }, &id);
+  if(!id.empty()) return "build-id " + id;
+  auto exe = llvm::MemoryBuffer::getFile("/proc/self/exe");
+  if(!exe) return qcc_build();
+  llvm::MD5 md5;
+  md5.update((*exe)->getBuffer());
+  llvm::MD5::MD5Result result;
+  md5.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return "md5 " + hex.str().str();
+}
+
+std::string qcc_binary_id() {
+  static const std::string id = binary_id(); // once per process
+  return id;
+}
+
 void QCC::show_version() {
   puts("qcc - a small toy compiler for C langauge (v" QCC_VERSION ", BUILD " __DATE__ " " __TIME__ ")");
 }
@@ -65,18 +544,83 @@ void QCC::show_version() {
 void QCC::show_usage() {
   show_version();
   puts("./qcc [options] file...");
+  puts("  several files are compiled side by side on -j<n> threads, each to its own");
+  puts("  output ('a.c' to 'a.bc', 'a.o' with -c, ...), or linked together with -exe");
   puts("options:");
   puts("  -o <name>  : place the output into <name> (default is 'a.bc')");
   puts("  -emit-ir   : output LLVM-IR to stdout");
+  puts("  -emit-ast  : write the parsed AST to the output file (default is 'a.qast')");
+  puts("               and stop. a .qast input file skips lexing and parsing");
+  puts("  -S         : write assembly for the host (default is 'a.s')");
+  puts("  -c         : write an object file for the host (default is 'a.o')");
+  puts("  -exe       : link an executable with the system's cc (default is 'a.out')");
+  puts("  -run file [args...] : compile file in memory and run its main() with args");
+  puts("  -interp file [args...] : run main() on qcc's own bytecode interpreter instead of");
+  puts("               llvm's JIT. starts at once, for programs that run briefly. x86-64 only");
+  puts("  -lazy      : with -run, compile each function on its first call");
+  puts("  -no-jit-cache : with -run, don't reuse or keep compiled objects. they are kept");
+  puts("                  in $QCC_CACHE_DIR (default ~/.cache/qcc), up to $QCC_CACHE_SIZE MiB (default 64)");
+  puts("  -cache     : reuse the output of an earlier compilation of the same preprocessed");
+  puts("               source with the same options, from $QCC_CACHE_DIR/out. warnings of");
+  puts("               the earlier compilation aren't shown again");
+  puts("  -incremental : generate only the functions that changed since the last compilation");
+  puts("                 to the same output. the others are kept in <output>.qdb");
+  puts("  -whole-program : link the files into one program before optimizing (at least -O2),");
+  puts("                  so that calls from one file into another can be inlined. one output");
+  puts("  -export=<name>[,<name>...] : with -whole-program, keep these visible outside, like main");
+  puts("  -stream    : generate each declaration as soon as it's parsed and free its AST,");
+  puts("               so that memory doesn't grow with the AST of the whole file");
+  puts("  -pipeline  : like -stream, with the lexer and the parser each on a thread of");
+  puts("               their own, ahead of codegen. -ftime-report shows how busy each was");
+  puts("  -O<n>      : optimize, n is 0 (default) to 3");
+  puts("  -Os        : optimize for size");
+  puts("  -j<n>      : compile files, or shards of one big file, on n threads (-j: one per core).");
+  puts("               one big file's output is the same for any n above 1, but -j1,");
+  puts("               the default, compiles it whole and may optimize it differently");
+  puts("  -ftime-report : print the time each optimization pass took,");
+  puts("                  and how long -run (or -interp) spent compiling and running");
+  puts("                  (with -lazy, also how many functions it compiled)");
+  puts("  -server, --server : compile for -client, on the socket $QCC_SERVER (default");
+  puts("               qcc.sock in $XDG_RUNTIME_DIR, or in /tmp/qcc-<uid>), for the same user only");
+  puts("  -client ..., --client ... : have the server compile, as the options after it");
+  puts("               say. without a server, compiles here. must come first, like -server");
+  puts("  --lsp      : be a language server for editors on stdin and stdout: errors as");
+  puts("               you type, and go to definition. must come first, like -server");
   puts("  -h         : show this help");
   puts("  -v         : show version info");
   exit(0);
 }
 
+void warning(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if(unit && unit->warnings) unit->warnings->push_back(buf);
+  else puts(buf);
+}
+
 void error(const char *errs, ...) {
   va_list args;
   va_start(args, errs);
-    vprintf(errs, args); puts("");
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), errs, args);
   va_end(args);
-  exit(0);
+  throw compile_error(buf);
+}
+
+bool run_program(const std::vector<std::string> &argv) {
+  std::vector<char *> args;
+  for(auto &a : argv) args.push_back((char *)a.c_str());
+  args.push_back(nullptr);
+  pid_t pid = fork();
+  if(pid < 0) return false;
+  if(pid == 0) {
+    execvp(args[0], args.data());
+    _exit(127);
+  }
+  int status;
+  if(waitpid(pid, &status, 0) < 0) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
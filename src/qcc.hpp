@@ -3,19 +3,62 @@
 #include "common.hpp"
 #include "lexer.hpp"
 #include "parse.hpp"
+#include "constfold.hpp"
+#include "sema.hpp"
+#include "serialize.hpp"
 #include "codegen.hpp"
+#include "jit.hpp"
+#include "server.hpp"
+#include "lsp.hpp"
+#include "vm.hpp"
 
 #define QCC_VERSION "0.3"
 
 class QCC {
   private:
+    // first, so it's destroyed after the stages holding its types and values
+    std::unique_ptr<unit_t> UNIT;
     Token token;
     Lexer LEX;
     Parser PARSE;
+    ConstFold FOLD;
+    Sema SEMA;
     Codegen CODEGEN;
 
     std::string out_file_name = "a.bc";
     bool emit_llvm_ir = false;
+    bool emit_ast = false;
+    int opt_level = 0, size_level = 0;
+    bool time_report = false;
+    unsigned jobs = 1;
+    OutputKind output = OUTPUT_BITCODE;
+    bool link = false; // an executable, from the object
+    bool run_jit = false, lazy_jit = false, jit_cache = true;
+    std::vector<std::string> run_args; // argv of the program under -run or -interp
+    bool interp = false; // main() on the bytecode VM instead, see vm.hpp
+    bool compile_cache = false; // outputs from and to an OutputCache
+    bool incremental = false; // functions from and to <output>.qdb
+    bool whole_program = false;
+    bool stream = false; // a declaration at a time, see run_stream()
+    bool pipeline = false; // -stream with lexer and parser threads, see pipeline.cpp
+    std::vector<std::string> exports; // not made internal by -whole-program, besides main
+
+    bool batch = false; // one of several files, errors name the file
+    const std::map<std::string, macro_t> *prelude = nullptr; // include/qcc.h, already lexed
+    bool quiet = false; // nothing on stdout, for libqcc
+    llvm::SmallVectorImpl<char> *bitcode = nullptr; // the module, written here too, for -whole-program
+
+    bool run_linker(const std::vector<std::string> &objs, const std::string &exe);
+    int run_batch(const std::vector<std::string> &);
+    int run_whole_program(const std::vector<std::string> &); // see wholeprog.cpp
+    int generate(const std::string &source, const std::string &out, std::chrono::steady_clock::time_point begin);
+    std::string cache_key(const std::string &out);
+    void run_stream();
+    void run_pipeline(const std::string &source);
+    int run_interp(AST_vec &, std::chrono::steady_clock::time_point begin);
+    unsigned synced_type_decls = ~0u; // PARSE.type_decls when its structs were last copied
+    void generate_decl(AST *);
+    void copy_options(const QCC &);
 
   public:
     int argc;
@@ -25,11 +68,30 @@ class QCC {
 
     void set_out_file_name(std::string);
     void set_emit_llvm_ir(bool);
+    void set_emit_ast(bool);
+    void set_opt_level(int, int = 0);
+    void set_time_report(bool);
+    void set_jobs(unsigned);
+    void set_output(OutputKind, bool link = false);
+    void set_run(bool, std::vector<std::string>, bool lazy = false, bool cache = true);
+    void set_interp(bool);
+    void set_compile_cache(bool);
+    void set_incremental(bool);
+    void set_whole_program(bool, std::vector<std::string> exports = {});
+    void set_stream(bool);
+    void set_pipeline(bool);
+    void set_prelude(const std::map<std::string, macro_t> *);
+    void set_quiet(bool);
+    void set_bitcode(llvm::SmallVectorImpl<char> *);
 
     void show_usage();
     void show_version();
 
     int run(); // run following argc and argv
-    int run(std::string);
+    int run(std::string); // needs a unit, see compile()
+    int compile(const std::string &);
+    void lex(const std::string &); // into token
+    void read_prelude(); // the predefined macros
+    AST_vec parse(); // token
 };
 
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.hpp"
+
+// a bounded queue from one thread to one other, see QCC::run_pipeline.
+// push and pop take no locks: the two sides share only the two indices, so
+// while it's full (or empty) a side spins on the other's index, yielding
+// the core. close() is the end for the consumer, once it has popped the
+// rest. cancel() stops both sides at once, for when a stage fails.
+// the time each side spent waiting is kept, to tell how busy it was.
+template<typename T>
+class SPSCQueue {
+  private:
+    std::vector<T> ring; // one slot is always free, so full and empty differ
+    std::atomic<size_t> head{0}, tail{0}; // next to pop, next to push
+    std::atomic<bool> closed{false}, cancelled_{false};
+
+    static double ms_since(std::chrono::steady_clock::time_point t) {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    }
+  public:
+    double push_wait_ms = 0, pop_wait_ms = 0; // each written by its side only
+
+    explicit SPSCQueue(size_t capacity): ring(capacity + 1) {}
+
+    // false when the queue was cancelled, and v wasn't pushed
+    bool push(T v) {
+      size_t t = tail.load(std::memory_order_relaxed), next = (t + 1) % ring.size();
+      if(next == head.load(std::memory_order_acquire)) {
+        auto start = std::chrono::steady_clock::now();
+        while(next == head.load(std::memory_order_acquire)) {
+          if(cancelled()) return false;
+          std::this_thread::yield();
+        }
+        push_wait_ms += ms_since(start);
+      }
+      ring[t] = std::move(v);
+      tail.store(next, std::memory_order_release);
+      return true;
+    }
+    // false once it's closed and empty, or cancelled
+    bool pop(T &v) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if(h == tail.load(std::memory_order_acquire)) {
+        auto start = std::chrono::steady_clock::now();
+        while(h == tail.load(std::memory_order_acquire)) {
+          // closed after the last push, so nothing comes in between
+          if(cancelled() || (closed.load(std::memory_order_acquire) && h == tail.load(std::memory_order_acquire))) {
+            pop_wait_ms += ms_since(start);
+            return false;
+          }
+          std::this_thread::yield();
+        }
+        pop_wait_ms += ms_since(start);
+      }
+      v = std::move(ring[h]);
+      head.store((h + 1) % ring.size(), std::memory_order_release);
+      return true;
+    }
+    void close() { closed.store(true, std::memory_order_release); }
+    void cancel() { cancelled_.store(true, std::memory_order_release); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,332 @@
+#include "sema.hpp"
+#include "codegen.hpp"
+
+static const int QUAL_CV = QUAL_CONST | QUAL_VOLATILE;
+
+bool is_arith(ctype_t t) {
+  return t.type && (t.type->isIntegerTy() || t.type->isDoubleTy());
+}
+
+ctype_t promote(ctype_t t) {
+  if(t.type && t.type->isIntegerTy() && t.type->getIntegerBitWidth() < 32)
+    return ctype_t(unit->builder.getInt32Ty());
+  return ctype_t(t.type, t.qual & ~QUAL_CV);
+}
+
+ctype_t arith_conv(ctype_t a, ctype_t b) {
+  if(a.type->isDoubleTy() || b.type->isDoubleTy())
+    return ctype_t(unit->builder.getDoubleTy());
+  a = promote(a); b = promote(b);
+  unsigned abits = a.type->getIntegerBitWidth(), bbits = b.type->getIntegerBitWidth();
+  if(abits == bbits) return ctype_t(a.type, (a.qual | b.qual) & QUAL_UNSIGNED);
+  return abits > bbits ? a : b;
+}
+
+void Sema::run(AST_vec &ast) {
+  for(auto st : ast) check(st);
+}
+
+void Sema::declare(const std::string &name, ctype_t t, bool *escapes) {
+  // codegen keeps a volatile local in memory, as if its address was taken
+  if(escapes) *escapes = t.qual & QUAL_VOLATILE;
+  if(scopes.empty()) globals[name] = sym_t{t, nullptr};
+  else scopes.back()[name] = sym_t{t, escapes};
+}
+
+// a function keeps the id of its first declaration
+int Sema::declare_func(const std::string &name, llvm::FunctionType *fty, int ret_qual, const std::vector<int> &args_qual) {
+  auto f = funcs.find(name);
+  int id = f != funcs.end() ? f->second.id : (int)funcs.size();
+  funcs[name] = func_sig_t{fty, ret_qual, args_qual, id};
+  return id;
+}
+
+Sema::sym_t *Sema::lookup(const std::string &name) {
+  for(auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+    auto v = s->find(name);
+    if(v != s->end()) return &v->second;
+  }
+  auto g = globals.find(name);
+  return g != globals.end() ? &g->second : nullptr;
+}
+
+// like the expression's type, but an array variable doesn't decay
+ctype_t Sema::object_type(AST *st) {
+  if(st->get_type() == AST_VARIABLE) {
+    sym_t *v = lookup(static_cast<VariableAST *>(st)->name);
+    if(v) return v->type;
+  }
+  return st->ctype;
+}
+
+// struct members carry no qualifiers of their own
+ctype_t Sema::member_type(ctype_t parent, const std::string &name) {
+  llvm::Type *ty = parent.type->isPointerTy() ? parent.type->getPointerElementType() : parent.type;
+  if(!ty->isStructTy()) error("error: member reference base type is not a structure or union");
+  std::string sname = ty->getStructName().str();
+  int qual = parent.qual & QUAL_CV;
+  if(struct_t *s = struct_list.get(sname)) {
+    if(const member_t *m = s->member(name)) return ctype_t(m->type, qual);
+    error("error: not found element '%s' in struct '%s'", name.c_str(), sname.c_str());
+  }
+  if(union_t *u = union_list.get(sname)) {
+    if(const member_t *m = u->member(name)) return ctype_t(m->type, qual);
+    error("error: not found element '%s' in union '%s'", name.c_str(), sname.c_str());
+  }
+  error("error: not found union or struct '%s'", sname.c_str());
+  return ctype_t();
+}
+
+ctype_t Sema::check(AST *st) {
+  if(!st) return ctype_t();
+  ctype_t t;
+  switch(st->get_type()) {
+    case AST_FUNCTION_PROTO:
+      t = check((FunctionProtoAST *)st); break;
+    case AST_FUNCTION_DEF:
+      t = check((FunctionDefAST *)st); break;
+    case AST_BLOCK:
+      t = check((BlockAST *)st); break;
+    case AST_FUNCTION_CALL:
+      t = check((FunctionCallAST *)st); break;
+    case AST_VAR_DECLARATION:
+      t = check((VarDeclarationAST *)st); break;
+    case AST_VARIABLE:
+      t = check((VariableAST *)st); break;
+    case AST_INDEX:
+      t = check((IndexAST *)st); break;
+    case AST_IF:
+      t = check((IfAST *)st); break;
+    case AST_WHILE:
+      t = check((WhileAST *)st); break;
+    case AST_FOR:
+      t = check((ForAST *)st); break;
+    case AST_RETURN:
+      t = check((ReturnAST *)st); break;
+    case AST_ASGMT:
+      t = check((AsgmtAST *)st); break;
+    case AST_ARRAY:
+      t = check((ArrayAST *)st); break;
+    case AST_TYPECAST:
+      t = check((TypeCastAST *)st); break;
+    case AST_UNARY:
+      t = check((UnaryAST *)st); break;
+    case AST_BINARY:
+      t = check((BinaryAST *)st); break;
+    case AST_TERNARY:
+      t = check((TernaryAST *)st); break;
+    case AST_DOT:
+      t = check((DotOpAST *)st); break;
+    case AST_SIZEOF:
+      t = check((SizeofAST *)st); break;
+    case AST_STRING:
+      t = ctype_t(unit->builder.getInt8PtrTy()); break;
+    case AST_NUMBER:
+      t = ctype_t(static_cast<NumberAST *>(st)->is_float ?
+          unit->builder.getDoubleTy() : unit->builder.getInt32Ty());
+      break;
+  }
+  st->ctype = t;
+  return t;
+}
+
+ctype_t Sema::check(FunctionProtoAST *st) {
+  st->func_id = declare_func(st->name, st->func_type, st->ret_qual, st->args_qual);
+  return ctype_t();
+}
+
+ctype_t Sema::check(FunctionDefAST *st) {
+  st->func_id = declare_func(st->name, st->func_type, st->ret_qual, st->args_qual);
+  ret_type = ctype_t(st->func_type->getReturnType(), st->ret_qual);
+  scopes.push_back(scope_t());
+  st->args_escape.assign(st->args_name.size(), false);
+  for(size_t i = 0; i < st->args_name.size(); i++)
+    declare(st->args_name[i], ctype_t(st->func_type->getParamType(i),
+          i < st->args_qual.size() ? st->args_qual[i] : 0), &st->args_escape[i]);
+  for(auto a : st->body) check(a);
+  scopes.clear();
+  return ctype_t();
+}
+
+ctype_t Sema::check(BlockAST *st) {
+  scopes.push_back(scope_t());
+  for(auto a : st->body) check(a);
+  scopes.pop_back();
+  return ctype_t();
+}
+
+ctype_t Sema::check(FunctionCallAST *st) {
+  llvm::FunctionType *fty = nullptr;
+  int ret_qual = 0;
+  std::vector<int> args_qual;
+  auto f = st->callee->get_type() == AST_VARIABLE ?
+    funcs.find(static_cast<VariableAST *>(st->callee)->name) : funcs.end();
+  if(f != funcs.end()) {
+    fty = f->second.type;
+    ret_qual = f->second.ret_qual;
+    args_qual = f->second.args_qual;
+    st->func_id = f->second.id;
+    st->callee->ctype = ctype_t(fty->getPointerTo());
+  } else { // function pointer
+    ctype_t callee = check(st->callee);
+    llvm::Type *ty = callee.type->isPointerTy() ? callee.type->getPointerElementType() : callee.type;
+    if(!ty->isFunctionTy()) error("error: called object is not a function");
+    fty = llvm::cast<llvm::FunctionType>(ty);
+  }
+
+  st->args_type.clear();
+  for(size_t i = 0; i < st->args.size(); i++) {
+    ctype_t a = check(st->args[i]);
+    if(i < fty->getNumParams())
+      st->args_type.push_back(ctype_t(fty->getParamType(i), i < args_qual.size() ? args_qual[i] : 0));
+    else // default argument promotion
+      st->args_type.push_back(is_arith(a) ? promote(a) : a);
+  }
+  return ctype_t(fty->getReturnType(), ret_qual);
+}
+
+ctype_t Sema::check(VarDeclarationAST *st) {
+  for(auto d : st->decls) {
+    ctype_t init = check(d->init_expr);
+    // int a[] = {1, 2}; -->> int a[2] = {1, 2};
+    if(d->type->isPointerTy() && init.type && init.type->isArrayTy()) d->type = init.type;
+    declare(d->name, ctype_t(d->type, d->qual), &d->escapes);
+  }
+  return ctype_t();
+}
+
+ctype_t Sema::check(VariableAST *st) {
+  sym_t *v = lookup(st->name);
+  if(v) {
+    st->is_lvalue = true;
+    if(v->type.type->isArrayTy()) // decays
+      return ctype_t(v->type.type->getArrayElementType()->getPointerTo(), v->type.qual);
+    return v->type;
+  }
+  auto f = funcs.find(st->name);
+  if(f != funcs.end()) {
+    st->func_id = f->second.id;
+    return ctype_t(f->second.type->getPointerTo());
+  }
+  error("error: not found variable '%s'", st->name.c_str());
+  return ctype_t();
+}
+
+ctype_t Sema::check(IndexAST *st) {
+  ctype_t ary = check(st->ary);
+  check(st->idx);
+  st->is_lvalue = true;
+  if(ary.type->isPointerTy()) return ctype_t(ary.type->getPointerElementType(), ary.qual);
+  if(ary.type->isArrayTy())   return ctype_t(ary.type->getArrayElementType(), ary.qual);
+  error("error: subscripted value is not an array or pointer");
+  return ctype_t();
+}
+
+ctype_t Sema::check(IfAST *st) {
+  check(st->cond);
+  check(st->b_then);
+  check(st->b_else);
+  return ctype_t();
+}
+
+ctype_t Sema::check(WhileAST *st) {
+  check(st->cond);
+  check(st->body);
+  return ctype_t();
+}
+
+// codegen puts a declaration in 'for(...)' into the enclosing block
+ctype_t Sema::check(ForAST *st) {
+  check(st->init);
+  check(st->cond);
+  check(st->reinit);
+  check(st->body);
+  return ctype_t();
+}
+
+ctype_t Sema::check(ReturnAST *st) {
+  check(st->expr);
+  return ret_type;
+}
+
+ctype_t Sema::check(AsgmtAST *st) {
+  ctype_t dst = check(st->dst);
+  check(st->src);
+  return ctype_t(dst.type, dst.qual & ~QUAL_CV);
+}
+
+// codegen builds a constant array of the first element's type
+ctype_t Sema::check(ArrayAST *st) {
+  for(auto e : st->elems) check(e);
+  if(st->elems.empty()) return ctype_t(unit->builder.getInt32Ty());
+  ctype_t elem = st->elems[0]->ctype;
+  return ctype_t(llvm::ArrayType::get(elem.type, st->elems.size()), elem.qual);
+}
+
+ctype_t Sema::check(TypeCastAST *st) {
+  check(st->expr);
+  return ctype_t(st->cast_to, st->qual);
+}
+
+ctype_t Sema::check(UnaryAST *st) {
+  ctype_t t = check(st->expr);
+  if(st->op == "&") {
+    if(st->expr->get_type() == AST_VARIABLE) {
+      sym_t *v = lookup(static_cast<VariableAST *>(st->expr)->name);
+      if(v && v->escapes) *v->escapes = true;
+    }
+    ctype_t obj = object_type(st->expr);
+    return ctype_t(obj.type->getPointerTo(), obj.qual);
+  } else if(st->op == "*") {
+    if(!t.type->isPointerTy()) error("error: indirection requires pointer operand");
+    st->is_lvalue = true;
+    return ctype_t(t.type->getPointerElementType(), t.qual);
+  } else if(st->op == "-" || st->op == "~") {
+    return promote(t);
+  } else if(st->op == "!") {
+    return ctype_t(unit->builder.getInt32Ty());
+  }
+  // ++, --
+  return ctype_t(t.type, t.qual & ~QUAL_CV);
+}
+
+ctype_t Sema::check(BinaryAST *st) {
+  ctype_t lhs = check(st->lhs), rhs = check(st->rhs);
+  const std::string &op = st->op;
+  st->conv = ctype_t();
+  if(op == "&&" || op == "||")
+    return ctype_t(unit->builder.getInt1Ty());
+  if(op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=") {
+    if(is_arith(lhs) && is_arith(rhs)) st->conv = arith_conv(lhs, rhs);
+    else st->conv = ctype_t(lhs.type->isPointerTy() ? lhs.type : rhs.type);
+    return ctype_t(unit->builder.getInt1Ty());
+  }
+  if(!is_arith(lhs) || !is_arith(rhs)) // pointer arithmetic
+    return ctype_t(lhs.type, lhs.qual & ~QUAL_CV);
+  // the shift count doesn't take part in the conversion, but llvm wants both sides alike
+  st->conv = op == "<<" || op == ">>" ? promote(lhs) : arith_conv(lhs, rhs);
+  return st->conv;
+}
+
+ctype_t Sema::check(TernaryAST *st) {
+  check(st->cond);
+  ctype_t then_t = check(st->then_expr), else_t = check(st->else_expr);
+  if(!then_t.type || !else_t.type || then_t.type->isVoidTy() || else_t.type->isVoidTy())
+    return ctype_t(unit->builder.getVoidTy());
+  if(is_arith(then_t) && is_arith(else_t)) return arith_conv(then_t, else_t);
+  return ctype_t(then_t.type, then_t.qual & ~QUAL_CV);
+}
+
+ctype_t Sema::check(DotOpAST *st) {
+  ctype_t parent = check(st->lhs);
+  const std::string &name = static_cast<VariableAST *>(st->rhs)->name;
+  st->is_lvalue = true;
+  return st->rhs->ctype = member_type(parent, name);
+}
+
+ctype_t Sema::check(SizeofAST *st) {
+  // sizeof(EXPR), EXPR is not evaluated, only typed
+  check(st->expr);
+  st->operand_type = object_type(st->expr).type;
+  return ctype_t(unit->builder.getInt32Ty());
+}
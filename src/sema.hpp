@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.hpp"
+#include "ast.hpp"
+#include "struct.hpp"
+
+// gives every expression its C type and value category, and every binary
+// operator the type of the usual arithmetic conversions, so that codegen
+// converts each operand once instead of re-deriving types from llvm values.
+// runs between ConstFold::run and Codegen::run.
+//
+// types follow what codegen emits: truth values (comparisons, && and ||) stay
+// i1 until something converts them, and float is double.
+class Sema {
+  private:
+    struct func_sig_t {
+      llvm::FunctionType *type;
+      int ret_qual;
+      std::vector<int> args_qual;
+      int id; // dense, in order of first declaration
+    };
+    struct sym_t {
+      ctype_t type;
+      bool *escapes; // noted when its address is taken, null for globals
+    };
+    typedef std::map<std::string, sym_t> scope_t;
+    std::unordered_map<std::string, func_sig_t> funcs;
+    scope_t globals;
+    std::vector<scope_t> scopes; // innermost last, empty outside of functions
+    ctype_t ret_type;
+
+    void declare(const std::string &, ctype_t, bool *escapes = nullptr);
+    int declare_func(const std::string &, llvm::FunctionType *, int, const std::vector<int> &);
+    sym_t *lookup(const std::string &);
+    ctype_t object_type(AST *);
+    ctype_t member_type(ctype_t, const std::string &);
+
+    ctype_t check(AST *);
+    ctype_t check(FunctionProtoAST *);
+    ctype_t check(FunctionDefAST *);
+    ctype_t check(BlockAST *);
+    ctype_t check(FunctionCallAST *);
+    ctype_t check(VarDeclarationAST *);
+    ctype_t check(VariableAST *);
+    ctype_t check(IndexAST *);
+    ctype_t check(IfAST *);
+    ctype_t check(WhileAST *);
+    ctype_t check(ForAST *);
+    ctype_t check(ReturnAST *);
+    ctype_t check(AsgmtAST *);
+    ctype_t check(ArrayAST *);
+    ctype_t check(TypeCastAST *);
+    ctype_t check(UnaryAST *);
+    ctype_t check(BinaryAST *);
+    ctype_t check(TernaryAST *);
+    ctype_t check(DotOpAST *);
+    ctype_t check(SizeofAST *);
+  public:
+    StructList struct_list;
+    UnionList   union_list;
+    void run(AST_vec &);
+};
+
+// integer promotion: anything narrower than int becomes int
+ctype_t promote(ctype_t);
+// the common type of two arithmetic operands
+ctype_t arith_conv(ctype_t, ctype_t);
+bool is_arith(ctype_t);
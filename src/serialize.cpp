@@ -0,0 +1,604 @@
+#include "serialize.hpp"
+#include "codegen.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char qast_magic[4] = { 'Q', 'A', 'S', 'T' };
+
+// ---- writer ----
+
+bool ASTWriter::run(const std::string &file_name, AST_vec &ast, StructList &struct_list, UnionList &union_list) {
+  write(ast, struct_list, union_list);
+  FILE *fp = fopen(file_name.c_str(), "wb");
+  if(!fp) return false;
+  bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+  return fclose(fp) == 0 && ok;
+}
+
+const std::string &ASTWriter::write(AST_vec &ast, StructList &struct_list, UnionList &union_list) {
+  // the AST goes first so that every string and type it uses gets interned
+  out.clear();
+  put_uint(struct_list.list().size());
+  for(auto &s : struct_list.list()) {
+    put_str(s.name);
+    put_type(s.llvm_struct);
+    put_uint(s.members_name.size());
+    for(auto &m : s.members_name) put_str(m);
+  }
+  put_uint(union_list.list().size());
+  for(auto &u : union_list.list()) {
+    put_str(u.name);
+    put_type(u.llvm_union);
+    put_uint(u.members.size());
+    for(auto &m : u.members) {
+      put_str(m.name);
+      put_type(m.type);
+    }
+  }
+  write_nodes(ast);
+  std::string body; body.swap(out);
+
+  std::string type_table;
+  write_type_table(type_table);
+
+  out.append(qast_magic, sizeof(qast_magic));
+  put_uint(QAST_VERSION);
+  put_uint(strings.size());
+  for(auto &s : strings) {
+    put_uint(s.size());
+    out += s;
+  }
+  out += type_table;
+  out += body;
+  return out;
+}
+
+void ASTWriter::put_uint(uint64_t n) {
+  do {
+    uint8_t byte = n & 0x7f;
+    n >>= 7;
+    out += (char)(n ? byte | 0x80 : byte);
+  } while(n);
+}
+
+void ASTWriter::put_int(int64_t n) {
+  put_uint(((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+}
+
+void ASTWriter::put_double(double n) {
+  char bytes[sizeof(double)];
+  memcpy(bytes, &n, sizeof(double));
+  out.append(bytes, sizeof(double));
+}
+
+void ASTWriter::put_str(const std::string &s) { put_uint(intern(s)); }
+
+void ASTWriter::put_type(llvm::Type *ty) { put_uint(intern(ty)); }
+
+uint32_t ASTWriter::intern(const std::string &s) {
+  auto it = string_idx.find(s);
+  if(it != string_idx.end()) return it->second;
+  strings.push_back(s);
+  return string_idx[s] = strings.size() - 1;
+}
+
+uint32_t ASTWriter::intern(llvm::Type *ty) {
+  auto it = type_idx.find(ty);
+  if(it != type_idx.end()) return it->second;
+  // a named struct gets its index before its elements: it may point to itself
+  if(ty->isStructTy() && !llvm::cast<llvm::StructType>(ty)->isLiteral()) {
+    llvm::StructType *st = llvm::cast<llvm::StructType>(ty);
+    types.push_back(ty);
+    uint32_t idx = type_idx[ty] = types.size() - 1;
+    intern(st->getName().str());
+    named_structs.push_back(st);
+    if(!st->isOpaque())
+      for(unsigned i = 0; i < st->getNumElements(); i++) intern(st->getElementType(i));
+    return idx;
+  }
+  if(ty->isPointerTy()) intern(ty->getPointerElementType());
+  else if(ty->isArrayTy()) intern(ty->getArrayElementType());
+  else if(ty->isFunctionTy() || ty->isStructTy()) {
+    for(unsigned i = 0; i < ty->getNumContainedTypes(); i++) intern(ty->getContainedType(i));
+  } else if(!ty->isVoidTy() && !ty->isIntegerTy() && !ty->isFloatTy() && !ty->isDoubleTy())
+    error("error: can't serialize this type");
+  types.push_back(ty);
+  return type_idx[ty] = types.size() - 1;
+}
+
+void ASTWriter::write_type_table(std::string &table) {
+  out.clear();
+  put_uint(types.size());
+  for(auto ty : types) {
+    if(ty->isVoidTy()) {
+      put_uint(QAST_TYPE_VOID);
+    } else if(ty->isIntegerTy()) {
+      put_uint(QAST_TYPE_INT);
+      put_uint(ty->getIntegerBitWidth());
+    } else if(ty->isFloatTy()) {
+      put_uint(QAST_TYPE_FLOAT);
+    } else if(ty->isDoubleTy()) {
+      put_uint(QAST_TYPE_DOUBLE);
+    } else if(ty->isPointerTy()) {
+      put_uint(QAST_TYPE_POINTER);
+      put_uint(type_idx[ty->getPointerElementType()]);
+    } else if(ty->isArrayTy()) {
+      put_uint(QAST_TYPE_ARRAY);
+      put_uint(type_idx[ty->getArrayElementType()]);
+      put_uint(ty->getArrayNumElements());
+    } else if(ty->isFunctionTy()) {
+      llvm::FunctionType *fty = llvm::cast<llvm::FunctionType>(ty);
+      put_uint(QAST_TYPE_FUNCTION);
+      put_uint(type_idx[fty->getReturnType()]);
+      put_uint(fty->isVarArg());
+      put_uint(fty->getNumParams());
+      for(unsigned i = 0; i < fty->getNumParams(); i++) put_uint(type_idx[fty->getParamType(i)]);
+    } else {
+      llvm::StructType *st = llvm::cast<llvm::StructType>(ty);
+      if(st->isLiteral()) {
+        put_uint(QAST_TYPE_LITERAL_STRUCT);
+        put_uint(st->isPacked());
+        put_uint(st->getNumElements());
+        for(unsigned i = 0; i < st->getNumElements(); i++) put_uint(type_idx[st->getElementType(i)]);
+      } else {
+        put_uint(QAST_TYPE_STRUCT);
+        put_uint(string_idx[st->getName().str()]);
+      }
+    }
+  }
+  // bodies of named structs, now that every element has an index
+  std::vector<llvm::StructType *> bodies;
+  for(auto st : named_structs)
+    if(!st->isOpaque()) bodies.push_back(st);
+  put_uint(bodies.size());
+  for(auto st : bodies) {
+    put_uint(type_idx[st]);
+    put_uint(st->isPacked());
+    put_uint(st->getNumElements());
+    for(unsigned i = 0; i < st->getNumElements(); i++) put_uint(type_idx[st->getElementType(i)]);
+  }
+  table.swap(out);
+  out.clear();
+}
+
+void ASTWriter::write_nodes(AST_vec &nodes) {
+  put_uint(nodes.size());
+  for(auto st : nodes) write_node(st);
+}
+
+void ASTWriter::write_node(AST *st) {
+  if(!st) { put_uint(0); return; }
+  put_uint(st->get_type() + 1);
+  switch(st->get_type()) {
+    case AST_FUNCTION_PROTO: {
+      FunctionProtoAST *f = (FunctionProtoAST *)st;
+      put_uint(f->stg); put_uint(f->attr);
+      put_str(f->name);
+      put_type(f->func_type);
+      put_uint(f->ret_qual);
+      put_uint(f->args_qual.size());
+      for(auto q : f->args_qual) put_uint(q);
+      break;
+    }
+    case AST_FUNCTION_DEF: {
+      FunctionDefAST *f = (FunctionDefAST *)st;
+      put_uint(f->stg); put_uint(f->attr);
+      put_str(f->name);
+      put_type(f->func_type);
+      put_uint(f->ret_qual);
+      put_uint(f->args_qual.size());
+      for(auto q : f->args_qual) put_uint(q);
+      put_uint(f->args_name.size());
+      for(auto &a : f->args_name) put_str(a);
+      write_nodes(f->body);
+      break;
+    }
+    case AST_FUNCTION_CALL: {
+      FunctionCallAST *c = (FunctionCallAST *)st;
+      write_node(c->callee);
+      write_nodes(c->args);
+      break;
+    }
+    case AST_BLOCK:
+      write_nodes(((BlockAST *)st)->body);
+      break;
+    case AST_VAR_DECLARATION: {
+      VarDeclarationAST *v = (VarDeclarationAST *)st;
+      put_uint(v->stg);
+      put_uint(v->decls.size());
+      for(auto d : v->decls) {
+        put_type(d->type);
+        put_str(d->name);
+        put_uint(d->qual);
+        write_node(d->init_expr);
+      }
+      break;
+    }
+    case AST_TYPEDEF:
+      put_type(((TypedefAST *)st)->from);
+      put_str(((TypedefAST *)st)->to);
+      break;
+    case AST_ARRAY:
+      write_nodes(((ArrayAST *)st)->elems);
+      break;
+    case AST_TYPECAST:
+      write_node(((TypeCastAST *)st)->expr);
+      put_type(((TypeCastAST *)st)->cast_to);
+      put_uint(((TypeCastAST *)st)->qual);
+      break;
+    case AST_UNARY: {
+      UnaryAST *u = (UnaryAST *)st;
+      put_str(u->op); put_uint(u->postfix);
+      write_node(u->expr);
+      break;
+    }
+    case AST_BINARY: {
+      BinaryAST *b = (BinaryAST *)st;
+      put_str(b->op);
+      write_node(b->lhs); write_node(b->rhs);
+      break;
+    }
+    case AST_TERNARY: {
+      TernaryAST *t = (TernaryAST *)st;
+      write_node(t->cond); write_node(t->then_expr); write_node(t->else_expr);
+      break;
+    }
+    case AST_DOT: {
+      DotOpAST *d = (DotOpAST *)st;
+      put_uint(d->is_arrow);
+      write_node(d->lhs); write_node(d->rhs);
+      break;
+    }
+    case AST_INDEX:
+      write_node(((IndexAST *)st)->ary);
+      write_node(((IndexAST *)st)->idx);
+      break;
+    case AST_VARIABLE:
+      put_str(((VariableAST *)st)->name);
+      break;
+    case AST_BREAK:
+    case AST_CONTINUE:
+      break;
+    case AST_IF: {
+      IfAST *i = (IfAST *)st;
+      write_node(i->cond); write_node(i->b_then); write_node(i->b_else);
+      break;
+    }
+    case AST_WHILE:
+      write_node(((WhileAST *)st)->cond);
+      write_node(((WhileAST *)st)->body);
+      break;
+    case AST_FOR: {
+      ForAST *f = (ForAST *)st;
+      write_node(f->init); write_node(f->cond); write_node(f->reinit); write_node(f->body);
+      break;
+    }
+    case AST_ASGMT:
+      write_node(((AsgmtAST *)st)->dst);
+      write_node(((AsgmtAST *)st)->src);
+      break;
+    case AST_RETURN:
+      write_node(((ReturnAST *)st)->expr);
+      break;
+    case AST_SIZEOF:
+      write_node(((SizeofAST *)st)->expr);
+      break;
+    case AST_NUMBER: {
+      NumberAST *n = (NumberAST *)st;
+      put_uint(n->is_float);
+      if(n->is_float) put_double(n->f_number);
+      else put_int(n->i_number);
+      break;
+    }
+    case AST_STRING:
+      put_str(((StringAST *)st)->str);
+      break;
+  }
+}
+
+// ---- reader ----
+
+bool ASTReader::run(const std::string &file_name, AST_vec &ast, StructList &struct_list, UnionList &union_list) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+  struct stat sb;
+  if(fstat(fd, &sb) < 0 || sb.st_size == 0) { close(fd); return false; }
+  void *map = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) return false;
+  bool ok = read((const uint8_t *)map, sb.st_size, ast, struct_list, union_list);
+  munmap(map, sb.st_size);
+  return ok;
+}
+
+bool ASTReader::read(const uint8_t *buf, size_t size, AST_vec &ast, StructList &struct_list, UnionList &union_list) {
+  cur = buf; end = buf + size; bad = false;
+  strings.clear(); types.clear();
+  if(size < sizeof(qast_magic) || memcmp(buf, qast_magic, sizeof(qast_magic))) return false;
+  cur += sizeof(qast_magic);
+  if(get_uint() != QAST_VERSION) return false;
+
+  uint64_t n = get_uint();
+  while(n-- && !bad) {
+    uint64_t len = get_uint();
+    if(len > (uint64_t)(end - cur)) { bad = true; break; }
+    strings.push_back(std::string((const char *)cur, len));
+    cur += len;
+  }
+  if(bad || !read_type_table()) return false;
+
+  StructList structs;
+  n = get_uint();
+  while(n-- && !bad) {
+    struct_t s;
+    get_str(); // the name given by the parser, the type knows its own
+    llvm::Type *ty = get_type();
+    if(!ty->isStructTy()) { bad = true; break; }
+    s.llvm_struct = llvm::cast<llvm::StructType>(ty);
+    s.name = s.llvm_struct->getName().str();
+    uint64_t m = get_uint();
+    while(m-- && !bad) s.members_name.push_back(get_str());
+    if(s.members_name.size() > (s.llvm_struct->isOpaque() ? 0 : s.llvm_struct->getNumElements())) {
+      bad = true;
+      break;
+    }
+    s.index_members();
+    structs.add(s);
+  }
+  UnionList unions;
+  n = get_uint();
+  while(n-- && !bad) {
+    union_t u;
+    get_str();
+    llvm::Type *ty = get_type();
+    if(!ty->isStructTy()) { bad = true; break; }
+    u.llvm_union = llvm::cast<llvm::StructType>(ty);
+    u.name = u.llvm_union->getName().str();
+    uint64_t m = get_uint();
+    while(m-- && !bad) {
+      std::string name = get_str();
+      u.members.push_back(union_elem_t(name, get_type()));
+    }
+    u.index_members();
+    unions.add(u);
+  }
+
+  AST_vec nodes = read_nodes();
+  if(bad || cur != end) return false;
+  ast = nodes;
+  struct_list = structs;
+  union_list = unions;
+  return true;
+}
+
+bool ASTReader::read_type_table() {
+  uint64_t n = get_uint();
+  if(n > (uint64_t)(end - cur)) return false;
+  for(uint64_t i = 0; i < n && !bad; i++) {
+    llvm::Type *ty = nullptr;
+    switch(get_uint()) {
+      case QAST_TYPE_VOID:   ty = llvm::Type::getVoidTy(unit->context); break;
+      case QAST_TYPE_FLOAT:  ty = llvm::Type::getFloatTy(unit->context); break;
+      case QAST_TYPE_DOUBLE: ty = llvm::Type::getDoubleTy(unit->context); break;
+      case QAST_TYPE_INT: {
+        uint64_t bits = get_uint();
+        if(bits == 0 || bits > llvm::IntegerType::MAX_INT_BITS) bad = true;
+        else ty = llvm::IntegerType::get(unit->context, bits);
+        break;
+      }
+      case QAST_TYPE_POINTER: {
+        llvm::Type *elem = get_type();
+        if(elem->isVoidTy()) bad = true;
+        else ty = elem->getPointerTo();
+        break;
+      }
+      case QAST_TYPE_ARRAY: {
+        llvm::Type *elem = get_type();
+        ty = llvm::ArrayType::get(elem, get_uint());
+        break;
+      }
+      case QAST_TYPE_FUNCTION: {
+        llvm::Type *ret = get_type();
+        bool vararg = get_uint();
+        Type_vec params;
+        uint64_t m = get_uint();
+        while(m-- && !bad) params.push_back(get_type());
+        ty = llvm::FunctionType::get(ret, params, vararg);
+        break;
+      }
+      case QAST_TYPE_STRUCT:
+        ty = llvm::StructType::create(unit->context, get_str());
+        break;
+      case QAST_TYPE_LITERAL_STRUCT: {
+        bool packed = get_uint();
+        Type_vec elems;
+        uint64_t m = get_uint();
+        while(m-- && !bad) elems.push_back(get_type());
+        ty = llvm::StructType::get(unit->context, elems, packed);
+        break;
+      }
+      default: bad = true;
+    }
+    if(!bad) types.push_back(ty);
+  }
+
+  uint64_t bodies = get_uint();
+  while(bodies-- && !bad) {
+    llvm::Type *ty = get_type();
+    bool packed = get_uint();
+    Type_vec elems;
+    uint64_t m = get_uint();
+    while(m-- && !bad) elems.push_back(get_type());
+    if(!ty->isStructTy() || !llvm::cast<llvm::StructType>(ty)->isOpaque()) bad = true;
+    else llvm::cast<llvm::StructType>(ty)->setBody(elems, packed);
+  }
+  return !bad;
+}
+
+uint64_t ASTReader::get_uint() {
+  uint64_t n = 0;
+  for(int shift = 0; shift < 64; shift += 7) {
+    if(cur >= end) break;
+    uint8_t byte = *cur++;
+    n |= (uint64_t)(byte & 0x7f) << shift;
+    if(!(byte & 0x80)) return n;
+  }
+  bad = true;
+  return 0;
+}
+
+int64_t ASTReader::get_int() {
+  uint64_t n = get_uint();
+  return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+double ASTReader::get_double() {
+  double n = 0;
+  if(end - cur < (ptrdiff_t)sizeof(double)) { bad = true; return n; }
+  memcpy(&n, cur, sizeof(double));
+  cur += sizeof(double);
+  return n;
+}
+
+const std::string &ASTReader::get_str() {
+  static const std::string empty;
+  uint64_t idx = get_uint();
+  if(idx >= strings.size()) { bad = true; return empty; }
+  return strings[idx];
+}
+
+// never nullptr, so that a broken file can't crash the reader before 'bad' is checked
+llvm::Type *ASTReader::get_type() {
+  uint64_t idx = get_uint();
+  if(idx >= types.size()) { bad = true; return llvm::Type::getInt32Ty(unit->context); }
+  return types[idx];
+}
+
+AST_vec ASTReader::read_nodes() {
+  AST_vec nodes;
+  uint64_t n = get_uint();
+  while(n-- && !bad) nodes.push_back(read_node());
+  return nodes;
+}
+
+AST *ASTReader::read_node() {
+  uint64_t tag = get_uint();
+  if(tag == 0 || bad) return nullptr;
+  switch(tag - 1) {
+    case AST_FUNCTION_PROTO: {
+      int stg = get_uint(), attr = get_uint();
+      std::string name = get_str();
+      llvm::Type *ty = get_type();
+      if(!ty->isFunctionTy()) { bad = true; return nullptr; }
+      FunctionProtoAST *f = new FunctionProtoAST(name, llvm::cast<llvm::FunctionType>(ty), stg, attr);
+      f->ret_qual = get_uint();
+      uint64_t n = get_uint();
+      while(n-- && !bad) f->args_qual.push_back(get_uint());
+      return f;
+    }
+    case AST_FUNCTION_DEF: {
+      int stg = get_uint(), attr = get_uint();
+      std::string name = get_str();
+      llvm::Type *ty = get_type();
+      if(!ty->isFunctionTy()) { bad = true; return nullptr; }
+      int ret_qual = get_uint();
+      std::vector<int> args_qual;
+      uint64_t n = get_uint();
+      while(n-- && !bad) args_qual.push_back(get_uint());
+      std::vector<std::string> args_name;
+      n = get_uint();
+      while(n-- && !bad) args_name.push_back(get_str());
+      AST_vec body = read_nodes();
+      FunctionDefAST *f = new FunctionDefAST(name, llvm::cast<llvm::FunctionType>(ty), args_name, body, stg, attr);
+      f->ret_qual = ret_qual;
+      f->args_qual = args_qual;
+      return f;
+    }
+    case AST_FUNCTION_CALL: {
+      AST *callee = read_node();
+      return new FunctionCallAST(callee, read_nodes());
+    }
+    case AST_BLOCK:
+      return new BlockAST(read_nodes());
+    case AST_VAR_DECLARATION: {
+      int stg = get_uint();
+      std::vector<declarator_t *> decls;
+      uint64_t n = get_uint();
+      while(n-- && !bad) {
+        llvm::Type *ty = get_type();
+        std::string name = get_str();
+        int qual = get_uint();
+        decls.push_back(new declarator_t(ty, name, read_node(), qual));
+      }
+      return new VarDeclarationAST(decls, stg);
+    }
+    case AST_TYPEDEF: {
+      llvm::Type *from = get_type();
+      return new TypedefAST(from, get_str());
+    }
+    case AST_ARRAY:
+      return new ArrayAST(read_nodes());
+    case AST_TYPECAST: {
+      AST *expr = read_node();
+      llvm::Type *cast_to = get_type();
+      return new TypeCastAST(expr, cast_to, get_uint());
+    }
+    case AST_UNARY: {
+      std::string op = get_str();
+      bool postfix = get_uint();
+      return new UnaryAST(op, read_node(), postfix);
+    }
+    case AST_BINARY: {
+      std::string op = get_str();
+      AST *lhs = read_node();
+      return new BinaryAST(op, lhs, read_node());
+    }
+    case AST_TERNARY: {
+      AST *cond = read_node(), *then_expr = read_node();
+      return new TernaryAST(cond, then_expr, read_node());
+    }
+    case AST_DOT: {
+      bool is_arrow = get_uint();
+      AST *lhs = read_node();
+      return new DotOpAST(lhs, read_node(), is_arrow);
+    }
+    case AST_INDEX: {
+      AST *ary = read_node();
+      return new IndexAST(ary, read_node());
+    }
+    case AST_VARIABLE:
+      return new VariableAST(get_str());
+    case AST_BREAK:
+      return new BreakAST();
+    case AST_CONTINUE:
+      return new ContinueAST();
+    case AST_IF: {
+      AST *cond = read_node(), *b_then = read_node();
+      return new IfAST(cond, b_then, read_node());
+    }
+    case AST_WHILE: {
+      AST *cond = read_node();
+      return new WhileAST(cond, read_node());
+    }
+    case AST_FOR: {
+      AST *init = read_node(), *cond = read_node(), *reinit = read_node();
+      return new ForAST(init, cond, reinit, read_node());
+    }
+    case AST_ASGMT: {
+      AST *dst = read_node();
+      return new AsgmtAST(dst, read_node());
+    }
+    case AST_RETURN:
+      return new ReturnAST(read_node());
+    case AST_SIZEOF:
+      return new SizeofAST(read_node());
+    case AST_NUMBER:
+      if(get_uint()) return new NumberAST(get_double());
+      return new NumberAST((int)get_int());
+    case AST_STRING:
+      return new StringAST(get_str());
+  }
+  bad = true;
+  return nullptr;
+}
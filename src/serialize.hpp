@@ -0,0 +1,82 @@
+#pragma once
+
+#include "common.hpp"
+#include "ast.hpp"
+#include "struct.hpp"
+
+// binary AST file (.qast): the output of Parser::run, loadable straight into Codegen.
+//
+//   "QAST" version
+//   string table: count, (length, bytes)...
+//   type table:   count, (kind, operands)...  operands refer to earlier entries
+//   struct bodies for named struct types (may refer to any entry)
+//   struct_list, union_list
+//   AST: count, nodes in preorder, tag 0 is nullptr
+//
+// integers are LEB128 (signed ones zigzag-encoded), doubles their raw 8 bytes.
+// bump QAST_VERSION whenever this layout or the classes in ast.hpp change.
+#define QAST_VERSION 2
+
+enum {
+  QAST_TYPE_VOID,
+  QAST_TYPE_INT,
+  QAST_TYPE_FLOAT,
+  QAST_TYPE_DOUBLE,
+  QAST_TYPE_POINTER,
+  QAST_TYPE_ARRAY,
+  QAST_TYPE_FUNCTION,
+  QAST_TYPE_STRUCT,
+  QAST_TYPE_LITERAL_STRUCT,
+};
+
+class ASTWriter {
+  private:
+    std::string out;
+    std::vector<std::string> strings;
+    std::map<std::string, uint32_t> string_idx;
+    Type_vec types;
+    std::map<llvm::Type *, uint32_t> type_idx;
+    std::vector<llvm::StructType *> named_structs;
+
+    void put_uint(uint64_t);
+    void put_int(int64_t);
+    void put_double(double);
+    void put_str(const std::string &);
+    void put_type(llvm::Type *);
+    uint32_t intern(const std::string &);
+    uint32_t intern(llvm::Type *);
+
+    void write_node(AST *);
+    void write_nodes(AST_vec &);
+    void write_type_table(std::string &);
+  public:
+    // false if the file can't be written
+    bool run(const std::string &, AST_vec &, StructList &, UnionList &);
+    // the contents of the file, once per writer
+    const std::string &write(AST_vec &, StructList &, UnionList &);
+    // every string written: names, members, operators...
+    const std::vector<std::string> &interned() const { return strings; }
+};
+
+class ASTReader {
+  private:
+    const uint8_t *cur, *end;
+    bool bad; // truncated or malformed input
+    std::vector<std::string> strings;
+    Type_vec types;
+
+    uint64_t get_uint();
+    int64_t get_int();
+    double get_double();
+    const std::string &get_str();
+    llvm::Type *get_type();
+
+    bool read(const uint8_t *, size_t, AST_vec &, StructList &, UnionList &);
+    bool read_type_table();
+    AST *read_node();
+    AST_vec read_nodes();
+  public:
+    // false if the file is missing, from another QAST_VERSION or broken;
+    // the caller should parse the source again.
+    bool run(const std::string &, AST_vec &, StructList &, UnionList &);
+};
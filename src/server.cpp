@@ -0,0 +1,259 @@
+#include "server.hpp"
+#include "qcc.hpp"
+
+// a request is the length of the rest, sent along with the client's stdin,
+// stdout and stderr, then its cwd and argv as NUL-terminated strings.
+// the reply is the status of the compilation as an int
+
+static bool read_all(int fd, void *buf, size_t n) {
+  char *p = (char *)buf;
+  while(n > 0) {
+    ssize_t r = read(fd, p, n);
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return false;
+    p += r, n -= r;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t n) {
+  const char *p = (const char *)buf;
+  while(n > 0) {
+    ssize_t w = write(fd, p, n);
+    if(w < 0 && errno == EINTR) continue;
+    if(w <= 0) return false;
+    p += w, n -= w;
+  }
+  return true;
+}
+
+static bool make_addr(const std::string &path, sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path)) return false;
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+// whether the other end of a connection runs as this user: nobody else
+// gets our files, or has us compile and run theirs
+static bool same_user(int fd) {
+  ucred cred;
+  socklen_t len = sizeof(cred);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+// the directory of the default socket, made if it isn't there. it must be
+// ours and closed to everyone else, or another user could put a socket of
+// theirs in its place
+static bool private_dir(const std::string &dir) {
+  if(mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) return false;
+  struct stat st;
+  return lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == getuid() && !(st.st_mode & 077);
+}
+
+static int connect_to(const std::string &path) {
+  sockaddr_un addr;
+  if(!make_addr(path, addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) return -1;
+  if(connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+  return fd;
+}
+
+static bool send_request(int fd, const std::string &body) {
+  uint32_t len = body.size();
+  int fds[3] = { 0, 1, 2 };
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  iovec iov = { &len, sizeof(len) };
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov, msg.msg_iovlen = 1;
+  msg.msg_control = control, msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if(sendmsg(fd, &msg, 0) != sizeof(len)) return false;
+  return write_all(fd, body.data(), body.size());
+}
+
+// closes whatever fds msg brought, so that a request we turn down leaks none
+static void close_fds(msghdr &msg) {
+  for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+    size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for(size_t i = 0; i < n; i++) {
+      int f;
+      memcpy(&f, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(f));
+      close(f);
+    }
+  }
+}
+
+static bool recv_request(int fd, std::string &body, int fds[3]) {
+  uint32_t len;
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  iovec iov = { &len, sizeof(len) };
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov, msg.msg_iovlen = 1;
+  msg.msg_control = control, msg.msg_controllen = sizeof(control);
+  ssize_t n = recvmsg(fd, &msg, 0);
+  if(n < 0) return false;
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if(n != sizeof(len) || !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || 
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)) || CMSG_NXTHDR(&msg, cmsg)) {
+    close_fds(msg);
+    return false;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  // checked before the buffer is allocated, not after
+  if(len > (1 << 20)) { close_fds(msg); return false; }
+  body.resize(len);
+  if(!read_all(fd, &body[0], len)) { close_fds(msg); return false; }
+  return true;
+}
+
+std::string Server::default_socket() {
+  if(const char *path = getenv("QCC_SERVER")) return path;
+  return default_dir() + "/qcc.sock";
+}
+
+std::string Server::default_dir() {
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if(runtime && *runtime) return runtime;
+  return "/tmp/qcc-" + std::to_string(getuid());
+}
+
+int Server::run() {
+  sockaddr_un addr;
+  if(!make_addr(socket_path, addr)) error("error: socket path '%s' is too long", socket_path.c_str());
+  int other = connect_to(socket_path);
+  if(other >= 0) {
+    close(other);
+    error("error: a server is already listening on '%s'", socket_path.c_str());
+  }
+  if(!getenv("QCC_SERVER") && !private_dir(default_dir()))
+    error("error: '%s' must be a directory only its owner can use", default_dir().c_str());
+  unlink(socket_path.c_str()); // left behind by a server that was killed
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  mode_t mask = umask(077);
+  bool bound = listen_fd >= 0 && bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+  umask(mask);
+  if(!bound || chmod(socket_path.c_str(), 0600) < 0 || listen(listen_fd, 64) < 0)
+    error("error: can't listen on '%s': %s", socket_path.c_str(), strerror(errno));
+
+  delete create_target_machine(0); // registers the targets, once for all requests
+  signal(SIGCHLD, SIG_IGN); // the kernel reaps finished requests
+  signal(SIGPIPE, SIG_IGN); // a client that went away isn't the server's problem
+  printf("qcc: serving on '%s'\n", socket_path.c_str());
+  fflush(stdout);
+  for(;;) {
+    int conn = accept(listen_fd, nullptr, nullptr);
+    if(conn < 0) {
+      if(errno == EINTR || errno == ECONNABORTED) continue;
+      error("error: accept: %s", strerror(errno));
+    }
+    if(same_user(conn)) serve(conn);
+    close(conn);
+  }
+}
+
+// the macros of ./include/qcc.h, which QCC::parse would otherwise lex
+// before every file. reloaded when the file changes
+const std::map<std::string, macro_t> *Server::prelude() {
+  char real[PATH_MAX];
+  struct stat st;
+  if(!realpath("./include/qcc.h", real) || stat(real, &st) < 0) return nullptr;
+  auto it = preludes.find(real);
+  if(it != preludes.end() && it->second.mtime == st.st_mtime) return &it->second.macros;
+  unit_t u;
+  unit = &u;
+  try {
+    Lexer lex; lex.run("./include/qcc.h");
+  } catch(compile_error &) {
+    unit = nullptr;
+    return nullptr; // the request reports it
+  }
+  unit = nullptr;
+  prelude_t &p = preludes[real];
+  p.mtime = st.st_mtime;
+  p.macros = std::move(u.macro_map);
+  return &p.macros;
+}
+
+static void reply(int status, void *conn) {
+  fflush(stdout), fflush(stderr);
+  write_all((int)(intptr_t)conn, &status, sizeof(status));
+}
+
+void Server::serve(int conn) {
+  std::string body;
+  int fds[3];
+  if(!recv_request(conn, body, fds)) return;
+  if(body.empty() || body.back() != '\0') body.push_back('\0');
+  std::vector<std::string> strs;
+  for(size_t i = 0; i < body.size(); i = body.find('\0', i) + 1)
+    strs.push_back(body.c_str() + i);
+
+  int status = 1;
+  // the server moves to the client's directory too, so that the prelude
+  // is the one the request would have read
+  if(strs.size() < 2 || chdir(strs[0].c_str()) < 0) {
+    dprintf(fds[1], "error: can't serve the request\n");
+  } else {
+    auto macros = prelude();
+    pid_t pid = fork();
+    if(pid == 0) {
+      signal(SIGCHLD, SIG_DFL); // run_program waits for the linker
+      close(listen_fd);
+      for(int i = 0; i < 3; i++) dup2(fds[i], i), close(fds[i]);
+      // however the request ends, -h and a program under -run call exit() too
+      on_exit(reply, (void *)(intptr_t)conn);
+      std::vector<char *> argv;
+      for(size_t i = 1; i < strs.size(); i++) argv.push_back((char *)strs[i].c_str());
+      argv.push_back(nullptr);
+      QCC qcc(argv.size() - 1, argv.data());
+      qcc.set_prelude(macros);
+      try {
+        status = qcc.run();
+      } catch(compile_error &e) {
+        puts(e.what());
+        status = 1;
+      }
+      exit(status);
+    }
+    if(pid > 0) { // the child replies
+      for(int i = 0; i < 3; i++) close(fds[i]);
+      return;
+    }
+    dprintf(fds[2], "error: fork: %s\n", strerror(errno));
+  }
+  for(int i = 0; i < 3; i++) close(fds[i]);
+  write_all(conn, &status, sizeof(status));
+}
+
+int run_client(const std::string &socket_path, int argc, char **argv) {
+  int fd = connect_to(socket_path);
+  if(fd < 0) return -1;
+  if(!same_user(fd)) {
+    close(fd);
+    warning("warning: another user is listening on '%s', compiling here", socket_path.c_str());
+    return -1;
+  }
+  char cwd[PATH_MAX];
+  if(!getcwd(cwd, sizeof(cwd))) { close(fd); return -1; }
+  std::string body(cwd, strlen(cwd) + 1);
+  for(int i = 0; i < argc; i++) body.append(argv[i], strlen(argv[i]) + 1);
+  int status;
+  bool ok = send_request(fd, body) && read_all(fd, &status, sizeof(status));
+  close(fd);
+  if(!ok) {
+    puts("error: the server didn't finish the request");
+    return 1;
+  }
+  return status;
+}
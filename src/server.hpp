@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.hpp"
+#include "lexer.hpp"
+
+// qcc -server: compiles for 'qcc -client' over a unix domain socket.
+// the server keeps what every compilation would otherwise redo warm: the
+// registered targets, and the macros of include/qcc.h for each directory
+// it has served. each request runs in a forked child that starts from that
+// state, gets the client's cwd, stdin, stdout and stderr, and exits when
+// done, so nothing a request allocates stays in the server.
+// only the user the server runs as can use it: the socket is theirs alone,
+// and either side hangs up on a peer of another uid.
+class Server {
+  private:
+    struct prelude_t {
+      time_t mtime;
+      std::map<std::string, macro_t> macros;
+    };
+    std::map<std::string, prelude_t> preludes; // by the real path of include/qcc.h
+    int listen_fd = -1;
+
+    const std::map<std::string, macro_t> *prelude();
+    void serve(int conn);
+  public:
+    std::string socket_path = default_socket();
+    // $QCC_SERVER, or qcc.sock in default_dir()
+    static std::string default_socket();
+    // $XDG_RUNTIME_DIR, or /tmp/qcc-<uid>, which the server makes with mode 0700
+    static std::string default_dir();
+    int run();
+};
+
+// sends argv (argv[0] and the options and files) to the server and returns
+// the status of the compilation, or -1 when no server is listening
+int run_client(const std::string &socket_path, int argc, char **argv);
@@ -0,0 +1,147 @@
+#include "codegen.hpp"
+#include "pool.hpp"
+
+// parallel back end for -j<n>.
+// the front end and IR generation stay on one thread: every llvm::Type in the
+// AST belongs to the unit's context. the finished module is split into shards
+// of whole functions, declarations of everything else replicated, and each
+// shard is optimized and compiled in its own LLVMContext on a worker thread.
+// shards are made and merged in a fixed order, so the output doesn't depend
+// on the number of threads or on which thread took which shard.
+
+namespace {
+  const unsigned funcs_per_shard = 32, max_shards = 256;
+
+  struct shard_t {
+    llvm::SmallVector<char, 0> input;  // bitcode of the split module
+    llvm::SmallVector<char, 0> output; // optimized bitcode, or an object
+    std::string err;
+  };
+
+  void compile_shard(shard_t &shard, llvm::TargetMachine *tm, OutputKind output, int opt_level, int size_level) {
+    llvm::LLVMContext ctx;
+    llvm::StringRef input(shard.input.data(), shard.input.size());
+    auto m = llvm::parseBitcodeFile(llvm::MemoryBufferRef(input, "shard"), ctx);
+    if(!m) { shard.err = m.getError().message(); return; }
+    llvm::Module &shard_mod = **m;
+    optimize_module(shard_mod, tm, opt_level, size_level);
+    llvm::raw_svector_ostream out(shard.output);
+    if(output == OUTPUT_BITCODE) {
+      llvm::WriteBitcodeToFile(&shard_mod, out);
+      return;
+    }
+    llvm::legacy::PassManager pm;
+    if(tm->addPassesToEmitFile(pm, out, llvm::TargetMachine::CGFT_ObjectFile))
+      shard.err = "the target can't emit this type of file";
+    else pm.run(shard_mod);
+  }
+}
+
+// false when the module is too small to be worth splitting
+bool Codegen::run_sharded(const std::string &out_file_name) {
+  unsigned defined = 0;
+  for(auto &f : *unit->mod) if(!f.isDeclaration()) defined++;
+  unsigned n = std::min(max_shards, (defined + funcs_per_shard - 1) / funcs_per_shard);
+  if(n < 2) return false;
+  auto begin = std::chrono::steady_clock::now();
+
+  // a static function may be called from another shard, so locals become
+  // external for the split. the suffix keeps them apart from the same names
+  // in other translation units, and the merge makes them local again: by
+  // their name after the split, which llvm may have numbered, to the name
+  // they had before.
+  std::string tag;
+  {
+    llvm::MD5 md5; llvm::MD5::MD5Result res; llvm::SmallString<32> hex;
+    md5.update(out_file_name);
+    md5.final(res);
+    llvm::MD5::stringifyResult(res, hex);
+    tag = ".qcc." + hex.str().substr(0, 8).str();
+  }
+  std::map<std::string, std::string> locals;
+  auto externalize = [&](llvm::GlobalValue &gv) {
+    if(!gv.hasLocalLinkage()) return;
+    std::string name = gv.getName().str();
+    gv.setName((name.empty() ? "anon" : name) + tag);
+    gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    locals[gv.getName().str()] = name;
+  };
+  for(auto &f : *unit->mod) externalize(f);
+  for(auto &gv : unit->mod->globals()) externalize(gv);
+
+  std::vector<shard_t> shards;
+  shards.reserve(n);
+  llvm::SplitModule(std::unique_ptr<llvm::Module>(unit->mod), n, [&](std::unique_ptr<llvm::Module> part) {
+      shards.emplace_back();
+      llvm::raw_svector_ostream out(shards.back().input);
+      llvm::WriteBitcodeToFile(part.get(), out);
+  });
+  unit->mod = nullptr;
+
+  // TargetMachine isn't shared between threads, so each gets its own, for
+  // the optimizer's cost model and for emitting objects
+  unsigned nthreads = std::min<unsigned>(jobs, shards.size());
+  std::vector<std::unique_ptr<llvm::TargetMachine>> tms;
+  for(unsigned i = 0; i < nthreads; i++)
+    tms.emplace_back(create_target_machine(opt_level));
+  Pool pool(nthreads);
+  for(auto &shard : shards) 
+    pool.add([&](unsigned thread) { compile_shard(shard, tms[thread].get(), output, opt_level, size_level); });
+  pool.run();
+  for(auto &shard : shards)
+    if(!shard.err.empty()) error("error: %s", shard.err.c_str());
+
+  if(output == OUTPUT_BITCODE) {
+    unit->mod = new llvm::Module("QCC", unit->context);
+    unit->mod->setTargetTriple(unit->target_machine->getTargetTriple().str());
+    unit->mod->setDataLayout(unit->target_machine->createDataLayout());
+    for(auto &shard : shards) {
+      llvm::StringRef bc(shard.output.data(), shard.output.size());
+      auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bc, "shard"), unit->context);
+      if(!part) error("error: %s", part.getError().message().c_str());
+      if(llvm::Linker::linkModules(*unit->mod, std::move(*part)))
+        error("error: can't merge the shards of '%s'", out_file_name.c_str());
+    }
+    for(auto &local : locals) {
+      llvm::GlobalValue *gv = unit->mod->getNamedValue(local.first);
+      if(!gv) continue; // optimized away
+      gv->setLinkage(llvm::GlobalValue::InternalLinkage);
+      gv->setVisibility(llvm::GlobalValue::DefaultVisibility);
+      gv->setName(local.second);
+    }
+    std::error_code EC;
+    llvm::raw_fd_ostream out(out_file_name, EC, llvm::sys::fs::OpenFlags::F_RW);
+    llvm::WriteBitcodeToFile(unit->mod, out);
+  } else {
+    // one relocatable object out of the shards' objects, by the system
+    // linker, then the locals made local again by objcopy: hidden globals
+    // would still clash with another object's of the same output name
+    auto temporary = [](const char *data, size_t size) {
+      char path[] = "/tmp/qcc-XXXXXX.o";
+      int fd = mkstemps(path, 2);
+      if(fd < 0 || write(fd, data, size) != (ssize_t)size)
+        error("error: can't create a temporary file");
+      close(fd);
+      return std::string(path);
+    };
+    std::vector<std::string> objs, ld{"ld", "-r", "-o", out_file_name};
+    for(auto &shard : shards) objs.push_back(temporary(shard.output.data(), shard.output.size()));
+    std::string names;
+    for(auto &local : locals) names += local.first + "\n";
+    std::string list = temporary(names.data(), names.size());
+    ld.insert(ld.end(), objs.begin(), objs.end());
+    bool linked = run_program(ld) &&
+      run_program({"objcopy", "--localize-symbols=" + list, out_file_name});
+    for(auto &obj : objs) unlink(obj.c_str());
+    unlink(list.c_str());
+    if(!linked) error("error: merging the shards of '%s' failed", out_file_name.c_str());
+  }
+
+  if(time_report)
+    llvm::errs() << "codegen: " << defined << " functions in " << shards.size() << " shards on "
+                 << nthreads << " threads, "
+                 << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count()
+                 << " ms\n";
+  return true;
+}
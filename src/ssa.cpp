@@ -0,0 +1,120 @@
+#include "codegen.hpp"
+
+// on-the-fly SSA construction for locals whose address is never taken, after
+// Braun et al., "Simple and Efficient Construction of Static Single Assignment
+// Form". every block remembers the last value written to each variable; a read
+// in a block that has none asks the predecessors, placing a phi where they can
+// disagree. a block is sealed once all of its predecessors are known. until
+// then a read in it gets an operandless phi that sealing completes.
+//
+// blocks are sealed unless made by create_unsealed_block(), which the loops use
+// for their header, step and exit blocks: continue and break jump to those.
+
+llvm::BasicBlock *Codegen::create_unsealed_block(const std::string &name, llvm::Function *func) {
+  llvm::BasicBlock *bb = llvm::BasicBlock::Create(unit->context, name, func);
+  unsealed.insert(bb);
+  return bb;
+}
+
+void Codegen::seal_block(llvm::BasicBlock *bb) {
+  unsealed.erase(bb);
+  auto incomplete = incomplete_phis.find(bb);
+  if(incomplete == incomplete_phis.end()) return;
+  auto phis = std::move(incomplete->second);
+  incomplete_phis.erase(incomplete);
+  for(auto &p : phis) add_phi_operands(p.first, p.second);
+}
+
+void Codegen::reset_ssa() {
+  current_def.clear();
+  unsealed.clear();
+  incomplete_phis.clear();
+}
+
+void Codegen::write_var(var_t *v, llvm::BasicBlock *bb, llvm::Value *val) {
+  current_def[bb][v] = val;
+}
+
+llvm::Value *Codegen::read_var(var_t *v, llvm::BasicBlock *bb) {
+  auto &defs = current_def[bb];
+  auto d = defs.find(v);
+  if(d != defs.end() && d->second) return d->second;
+  return read_var_recursive(v, bb);
+}
+
+static llvm::PHINode *create_phi(var_t *v, llvm::BasicBlock *bb) {
+  if(bb->empty()) return llvm::PHINode::Create(v->type, 0, *v->name, bb);
+  return llvm::PHINode::Create(v->type, 0, *v->name, &bb->front());
+}
+
+llvm::Value *Codegen::read_var_recursive(var_t *v, llvm::BasicBlock *bb) {
+  llvm::Value *val;
+  if(unsealed.count(bb)) {
+    llvm::PHINode *phi = create_phi(v, bb);
+    incomplete_phis[bb].push_back(std::make_pair(v, phi));
+    val = phi;
+  } else if(llvm::BasicBlock *pred = bb->getSinglePredecessor()) {
+    val = read_var(v, pred);
+  } else if(llvm::pred_begin(bb) == llvm::pred_end(bb)) {
+    val = llvm::UndefValue::get(v->type); // read before any write
+  } else {
+    llvm::PHINode *phi = create_phi(v, bb);
+    write_var(v, bb, phi); // a loop may lead back here
+    val = add_phi_operands(v, phi);
+  }
+  write_var(v, bb, val);
+  return val;
+}
+
+llvm::Value *Codegen::add_phi_operands(var_t *v, llvm::PHINode *phi) {
+  std::vector<llvm::BasicBlock *> preds(llvm::pred_begin(phi->getParent()), llvm::pred_end(phi->getParent()));
+  for(auto pred : preds)
+    phi->addIncoming(read_var(v, pred), pred);
+  return try_remove_trivial_phi(phi);
+}
+
+// a phi that merges only itself and one other value is that value
+llvm::Value *Codegen::try_remove_trivial_phi(llvm::PHINode *phi) {
+  llvm::Value *same = nullptr;
+  for(unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+    llvm::Value *op = phi->getIncomingValue(i);
+    if(op == same || op == phi) continue;
+    if(same) return phi;
+    same = op;
+  }
+  if(!same) same = llvm::UndefValue::get(phi->getType());
+
+  std::vector<llvm::WeakVH> users;
+  for(auto u : phi->users())
+    if(u != phi && llvm::isa<llvm::PHINode>(u)) users.push_back(u);
+  // current_def holds WeakVHs, they follow this as well
+  phi->replaceAllUsesWith(same);
+  phi->eraseFromParent();
+  // removing this may have made the phis using it trivial
+  for(auto &u : users)
+    if(u) try_remove_trivial_phi(llvm::cast<llvm::PHINode>(u));
+  return same;
+}
+
+// the variable named by 'st' if it lives in SSA form, nullptr otherwise
+var_t *Codegen::ssa_var(AST *st) {
+  if(st->get_type() != AST_VARIABLE) return nullptr;
+  var_t *v = lookup_var(static_cast<VariableAST *>(st)->name);
+  return v && v->ssa ? v : nullptr;
+}
+
+llvm::Value *Codegen::load_var(var_t *v) {
+  if(v->ssa) return read_var(v, unit->builder.GetInsertBlock());
+  return unit->builder.CreateLoad(v->val);
+}
+
+// returns the value as stored
+llvm::Value *Codegen::store_var(var_t *v, llvm::Value *val) {
+  if(!v->ssa) {
+    asgmt_value(v->val, val);
+    return unit->builder.CreateLoad(v->val);
+  }
+  val = type_cast(val, v->type);
+  write_var(v, unit->builder.GetInsertBlock(), val);
+  return val;
+}
@@ -1,43 +1,70 @@
 #include "struct.hpp"
+#include "codegen.hpp"
+
+void struct_t::index_members() {
+  members.clear();
+  if(llvm_struct->isOpaque()) return;
+  const llvm::StructLayout *layout = unit->data_layout->getStructLayout(llvm_struct);
+  for(unsigned i = 0; i < members_name.size(); i++)
+    members[members_name[i]] = member_t{i, llvm_struct->getElementType(i), layout->getElementOffset(i)};
+}
+
+const member_t *struct_t::member(const std::string &name) const {
+  auto m = members.find(name);
+  return m == members.end() ? nullptr : &m->second;
+}
+
+void union_t::index_members() {
+  members_map.clear();
+  for(unsigned i = 0; i < members.size(); i++)
+    members_map[members[i].name] = member_t{i, members[i].type, 0};
+}
+
+const member_t *union_t::member(const std::string &name) const {
+  auto m = members_map.find(name);
+  return m == members_map.end() ? nullptr : &m->second;
+}
 
 void StructList::add(struct_t strct) {
+  struct_idx[strct.name] = struct_list.size();
   struct_list.push_back(strct);
 }
 
 void StructList::add(std::string name, std::vector<std::string> members_name, llvm::StructType *llvm_strct) {
-  struct_list.push_back(
-      (struct_t) {
-        name,
-        members_name,
-        llvm_strct
-        });
+  struct_t strct;
+  strct.name = name;
+  strct.members_name = members_name;
+  strct.llvm_struct = llvm_strct;
+  add(strct);
+}
+
+struct_t *StructList::get(const std::string &name) {
+  auto i = struct_idx.find(name);
+  return i == struct_idx.end() ? nullptr : &struct_list[i->second];
 }
 
-struct_t *StructList::get(std::string name) {
-  for(auto &s : struct_list) {
-    if(s.name == name)
-      return &s;
-  }
-  return nullptr;
+const std::vector<struct_t> &StructList::list() {
+  return struct_list;
 }
 
 void UnionList::add(union_t unon) {
+  union_idx[unon.name] = union_list.size();
   union_list.push_back(unon);
 }
 
 void UnionList::add(std::string name, std::vector<union_elem_t> members, llvm::StructType *llvm_union) {
-  union_list.push_back(
-      (union_t) {
-        name,
-        members,
-        llvm_union
-        });
-}
-
-union_t *UnionList::get(std::string name) {
-  for(auto &s : union_list) {
-    if(s.name == name)
-      return &s;
-  }
-  return nullptr;
+  union_t unon;
+  unon.name = name;
+  unon.members = members;
+  unon.llvm_union = llvm_union;
+  add(unon);
+}
+
+union_t *UnionList::get(const std::string &name) {
+  auto i = union_idx.find(name);
+  return i == union_idx.end() ? nullptr : &union_list[i->second];
+}
+
+const std::vector<union_t> &UnionList::list() {
+  return union_list;
 }
@@ -2,10 +2,21 @@
 
 #include "common.hpp"
 
+struct member_t {
+  unsigned index;
+  llvm::Type *type;
+  uint64_t offset; // in bytes
+};
+typedef std::unordered_map<std::string, member_t> member_map_t;
+
 struct struct_t {
   std::string name;
   std::vector<std::string> members_name;
   llvm::StructType *llvm_struct;
+  member_map_t members; // built by index_members() once the body is set
+
+  void index_members();
+  const member_t *member(const std::string &) const;
 };
 
 struct union_elem_t {
@@ -19,22 +30,30 @@ struct union_t {
   std::string name;
   std::vector<union_elem_t> members;
   llvm::StructType *llvm_union;
+  member_map_t members_map; // built by index_members() once the members are set
+
+  void index_members();
+  const member_t *member(const std::string &) const;
 };
 
 class StructList {
   private:
     std::vector<struct_t> struct_list;
+    std::unordered_map<std::string, size_t> struct_idx;
   public:
     void add(struct_t);
     void add(std::string name, std::vector<std::string>, llvm::StructType *);
-    struct_t *get(std::string);
+    struct_t *get(const std::string &);
+    const std::vector<struct_t> &list();
 };
 
 class UnionList {
   private:
     std::vector<union_t> union_list;
+    std::unordered_map<std::string, size_t> union_idx;
   public:
     void add(union_t);
     void add(std::string name, std::vector<union_elem_t>, llvm::StructType *);
-    union_t *get(std::string);
+    union_t *get(const std::string &);
+    const std::vector<union_t> &list();
 };
@@ -1,14 +1,24 @@
 #include "token.hpp"
 
+void Token::fill(size_t n) {
+  while(n >= token.size() && more && more(token));
+}
+
 token_t Token::get() {
+  fill(pos);
+  if(pos >= token.size()) error("error: program is reached EOF");
   return token[pos];
 }
 
 token_t Token::get(int skip) {
+  fill(pos + skip);
+  if(pos + skip >= token.size()) error("error: program is reached EOF");
   return token[pos + skip];
 }
 
 token_t Token::next() {
+  fill(pos);
+  if(pos >= token.size()) error("error: program is reached EOF");
   return token[pos++];
 }
 
@@ -16,7 +26,15 @@ void Token::seek(int pos) {
   this->pos = pos;
 }
 
+void Token::drop_consumed() {
+  if(pos < 4096 || pos < token.size() / 2) return;
+  token.erase(token.begin(), token.begin() + pos);
+  token.shrink_to_fit();
+  pos = 0;
+}
+
 bool Token::is_end() {
+  fill(pos);
   return !(pos < token.size());
 }
 
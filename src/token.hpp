@@ -19,6 +19,7 @@ struct token_t {
   std::string val;
   int line;
   bool space;
+  bool included = false; // from an #include: line is the header's
 
   std::map<std::string, bool> hideset; // for preprocessor
 };
@@ -30,6 +31,9 @@ class Token {
 
     std::vector<token_t> token;
     size_t pos = 0;
+    // where the tokens after these come from, if they aren't all here yet
+    // (see QCC::run_pipeline). appends some, false when there are no more
+    std::function<bool(std::vector<token_t> &)> more;
 
     void add_ident_tok  (std::string, int, bool = false);
     void add_symbol_tok (std::string, int, bool = false);
@@ -40,6 +44,9 @@ class Token {
     void add_end_tok    ();
 
     void seek(int);
+    // frees the tokens before pos, once they're most of them. positions
+    // taken before are no good after
+    void drop_consumed();
     bool is_end();
     token_t get();
     token_t get(int skip); // pos + skip
@@ -52,4 +59,6 @@ class Token {
     void prev();
 
     void show();
+  private:
+    void fill(size_t); // until token[n] is there, or there's no more
 };
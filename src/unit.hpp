@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.hpp"
+#include "lexer.hpp"
+
+// what one translation unit owns while it's compiled: the llvm context its
+// types and module live in, and the macros seen so far. QCC::run makes one
+// per file and points 'unit' at it, so files on different threads don't
+// share anything.
+struct unit_t {
+  llvm::LLVMContext context;
+  llvm::IRBuilder<> builder;
+  llvm::Module *mod = nullptr;
+  llvm::DataLayout *data_layout = nullptr;
+  llvm::TargetMachine *target_machine = nullptr;
+  std::map<std::string, macro_t> macro_map;
+  // sources and headers in memory, by the name they're opened or included
+  // by. the lexer looks here before the disk
+  std::map<std::string, std::string> files;
+  // where warning() puts its messages, instead of stdout, when set
+  std::vector<std::string> *warnings = nullptr;
+  // under -pipeline the parser makes types while codegen runs on another
+  // thread, and the context isn't thread-safe. both take this around what
+  // creates types or struct layouts, through types_guard
+  std::recursive_mutex types_lock;
+  std::atomic<int> types_waiting{0}; // threads blocked on it
+
+  unit_t(): builder(context) {}
+  ~unit_t() {
+    delete mod; // before the context it lives in
+    delete data_layout;
+    delete target_machine;
+  }
+};
+
+// the unit this thread is compiling
+extern thread_local unit_t *unit;
+
+// holds unit->types_lock while in scope. what a thread spends blocked on it
+// adds up in wait_ms, which -pipeline reports as waiting, not as work
+class types_guard {
+  private:
+    static thread_local int depth; // guards on this thread
+    void acquire() {
+      if(unit->types_lock.try_lock()) return;
+      auto start = std::chrono::steady_clock::now();
+      unit->types_waiting++;
+      unit->types_lock.lock();
+      unit->types_waiting--;
+      wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+  public:
+    static thread_local double wait_ms;
+
+    types_guard() { acquire(); depth++; }
+    ~types_guard() { depth--; unit->types_lock.unlock(); }
+    // lets the threads blocked on the lock have it first, so that a long
+    // holder (codegen, between statements) doesn't starve them. does nothing
+    // while an outer guard holds it too
+    void yield() {
+      if(depth > 1 || !unit->types_waiting) return;
+      unit->types_lock.unlock();
+      while(unit->types_waiting) std::this_thread::yield();
+      acquire();
+    }
+};
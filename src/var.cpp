@@ -1,12 +1,71 @@
 #include "var.hpp"
 
-var_t *VariableList::add(var_t v) {
-  var_list.push_back(v);
-  return &var_list.back();
+Arena::~Arena() {
+  for(auto c : chunks) free(c);
 }
 
-var_t *VariableList::get(std::string name) {
-  for(auto &v : var_list) 
-    if(v.name == name) return &v;
-  return nullptr;
+void *Arena::alloc(size_t size, size_t align) {
+  used = (used + align - 1) & ~(align - 1);
+  if(chunks.empty() || used + size > chunk_size) {
+    size_t n = std::max(chunk_size, size);
+    char *c = (char *)malloc(n);
+    if(!c) error("error: out of memory");
+    // a chunk bigger than usual goes below the current one, so the current one keeps filling up
+    if(n > chunk_size && !chunks.empty()) {
+      chunks.insert(chunks.end() - 1, c);
+      return c;
+    }
+    chunks.push_back(c);
+    used = 0;
+  }
+  void *p = chunks.back() + used;
+  used += size;
+  return p;
+}
+
+void Arena::reset() {
+  if(chunks.empty()) return;
+  for(size_t i = 1; i < chunks.size(); i++) free(chunks[i]);
+  chunks.resize(1);
+  used = 0;
+}
+
+var_t *SymbolTable::add(const std::string &name, llvm::Type *type) {
+  auto slot = table.insert(std::make_pair(name, nullptr)).first;
+  var_t *v = scopes.empty() ? global_arena.make<var_t>() : func_arena.make<var_t>();
+  v->type = type;
+  v->val = nullptr;
+  v->name = &slot->first;
+  v->shadowed = slot->second;
+  slot->second = v;
+  if(!scopes.empty()) decls.push_back(v);
+  return v;
+}
+
+var_t *SymbolTable::lookup(const std::string &name) {
+  auto slot = table.find(name);
+  return slot == table.end() ? nullptr : slot->second;
+}
+
+void SymbolTable::push_scope() {
+  scopes.push_back(decls.size());
+}
+
+void SymbolTable::pop_scope() {
+  size_t mark = scopes.back();
+  scopes.pop_back();
+  while(decls.size() > mark) {
+    var_t *v = decls.back();
+    decls.pop_back();
+    table[*v->name] = v->shadowed;
+  }
+}
+
+void SymbolTable::enter_function() {
+  push_scope();
+}
+
+void SymbolTable::leave_function() {
+  while(!scopes.empty()) pop_scope();
+  func_arena.reset();
 }
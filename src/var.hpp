@@ -3,17 +3,45 @@
 #include "common.hpp"
 
 struct var_t {
-  var_t(std::string _name, llvm::Type *_type):
-    type(_type), name(_name) {};
   llvm::Type *type;
   llvm::Value *val;
-  std::string name;
+  const std::string *name; // interned by SymbolTable
+  var_t *shadowed;         // the same name in an outer scope
+  bool ssa;                // no stack slot, val is unused. see ssa.cpp
 };
 
-class VariableList {
+// bump allocator, reset() frees everything at once
+class Arena {
   private:
-    std::vector<var_t> var_list;
+    std::vector<char *> chunks;
+    size_t chunk_size, used;
   public:
-    var_t *add(var_t);
-    var_t *get(std::string name);
+    Arena(size_t _chunk_size = 4096):
+      chunk_size(_chunk_size), used(_chunk_size) {};
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *alloc(size_t size, size_t align);
+    void reset(); // keeps the first chunk around for the next user
+    template<typename T> T *make() { return new(alloc(sizeof(T), alignof(T))) T(); }
+};
+
+// every visible variable in one hash table keyed by name. a name maps to its
+// innermost declaration, which links to the one it shadows. leaving a scope
+// pops that scope's declarations off an undo log.
+// locals live in a per-function arena, dropped as a whole by leave_function().
+class SymbolTable {
+  private:
+    std::unordered_map<std::string, var_t *> table;
+    std::vector<var_t *> decls; // undo log of locals, innermost last
+    std::vector<size_t> scopes; // decls.size() at each scope entry
+    Arena global_arena, func_arena;
+  public:
+    var_t *add(const std::string &, llvm::Type *);
+    var_t *lookup(const std::string &);
+    void push_scope();
+    void pop_scope();
+    void enter_function(); // the outermost scope of a function, for its parameters
+    void leave_function();
 };
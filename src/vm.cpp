@@ -0,0 +1,1192 @@
+#include "vm.hpp"
+#include "unit.hpp"
+#include "parse.hpp"
+
+const char *const host_data_layout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128";
+
+thread_local VM *VM::running;
+const void *const *VM::labels;
+
+namespace {
+  const size_t stack_regs = 1 << 20;     // 8 MiB of registers
+  const size_t memory_bytes = 64 << 20;  // for the frames, untouched until used
+  const int max_thunks = 64;             // interpreted functions C may hold at once
+  const size_t max_stack_args = 16;      // past the registers, in a call into C
+
+  double ms_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+  }
+
+  bool is_aggregate(llvm::Type *ty) {
+    return ty->isStructTy() || ty->isArrayTy();
+  }
+
+  bool is_int(AST *st) {
+    return st->get_type() == AST_NUMBER && !static_cast<NumberAST *>(st)->is_float;
+  }
+
+  // what a value of ty looks like in a register: integers sign-extended from
+  // their width, truth values 0 or 1
+  VM::value_t canonical(VM::value_t v, llvm::Type *ty) {
+    if(!ty->isIntegerTy()) return v;
+    switch(ty->getIntegerBitWidth()) {
+      case 1:  v.i &= 1; break;
+      case 8:  v.i = (int8_t)v.i; break;
+      case 16: v.i = (int16_t)v.i; break;
+      case 32: v.i = (int32_t)v.i; break;
+    }
+    return v;
+  }
+
+  // C calls an interpreted function through thunk N, which hands VM::enter
+  // everything that may hold an argument
+  template<int N>
+  uint64_t int_thunk(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5,
+      double f0, double f1, double f2, double f3, double f4, double f5, double f6, double f7) {
+    const uint64_t ints[] = { a0, a1, a2, a3, a4, a5 };
+    const double fps[] = { f0, f1, f2, f3, f4, f5, f6, f7 };
+    return VM::enter(N, ints, fps).u;
+  }
+  template<int N>
+  double double_thunk(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5,
+      double f0, double f1, double f2, double f3, double f4, double f5, double f6, double f7) {
+    const uint64_t ints[] = { a0, a1, a2, a3, a4, a5 };
+    const double fps[] = { f0, f1, f2, f3, f4, f5, f6, f7 };
+    return VM::enter(N, ints, fps).d;
+  }
+  template<int N> struct thunks {
+    static void fill(void **ints, void **doubles) {
+      thunks<N - 1>::fill(ints, doubles);
+      ints[N - 1] = (void *)&int_thunk<N - 1>;
+      doubles[N - 1] = (void *)&double_thunk<N - 1>;
+    }
+  };
+  template<> struct thunks<0> {
+    static void fill(void **, void **) {}
+  };
+  struct thunk_table_t {
+    void *ints[max_thunks], *doubles[max_thunks];
+    thunk_table_t() { thunks<max_thunks>::fill(ints, doubles); }
+  };
+  const thunk_table_t &thunk_table() {
+    static thunk_table_t table;
+    return table;
+  }
+
+  // any function of up to 6 integer and 8 floating-point arguments in
+  // registers, variadic or not, and max_stack_args words on the stack. al is
+  // 8 for a variadic one, which is what it may be
+  typedef uint64_t (*int_fn_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+      double, double, double, double, double, double, double, double, ...);
+  typedef double (*double_fn_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+      double, double, double, double, double, double, double, double, ...);
+}
+
+VM::VM():
+  stack(new value_t[stack_regs]), stack_end(stack.get() + stack_regs),
+  memory(new char[memory_bytes]), memory_end(memory.get() + memory_bytes) {
+  top = stack.get();
+  msp = memory.get();
+  init.name = "<init>";
+  init.index = -1;
+}
+
+VM::~VM() {
+  for(auto a : allocations) free(a);
+  if(running == this) running = nullptr;
+}
+
+int VM::run(AST_vec &ast, const std::vector<std::string> &args) {
+  auto begin = std::chrono::steady_clock::now();
+  exec(nullptr, nullptr); // for finish()
+  // until the VM is gone: what the program gave atexit() may come back in
+  // after main() returns, see QCC::run_interp
+  running = this;
+  load(ast);
+  auto m = by_name.find("main");
+  if(m == by_name.end() || !m->second->def) error("error: no main() to run");
+  function_t *main_func = m->second;
+  compile(main_func);
+  double load_ms = ms_since(begin);
+  compile_ms = 0; // from here on, what the functions main() calls take
+
+  std::vector<char *> argv;
+  for(auto &a : args) argv.push_back((char *)a.c_str());
+  argv.push_back(nullptr);
+  value_t *regs = stack.get();
+  llvm::FunctionType *fty = main_func->def->func_type;
+  value_t params[3];
+  params[0].i = (int)args.size();
+  params[1].p = (char *)argv.data();
+  params[2].p = (char *)environ;
+  for(unsigned i = 0; i < fty->getNumParams() && i < 3; i++)
+    regs[i] = canonical(params[i], fty->getParamType(i));
+
+  auto exec_begin = std::chrono::steady_clock::now();
+  fflush(stdout);
+  if(!init.code.empty()) exec(&init, regs + main_func->nregs);
+  value_t ret = exec(main_func, regs);
+  fflush(stdout);
+  double exec_ms = ms_since(exec_begin) - compile_ms;
+  if(time_report) {
+    size_t defined = std::count_if(funcs.begin(), funcs.end(), [](const function_t &f) { return f.def; });
+    size_t compiled = std::count_if(funcs.begin(), funcs.end(), [](const function_t &f) { return f.compiled; });
+    fprintf(stderr, "-interp: front end %.3f ms, bytecode %.3f ms (%zu of %zu functions, %zu instructions), execution %.3f ms\n",
+        frontend_ms, load_ms + compile_ms, compiled, defined, instructions, exec_ms);
+  }
+  return fty->getReturnType()->isVoidTy() ? 0 : (int)ret.i;
+}
+
+// every top-level declaration, before anything runs: calls may go to
+// functions defined further down. the initializers of the globals become
+// the code of 'init', once every function and global is known, since they
+// may take the address of one defined further down too
+void VM::load(AST_vec &ast) {
+  auto start = std::chrono::steady_clock::now();
+  cur = &init;
+  top_reg = 0, frame_top = 0, landing = ~(size_t)0;
+  scopes.clear();
+  for(auto st : ast) {
+    switch(st->get_type()) {
+      case AST_FUNCTION_PROTO:
+        function(static_cast<FunctionProtoAST *>(st)->name);
+        break;
+      case AST_FUNCTION_DEF:
+        function(static_cast<FunctionDefAST *>(st)->name)->def = static_cast<FunctionDefAST *>(st);
+        break;
+      case AST_VAR_DECLARATION:
+        declare_globals(static_cast<VarDeclarationAST *>(st));
+        break;
+    }
+  }
+  for(auto st : ast)
+    if(st->get_type() == AST_VAR_DECLARATION) init_globals(static_cast<VarDeclarationAST *>(st));
+  if(!init.code.empty()) {
+    emit(OP_RETV);
+    finish(&init);
+  }
+  cur = nullptr;
+  compile_ms += ms_since(start);
+}
+
+VM::function_t *VM::function(const std::string &name) {
+  auto f = by_name.find(name);
+  if(f != by_name.end()) return f->second;
+  funcs.emplace_back();
+  function_t *g = &funcs.back();
+  g->name = name;
+  g->index = by_index.size();
+  by_index.push_back(g);
+  by_name[name] = g;
+  return g;
+}
+
+// a function only declared is looked up in qcc's own process, as -run does.
+// glibc links atexit() into each program instead, so dlsym can't find it:
+// the program gets qcc's own
+void *VM::native_symbol(function_t *f) {
+  if(!f->native && f->name == "atexit") f->native = (void *)&atexit;
+  if(!f->native) f->native = dlsym(RTLD_DEFAULT, f->name.c_str());
+  if(!f->native) error("error: -interp: undefined reference to '%s'", f->name.c_str());
+  return f->native;
+}
+
+// what C calls f by. an interpreted function gets a thunk the first time
+void *VM::address_of(function_t *f) {
+  if(!f->def) return native_symbol(f);
+  if(f->native) return f->native;
+  llvm::FunctionType *fty = f->def->func_type;
+  unsigned ints = 0, fps = 0;
+  for(unsigned i = 0; i < fty->getNumParams(); i++) {
+    llvm::Type *ty = fty->getParamType(i);
+    if(is_aggregate(ty)) error("error: -interp: '%s' takes a struct, so C can't call it", f->name.c_str());
+    (ty->isDoubleTy() ? fps : ints)++;
+  }
+  if(ints > 6 || fps > 8) error("error: -interp: '%s' takes too many arguments for C to call it", f->name.c_str());
+  if(slots.size() == max_thunks) error("error: -interp: more than %d functions are called from C", max_thunks);
+  const thunk_table_t &table = thunk_table();
+  f->native = fty->getReturnType()->isDoubleTy() ? table.doubles[slots.size()] : table.ints[slots.size()];
+  slots.push_back(f);
+  thunked[f->native] = f;
+  return f->native;
+}
+
+VM::value_t VM::enter(int slot, const uint64_t *ints, const double *fps) {
+  VM *vm = running;
+  function_t *f = vm->slots[slot];
+  if(!f->compiled) vm->compile(f);
+  // above whatever called into C
+  value_t *saved = vm->top, *regs = saved;
+  if(regs + f->nregs > vm->stack_end) error("error: -interp: stack overflow");
+  llvm::FunctionType *fty = f->def->func_type;
+  unsigned ni = 0, nf = 0;
+  for(unsigned i = 0; i < fty->getNumParams(); i++) {
+    llvm::Type *ty = fty->getParamType(i);
+    if(ty->isDoubleTy()) regs[i].d = fps[nf++];
+    else regs[i].u = ints[ni++], regs[i] = canonical(regs[i], ty);
+  }
+  value_t ret = vm->exec(f, regs);
+  vm->top = saved;
+  return ret;
+}
+
+VM::global_t *VM::global(const std::string &name) {
+  auto g = globals.find(name);
+  if(g == globals.end()) return nullptr;
+  if(!g->second.addr) {
+    g->second.addr = (char *)dlsym(RTLD_DEFAULT, name.c_str());
+    if(!g->second.addr) error("error: -interp: undefined reference to '%s'", name.c_str());
+  }
+  return &g->second;
+}
+
+const char *VM::string(const std::string &str) {
+  auto s = strings.find(str);
+  if(s != strings.end()) return s->second;
+  string_data.push_back(str);
+  return strings[str] = string_data.back().c_str();
+}
+
+uint64_t VM::size_of(llvm::Type *ty) {
+  return unit->data_layout->getTypeAllocSize(ty);
+}
+
+VM::local_t *VM::lookup(const std::string &name) {
+  for(auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+    auto l = s->find(name);
+    if(l != s->end()) return &l->second;
+  }
+  return nullptr;
+}
+
+// globals are zeroed, then set by init before main() runs
+void VM::declare_globals(VarDeclarationAST *st) {
+  for(auto d : st->decls) {
+    global_t &g = globals[d->name];
+    if(st->stg == STG_EXTERN && !d->init_expr) {
+      if(!g.type) g.type = d->type, g.qual = d->qual, g.external = true;
+      continue;
+    }
+    if(!g.addr || g.external) {
+      g.type = d->type, g.qual = d->qual, g.external = false;
+      g.addr = (char *)calloc(1, std::max<uint64_t>(size_of(d->type), 1));
+      allocations.push_back(g.addr);
+    }
+  }
+}
+
+void VM::init_globals(VarDeclarationAST *st) {
+  for(auto d : st->decls) {
+    if(!d->init_expr) continue;
+    global_t &g = globals[d->name];
+    int mark = top_reg;
+    init_memory(lvalue_t{load_ptr(g.addr), 0}, g.type, g.qual, d->init_expr);
+    top_reg = mark;
+  }
+}
+
+void VM::compile(function_t *f) {
+  auto start = std::chrono::steady_clock::now();
+  FunctionDefAST *st = f->def;
+  cur = f;
+  top_reg = 0, frame_top = 0, landing = ~(size_t)0;
+  scopes.assign(1, std::map<std::string, local_t>());
+  llvm::FunctionType *fty = st->func_type;
+  // the arguments are the first registers
+  int nparams = fty->getNumParams();
+  top_reg = cur->nregs = nparams;
+  for(int i = 0; i < nparams && i < (int)st->args_name.size(); i++) {
+    llvm::Type *ty = fty->getParamType(i);
+    int qual = i < (int)st->args_qual.size() ? st->args_qual[i] : 0;
+    bool escapes = i >= (int)st->args_escape.size() || st->args_escape[i];
+    local_t l{ty, qual, i, false};
+    if(is_aggregate(ty) || (escapes && ty->isSingleValueType())) {
+      // a struct comes as the caller's address, and is copied
+      l.reg = alloc(), l.memory = true;
+      emit(OP_FRAME, l.reg, 0, frame_alloc(ty));
+      if(is_aggregate(ty)) emit(OP_COPY, l.reg, i, 0, size_of(ty));
+      else store(lvalue_t{l.reg, 0}, i, ty);
+    }
+    scopes.back()[st->args_name[i]] = l;
+  }
+  for(auto s : st->body) statement(s);
+  if(falls_through()) {
+    if(fty->getReturnType()->isVoidTy()) emit(OP_RETV);
+    else emit(OP_RET, load_int(0)); // 0.0 too
+  }
+  finish(f);
+  scopes.clear();
+  cur = nullptr;
+  compile_ms += ms_since(start);
+}
+
+// instructions jump straight to where exec handles them
+void VM::finish(function_t *f) {
+  for(auto &insn : f->code) insn.label = labels[insn.op];
+  f->frame_size = (f->frame_size + 15) & ~15;
+  f->compiled = true;
+  instructions += f->code.size();
+}
+
+size_t VM::emit(int op, int32_t a, int32_t b, int32_t c, int32_t d) {
+  insn_t insn;
+  insn.op = op;
+  insn.a = a, insn.b = b, insn.c = c, insn.d = d;
+  cur->code.push_back(insn);
+  return cur->code.size() - 1;
+}
+
+// registers are taken and given back as a stack: what an expression or a
+// block took is free once it's done
+int VM::alloc() {
+  int r = top_reg++;
+  cur->nregs = std::max(cur->nregs, top_reg);
+  return r;
+}
+
+int VM::constant(value_t v) {
+  cur->consts.push_back(v);
+  return cur->consts.size() - 1;
+}
+
+int VM::load_int(int64_t n) {
+  int r = alloc();
+  if(n == (int32_t)n) emit(OP_KINT, r, 0, n);
+  else {
+    value_t v;
+    v.i = n;
+    emit(OP_KVAL, r, 0, constant(v));
+  }
+  return r;
+}
+
+int VM::load_ptr(const void *p) {
+  value_t v;
+  v.p = (char *)p;
+  int r = alloc();
+  emit(OP_KVAL, r, 0, constant(v));
+  return r;
+}
+
+// the next position, as something jumps to it
+size_t VM::here() {
+  return landing = cur->code.size();
+}
+
+bool VM::falls_through() {
+  auto &code = cur->code;
+  if(code.empty() || landing == code.size()) return true;
+  intptr_t op = code.back().op;
+  return op != OP_JMP && op != OP_RET && op != OP_RETV;
+}
+
+void VM::patch(const std::vector<size_t> &jumps, size_t to) {
+  for(auto j : jumps) cur->code[j].d = to;
+}
+
+// r to dst. when r is a temporary the last instruction just computed, that
+// instruction computes into dst instead
+void VM::move(int dst, int r, int mark) {
+  if(dst == r) return;
+  auto &code = cur->code;
+  if(r >= mark && !code.empty() && landing != code.size() && code.back().a == r) {
+    intptr_t op = code.back().op;
+    if(op < OP_STORE8 || (op >= OP_CALL && op <= OP_CALLI)) {
+      code.back().a = dst;
+      return;
+    }
+  }
+  emit(OP_MOV, dst, r);
+}
+
+int32_t VM::frame_alloc(llvm::Type *ty) {
+  int32_t offset = (frame_top + 15) & ~15;
+  frame_top = offset + size_of(ty);
+  cur->frame_size = std::max(cur->frame_size, frame_top);
+  return offset;
+}
+
+void VM::statement(AST *st) {
+  int mark = top_reg;
+  switch(st->get_type()) {
+    case AST_VAR_DECLARATION: // its registers stay taken until the block ends
+      return declare_locals(static_cast<VarDeclarationAST *>(st));
+    case AST_FUNCTION_PROTO:
+    case AST_TYPEDEF:
+      return;
+    case AST_BLOCK:
+      scopes.push_back(std::map<std::string, local_t>());
+      for(auto s : static_cast<BlockAST *>(st)->body) statement(s);
+      scopes.pop_back();
+      break;
+    case AST_IF: {
+      IfAST *i = static_cast<IfAST *>(st);
+      std::vector<size_t> to_else;
+      branch(i->cond, false, to_else);
+      top_reg = mark;
+      if(i->b_then) statement(i->b_then);
+      if(i->b_else) {
+        std::vector<size_t> to_end;
+        if(falls_through()) to_end.push_back(emit(OP_JMP));
+        patch(to_else, here());
+        statement(i->b_else);
+        patch(to_end, here());
+      } else patch(to_else, here());
+      break;
+    }
+    case AST_WHILE:
+    case AST_FOR: {
+      // the condition is tested at the bottom, after a jump to it the first time
+      bool is_for = st->get_type() == AST_FOR;
+      ForAST *f = is_for ? static_cast<ForAST *>(st) : nullptr;
+      WhileAST *w = is_for ? nullptr : static_cast<WhileAST *>(st);
+      // like codegen, a declaration in 'for(...)' belongs to the enclosing block
+      if(f && f->init) statement(f->init), mark = top_reg;
+      AST *cond = f ? f->cond : w->cond;
+      std::vector<size_t> to_cond;
+      if(cond) to_cond.push_back(emit(OP_JMP));
+      size_t body = here();
+      breaks.push_back({}), continues.push_back({});
+      statement(f ? f->body : w->body);
+      top_reg = mark;
+      patch(continues.back(), here());
+      if(f && f->reinit) expr(f->reinit), top_reg = mark;
+      patch(to_cond, here());
+      std::vector<size_t> to_body;
+      if(cond) branch(cond, true, to_body);
+      else to_body.push_back(emit(OP_JMP));
+      patch(to_body, body);
+      patch(breaks.back(), here());
+      breaks.pop_back(), continues.pop_back();
+      break;
+    }
+    case AST_BREAK:
+      if(breaks.empty()) error("error: 'break' not in a loop");
+      breaks.back().push_back(emit(OP_JMP));
+      break;
+    case AST_CONTINUE:
+      if(continues.empty()) error("error: 'continue' not in a loop");
+      continues.back().push_back(emit(OP_JMP));
+      break;
+    case AST_RETURN: {
+      ReturnAST *r = static_cast<ReturnAST *>(st);
+      if(!r->expr) {
+        emit(OP_RETV);
+        break;
+      }
+      if(r->ctype.type && r->ctype.type->isStructTy())
+        error("error: -interp: functions returning structs are not supported");
+      emit(OP_RET, convert(expr(r->expr), r->expr->ctype, r->ctype));
+      break;
+    }
+    default:
+      expr(st);
+  }
+  top_reg = mark;
+}
+
+// static locals are automatic, as codegen has them
+void VM::declare_locals(VarDeclarationAST *st) {
+  for(auto d : st->decls) {
+    if(st->stg == STG_EXTERN) {
+      if(!globals.count(d->name)) {
+        global_t &g = globals[d->name];
+        g.type = d->type, g.qual = d->qual, g.external = true;
+      }
+      scopes.back().erase(d->name);
+      continue;
+    }
+    local_t l{d->type, d->qual, alloc(), d->escapes || !d->type->isSingleValueType()};
+    int mark = top_reg;
+    if(l.memory) {
+      emit(OP_FRAME, l.reg, 0, frame_alloc(d->type));
+      if(d->init_expr) init_memory(lvalue_t{l.reg, 0}, d->type, d->qual, d->init_expr);
+    } else if(d->init_expr) {
+      move(l.reg, convert(expr(d->init_expr), d->init_expr->ctype, ctype_t(d->type, d->qual)), mark);
+    }
+    top_reg = mark;
+    scopes.back()[d->name] = l;
+  }
+}
+
+// 'int a[4] = {1, 2}', 'struct s v = {1, {2, 3}}' and 'char s[8] = "abc"'
+// leave the rest zeroed
+void VM::init_memory(lvalue_t dst, llvm::Type *ty, int qual, AST *init) {
+  if(is_aggregate(ty) && init->get_type() == AST_ARRAY) {
+    AST_vec &elems = static_cast<ArrayAST *>(init)->elems;
+    emit(OP_ZERO, address(dst), 0, 0, size_of(ty));
+    llvm::StructType *sty = ty->isStructTy() ? llvm::cast<llvm::StructType>(ty) : nullptr;
+    uint64_t n = sty ? sty->getNumElements() : ty->getArrayNumElements();
+    if(elems.size() > n) error("error: excess elements");
+    for(size_t i = 0; i < elems.size(); i++) {
+      llvm::Type *elem = sty ? sty->getElementType(i) : ty->getArrayElementType();
+      uint64_t offset = sty ? unit->data_layout->getStructLayout(sty)->getElementOffset(i) : i * size_of(elem);
+      int mark = top_reg;
+      init_memory(lvalue_t{dst.reg, (int32_t)(dst.offset + offset)}, elem, qual, elems[i]);
+      top_reg = mark;
+    }
+    return;
+  }
+  if(ty->isArrayTy() && init->get_type() == AST_STRING) {
+    const std::string &str = static_cast<StringAST *>(init)->str;
+    int to = address(dst);
+    emit(OP_ZERO, to, 0, 0, size_of(ty));
+    emit(OP_COPY, to, load_ptr(string(str)), 0, std::min<uint64_t>(str.size() + 1, size_of(ty)));
+    return;
+  }
+  int r = expr(init);
+  if(!is_aggregate(ty)) r = convert(r, init->ctype, ctype_t(ty, qual));
+  store(dst, r, ty);
+}
+
+// jumps to what's added to 'jumps' when the truth of cond is 'when', and
+// falls through otherwise. && and || short-circuit, and a comparison of
+// integers or pointers jumps on its own
+void VM::branch(AST *cond, bool when, std::vector<size_t> &jumps) {
+  int mark = top_reg;
+  if(cond->get_type() == AST_NUMBER) {
+    NumberAST *n = static_cast<NumberAST *>(cond);
+    if((n->is_float ? n->f_number != 0 : n->i_number != 0) == when) jumps.push_back(emit(OP_JMP));
+    return;
+  }
+  if(cond->get_type() == AST_UNARY && static_cast<UnaryAST *>(cond)->op == "!")
+    return branch(static_cast<UnaryAST *>(cond)->expr, !when, jumps);
+  if(cond->get_type() == AST_BINARY) {
+    BinaryAST *b = static_cast<BinaryAST *>(cond);
+    const std::string &op = b->op;
+    if(op == "&&" || op == "||") {
+      // the side that decides alone, and how
+      bool decides = op == "||";
+      if(when == decides) {
+        branch(b->lhs, when, jumps);
+        branch(b->rhs, when, jumps);
+      } else {
+        std::vector<size_t> skip;
+        branch(b->lhs, decides, skip);
+        branch(b->rhs, when, jumps);
+        patch(skip, here());
+      }
+      return;
+    }
+    static const char *const cmps[] = { "==", "!=", "<", "<=", ">", ">=" };
+    int k = std::find(cmps, cmps + 6, op) - cmps;
+    if(k < 6 && b->conv.type && !b->conv.type->isDoubleTy()) {
+      bool is_unsigned = b->conv.is_unsigned() || b->conv.type->isPointerTy();
+      if(is_unsigned && k >= 2) k += 4; // ULT...
+      static const int inverse[] = { 1, 0, 5, 4, 3, 2, 9, 8, 7, 6 };
+      if(!when) k = inverse[k];
+      int l = convert(expr(b->lhs), b->lhs->ctype, b->conv);
+      if(is_int(b->rhs) && k < 6 && !(b->conv.type->isPointerTy() && static_cast<NumberAST *>(b->rhs)->i_number < 0)) {
+        jumps.push_back(emit(OP_JEQI + k, l, 0, static_cast<NumberAST *>(b->rhs)->i_number));
+      } else {
+        int r = convert(expr(b->rhs), b->rhs->ctype, b->conv);
+        jumps.push_back(emit(OP_JEQ + k, l, r));
+      }
+      top_reg = mark;
+      return;
+    }
+  }
+  int r = expr(cond);
+  if(cond->ctype.type && cond->ctype.type->isDoubleTy()) {
+    // unordered, as codegen's 'x != 0.0' for conditions: NaN is true
+    value_t zero;
+    zero.d = 0;
+    int z = alloc();
+    emit(OP_KVAL, z, 0, constant(zero));
+    emit(OP_FEQ, z, r, z);
+    jumps.push_back(emit(when ? OP_JZ : OP_JNZ, z));
+  } else jumps.push_back(emit(when ? OP_JNZ : OP_JZ, r));
+  top_reg = mark;
+}
+
+int VM::expr(AST *st) {
+  switch(st->get_type()) {
+    case AST_NUMBER: {
+      NumberAST *n = static_cast<NumberAST *>(st);
+      if(!n->is_float) return load_int(n->i_number);
+      value_t v;
+      v.d = n->f_number;
+      int r = alloc();
+      emit(OP_KVAL, r, 0, constant(v));
+      return r;
+    }
+    case AST_STRING:
+      return load_ptr(string(static_cast<StringAST *>(st)->str));
+    case AST_VARIABLE:
+      return variable(static_cast<VariableAST *>(st));
+    case AST_INDEX:
+    case AST_DOT:
+      return load(lvalue(st), st->ctype.type);
+    case AST_UNARY:
+      return unary(static_cast<UnaryAST *>(st));
+    case AST_BINARY:
+      return binary(static_cast<BinaryAST *>(st));
+    case AST_TERNARY:
+      return ternary(static_cast<TernaryAST *>(st));
+    case AST_ASGMT:
+      return assign(static_cast<AsgmtAST *>(st));
+    case AST_FUNCTION_CALL:
+      return call(static_cast<FunctionCallAST *>(st));
+    case AST_TYPECAST: {
+      TypeCastAST *c = static_cast<TypeCastAST *>(st);
+      int r = expr(c->expr);
+      return c->cast_to->isVoidTy() ? r : convert(r, c->expr->ctype, c->ctype);
+    }
+    case AST_SIZEOF:
+      return load_int(size_of(static_cast<SizeofAST *>(st)->operand_type));
+  }
+  error("error: -interp: unsupported expression");
+  return 0;
+}
+
+// an array, or a struct, is its address
+int VM::variable(VariableAST *st) {
+  if(local_t *l = lookup(st->name)) {
+    if(!l->memory || is_aggregate(l->type)) return l->reg;
+    return load(lvalue_t{l->reg, 0}, l->type);
+  }
+  if(global_t *g = global(st->name)) {
+    int a = load_ptr(g->addr);
+    return is_aggregate(g->type) ? a : load(lvalue_t{a, 0}, g->type);
+  }
+  auto f = by_name.find(st->name);
+  if(f != by_name.end()) return load_ptr(address_of(f->second));
+  error("error: not found variable '%s'", st->name.c_str());
+  return 0;
+}
+
+VM::lvalue_t VM::lvalue(AST *st) {
+  switch(st->get_type()) {
+    case AST_VARIABLE: {
+      const std::string &name = static_cast<VariableAST *>(st)->name;
+      if(local_t *l = lookup(name)) {
+        if(!l->memory) error("error: in -interp: '%s' has no address", name.c_str());
+        return lvalue_t{l->reg, 0};
+      }
+      if(global_t *g = global(name)) return lvalue_t{load_ptr(g->addr), 0};
+      error("error: not found variable '%s'", name.c_str());
+    }
+    case AST_INDEX: {
+      IndexAST *i = static_cast<IndexAST *>(st);
+      int64_t size = size_of(st->ctype.type);
+      // a row of an array of arrays is where the array is, plus an offset
+      lvalue_t base = i->ary->ctype.type->isArrayTy() ? lvalue(i->ary) : lvalue_t{expr(i->ary), 0};
+      if(is_int(i->idx)) {
+        int64_t offset = base.offset + size * static_cast<NumberAST *>(i->idx)->i_number;
+        if(offset == (int32_t)offset) return lvalue_t{base.reg, (int32_t)offset};
+      }
+      if(!i->idx->ctype.type->isIntegerTy()) error("error: unknown operation");
+      int r = alloc();
+      emit(OP_INDEX, r, base.reg, expr(i->idx), size);
+      return lvalue_t{r, base.offset};
+    }
+    case AST_DOT: {
+      DotOpAST *d = static_cast<DotOpAST *>(st);
+      const std::string &name = static_cast<VariableAST *>(d->rhs)->name;
+      llvm::Type *ty = d->lhs->ctype.type;
+      bool is_pointer = ty->isPointerTy();
+      lvalue_t base = is_pointer ? lvalue_t{expr(d->lhs), 0} : lvalue(d->lhs);
+      if(is_pointer) ty = ty->getPointerElementType();
+      std::string sname = ty->getStructName().str();
+      const member_t *m = nullptr;
+      if(struct_t *s = struct_list.get(sname)) {
+        if(!(m = s->member(name))) error("error: not found element '%s' in struct '%s'", name.c_str(), sname.c_str());
+      } else if(union_t *u = union_list.get(sname)) {
+        if(!(m = u->member(name))) error("error: not found element '%s' in union '%s'", name.c_str(), sname.c_str());
+      } else error("error: not found union or struct '%s'", sname.c_str());
+      base.offset += m->offset;
+      return base;
+    }
+    case AST_UNARY:
+      if(static_cast<UnaryAST *>(st)->op == "*") return lvalue_t{expr(static_cast<UnaryAST *>(st)->expr), 0};
+  }
+  error("error: lvalue required");
+  return lvalue_t();
+}
+
+int VM::address(lvalue_t lv) {
+  if(lv.offset == 0) return lv.reg;
+  int r = alloc();
+  emit(OP_ADDI64, r, lv.reg, lv.offset);
+  return r;
+}
+
+int VM::load(lvalue_t lv, llvm::Type *ty) {
+  if(is_aggregate(ty)) return address(lv);
+  int op = ty->isIntegerTy() && ty->getIntegerBitWidth() <= 8 ? OP_LOAD8 :
+           ty->isIntegerTy(16) ? OP_LOAD16 : ty->isIntegerTy(32) ? OP_LOAD32 : OP_LOAD64;
+  int r = alloc();
+  emit(op, r, lv.reg, 0, lv.offset);
+  return r;
+}
+
+void VM::store(lvalue_t lv, int r, llvm::Type *ty) {
+  if(is_aggregate(ty)) {
+    emit(OP_COPY, address(lv), r, 0, size_of(ty));
+    return;
+  }
+  int op = ty->isIntegerTy() && ty->getIntegerBitWidth() <= 8 ? OP_STORE8 :
+           ty->isIntegerTy(16) ? OP_STORE16 : ty->isIntegerTy(32) ? OP_STORE32 : OP_STORE64;
+  emit(op, lv.reg, r, 0, lv.offset);
+}
+
+int VM::unary(UnaryAST *st) {
+  const std::string &op = st->op;
+  AST *e = st->expr;
+  if(op == "&") {
+    if(e->get_type() == AST_VARIABLE) {
+      const std::string &name = static_cast<VariableAST *>(e)->name;
+      auto f = by_name.find(name);
+      if(!lookup(name) && !globals.count(name) && f != by_name.end()) return load_ptr(address_of(f->second));
+    }
+    return address(lvalue(e));
+  }
+  if(op == "*") {
+    // '(*fp)(...)' calls what fp points to
+    if(st->ctype.type->isFunctionTy()) return expr(e);
+    return load(lvalue(st), st->ctype.type);
+  }
+  if(op == "++" || op == "--") return step(st);
+  if(op == "!") { // of the value as it is, 0 or 1
+    int v = expr(e), r = alloc();
+    if(!e->ctype.type->isDoubleTy()) {
+      emit(OP_LNOT, r, v);
+      return r;
+    }
+    value_t zero;
+    zero.d = 0;
+    emit(OP_KVAL, r, 0, constant(zero));
+    emit(OP_FEQ, r, v, r);
+    return r;
+  }
+  int v = convert(expr(e), e->ctype, st->ctype);
+  llvm::Type *ty = st->ctype.type;
+  int r = alloc();
+  if(op == "-" && ty->isDoubleTy()) { // 0.0 - x, as codegen has it
+    value_t zero;
+    zero.d = 0;
+    emit(OP_KVAL, r, 0, constant(zero));
+    emit(OP_FSUB, r, r, v);
+  } else if(op == "-" && ty->isIntegerTy()) {
+    emit(ty->getIntegerBitWidth() > 32 ? OP_NEG64 : OP_NEG32, r, v);
+  } else if(op == "~" && ty->isIntegerTy()) {
+    emit(OP_NOT, r, v);
+  } else error("error: unknown operation");
+  return r;
+}
+
+// ++ and --. a char or a short wraps at its own width
+int VM::step(UnaryAST *st) {
+  AST *e = st->expr;
+  llvm::Type *ty = st->ctype.type;
+  int sign = st->op == "++" ? 1 : -1;
+  auto add = [&](int dst, int src) {
+    if(ty->isPointerTy()) {
+      emit(OP_ADDI64, dst, src, sign * (int64_t)size_of(ty->getPointerElementType()));
+    } else if(ty->isDoubleTy()) {
+      value_t one;
+      one.d = 1;
+      int k = alloc();
+      emit(OP_KVAL, k, 0, constant(one));
+      emit(sign > 0 ? OP_FADD : OP_FSUB, dst, src, k);
+    } else if(ty->isIntegerTy(64)) {
+      emit(OP_ADDI64, dst, src, sign);
+    } else if(ty->isIntegerTy()) {
+      emit(OP_ADDI32, dst, src, sign);
+      unsigned bits = ty->getIntegerBitWidth();
+      if(bits < 32) emit(bits == 1 ? OP_TRUNC1 : bits == 8 ? OP_SEXT8 : OP_SEXT16, dst, dst);
+    } else error("error: unknown operation");
+  };
+  local_t *l = e->get_type() == AST_VARIABLE ? lookup(static_cast<VariableAST *>(e)->name) : nullptr;
+  if(l && !l->memory) {
+    if(!st->postfix) {
+      add(l->reg, l->reg);
+      return l->reg;
+    }
+    int old = alloc();
+    emit(OP_MOV, old, l->reg);
+    add(l->reg, l->reg);
+    return old;
+  }
+  lvalue_t lv = lvalue(e);
+  int v = load(lv, ty), n = alloc();
+  add(n, v);
+  store(lv, n, ty);
+  return st->postfix ? v : n;
+}
+
+int VM::binary(BinaryAST *st) {
+  const std::string &op = st->op;
+  if(op == "&&" || op == "||") { // 0 or 1
+    int r = alloc();
+    std::vector<size_t> is_false;
+    branch(st, false, is_false);
+    emit(OP_KINT, r, 0, 1);
+    size_t to_end = emit(OP_JMP);
+    patch(is_false, here());
+    emit(OP_KINT, r, 0, 0);
+    patch({ to_end }, here());
+    return r;
+  }
+  llvm::Type *ty = st->conv.type;
+  if(!ty) { // pointer arithmetic
+    llvm::Type *lty = st->lhs->ctype.type, *rty = st->rhs->ctype.type;
+    if(!lty->isPointerTy() || !rty->isIntegerTy() || (op != "+" && op != "-"))
+      error("error: unknown operation");
+    int64_t size = size_of(lty->getPointerElementType()) * (op == "+" ? 1 : -1);
+    int p = expr(st->lhs), r = alloc();
+    if(is_int(st->rhs)) {
+      int64_t offset = size * static_cast<NumberAST *>(st->rhs)->i_number;
+      if(offset == (int32_t)offset) {
+        emit(OP_ADDI64, r, p, offset);
+        return r;
+      }
+    }
+    emit(OP_INDEX, r, p, expr(st->rhs), size);
+    return r;
+  }
+  bool is_double = ty->isDoubleTy(), wide = !is_double && !ty->isPointerTy() && ty->getIntegerBitWidth() > 32;
+  bool is_unsigned = st->conv.is_unsigned() || ty->isPointerTy();
+  int l = convert(expr(st->lhs), st->lhs->ctype, st->conv);
+  // x + 1, x - 1
+  if(is_int(st->rhs) && !is_double && !ty->isPointerTy() && (op == "+" || op == "-")) {
+    int64_t n = static_cast<NumberAST *>(st->rhs)->i_number;
+    if(op == "-") n = -n;
+    if(n == (int32_t)n) {
+      int r = alloc();
+      emit(wide ? OP_ADDI64 : OP_ADDI32, r, l, n);
+      return r;
+    }
+  }
+  int rhs = convert(expr(st->rhs), st->rhs->ctype, st->conv), r = alloc();
+  static const char *const cmps[] = { "==", "!=", "<", "<=", ">", ">=" };
+  int k = std::find(cmps, cmps + 6, op) - cmps;
+  if(k < 6) {
+    if(is_double) emit(OP_FEQ + k, r, l, rhs);
+    else emit(OP_EQ + (is_unsigned && k >= 2 ? k + 4 : k), r, l, rhs);
+    return r;
+  }
+  int code = -1;
+  if(is_double) {
+    code = op == "+" ? OP_FADD : op == "-" ? OP_FSUB : op == "*" ? OP_FMUL : op == "/" ? OP_FDIV : -1;
+  } else if(ty->isIntegerTy()) {
+    int base = wide ? OP_ADD64 : OP_ADD32;
+    code = op == "+" ? base : op == "-" ? base + 1 : op == "*" ? base + 2 :
+           op == "/" ? base + (is_unsigned ? 4 : 3) : op == "%" ? base + (is_unsigned ? 6 : 5) :
+           op == "<<" ? base + 7 : op == ">>" ? base + (is_unsigned ? 9 : 8) :
+           op == "&" ? OP_AND : op == "|" ? OP_OR : op == "^" ? OP_XOR : -1;
+  }
+  if(code < 0) error("error: unknown operation");
+  emit(code, r, l, rhs);
+  return r;
+}
+
+int VM::ternary(TernaryAST *st) {
+  std::vector<size_t> to_else, to_end;
+  branch(st->cond, false, to_else);
+  bool is_void = !st->ctype.type || st->ctype.type->isVoidTy();
+  int r = alloc(), mark = top_reg;
+  int v = expr(st->then_expr);
+  if(!is_void) move(r, convert(v, st->then_expr->ctype, st->ctype), mark);
+  top_reg = mark;
+  to_end.push_back(emit(OP_JMP));
+  patch(to_else, here());
+  v = expr(st->else_expr);
+  if(!is_void) move(r, convert(v, st->else_expr->ctype, st->ctype), mark);
+  top_reg = mark;
+  patch(to_end, here());
+  return r;
+}
+
+// the value is evaluated before where it goes, as codegen does
+int VM::assign(AsgmtAST *st) {
+  llvm::Type *ty = st->ctype.type;
+  if(st->dst->get_type() == AST_VARIABLE) {
+    local_t *l = lookup(static_cast<VariableAST *>(st->dst)->name);
+    if(l && !l->memory) {
+      int mark = top_reg;
+      move(l->reg, convert(expr(st->src), st->src->ctype, st->ctype), mark);
+      top_reg = mark;
+      return l->reg;
+    }
+  }
+  int r = expr(st->src);
+  if(!is_aggregate(ty)) r = convert(r, st->src->ctype, st->ctype);
+  lvalue_t lv = lvalue(st->dst);
+  store(lv, r, ty);
+  return is_aggregate(ty) ? address(lv) : r;
+}
+
+// the arguments go to consecutive registers, the callee's first, and the
+// result to the first of them
+int VM::call(FunctionCallAST *st) {
+  function_t *g = nullptr;
+  if(st->func_id >= 0) g = function(static_cast<VariableAST *>(st->callee)->name);
+  int fp = g ? -1 : expr(st->callee);
+  if(st->ctype.type->isStructTy()) error("error: -interp: functions returning structs are not supported");
+  bool native = !g || !g->def;
+
+  int base = top_reg;
+  for(size_t i = 0; i < std::max<size_t>(st->args.size(), 1); i++) alloc();
+  callsite_t cs;
+  cs.ret = st->ctype.type;
+  int ints = 0, fps = 0;
+  for(size_t i = 0; i < st->args.size(); i++) {
+    int mark = top_reg;
+    ctype_t to = st->args_type[i];
+    move(base + i, convert(expr(st->args[i]), st->args[i]->ctype, to), mark);
+    top_reg = mark;
+    if(is_aggregate(to.type)) {
+      if(g && !g->def) error("error: -interp: structs can't be passed to '%s' by value", g->name.c_str());
+      cs.structs = true;
+    }
+    // C's callee may count on the upper bits, as clang's does
+    if(native && to.is_unsigned() && to.type->isIntegerTy() && to.type->getIntegerBitWidth() < 32)
+      emit(to.type->isIntegerTy(8) ? OP_ZEXT8 : OP_ZEXT16, base + i, base + i);
+    bool is_double = to.type->isDoubleTy();
+    cs.fp.push_back(is_double);
+    (is_double ? fps : ints)++;
+  }
+  if(native && std::max(ints - 6, 0) + std::max(fps - 8, 0) > (int)max_stack_args)
+    error("error: -interp: too many arguments in a call to C");
+  if(g && g->def) {
+    emit(OP_CALL, base, base, g->index);
+  } else if(g) {
+    cs.addr = native_symbol(g);
+    cur->calls.push_back(cs);
+    emit(OP_CALLN, base, base, cur->calls.size() - 1);
+  } else {
+    cur->calls.push_back(cs);
+    emit(OP_CALLI, base, base, cur->calls.size() - 1, fp);
+  }
+  top_reg = base + 1;
+  return base;
+}
+
+// Codegen::convert, for values as registers hold them
+int VM::convert(int r, ctype_t from, ctype_t to) {
+  llvm::Type *vty = from.type, *ty = to.type;
+  if(!vty || !ty || ty->isVoidTy() || vty == ty) return r;
+  if(!vty->isSingleValueType() || !ty->isSingleValueType()) return r;
+  bool from_unsigned = from.is_unsigned() || vty->isIntegerTy(1);
+  unsigned from_bits = vty->isIntegerTy() ? vty->getIntegerBitWidth() : 64;
+  unsigned to_bits = ty->isIntegerTy() ? ty->getIntegerBitWidth() : 64;
+  auto op = [&](int code, int src) {
+    int t = alloc();
+    emit(code, t, src);
+    return t;
+  };
+  auto narrow = [&](int src) {
+    if(to_bits >= 64) return src;
+    return op(to_bits == 1 ? OP_TRUNC1 : to_bits == 8 ? OP_SEXT8 : to_bits == 16 ? OP_SEXT16 : OP_SEXT32, src);
+  };
+  // an unsigned value as the 64 bits it stands for
+  auto widen = [&](int src) {
+    if(!from_unsigned || from_bits == 1 || from_bits >= 64) return src;
+    return op(from_bits == 8 ? OP_ZEXT8 : from_bits == 16 ? OP_ZEXT16 : OP_ZEXT32, src);
+  };
+  if(vty->isIntegerTy() && ty->isIntegerTy()) {
+    if(from_bits > to_bits) return narrow(r);
+    return widen(r);
+  } else if(vty->isIntegerTy() && ty->isDoubleTy()) {
+    return op(from_unsigned && from_bits == 64 ? OP_U2F : OP_I2F, widen(r));
+  } else if(vty->isDoubleTy() && ty->isIntegerTy()) {
+    return narrow(op(to.is_unsigned() && to_bits == 64 ? OP_F2U : OP_F2I, r));
+  } else if(vty->isIntegerTy() && ty->isPointerTy()) { // zero-extended
+    if(from_bits >= 64 || from_bits == 1) return r;
+    return op(from_bits == 8 ? OP_ZEXT8 : from_bits == 16 ? OP_ZEXT16 : OP_ZEXT32, r);
+  } else if(vty->isPointerTy() && ty->isIntegerTy()) {
+    return narrow(r);
+  }
+  return r;
+}
+
+VM::value_t VM::call_native(const callsite_t &cs, void *addr, const value_t *args) {
+  uint64_t i[6] = {}, s[max_stack_args] = {};
+  double f[8] = {};
+  size_t ni = 0, nf = 0, ns = 0;
+  for(size_t n = 0; n < cs.fp.size(); n++) {
+    if(cs.fp[n] && nf < 8) f[nf++] = args[n].d;
+    else if(!cs.fp[n] && ni < 6) i[ni++] = args[n].u;
+    else s[ns++] = args[n].u;
+  }
+#define NATIVE_ARGS i[0], i[1], i[2], i[3], i[4], i[5], f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], \
+  s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8], s[9], s[10], s[11], s[12], s[13], s[14], s[15]
+  value_t ret;
+  if(cs.ret->isDoubleTy()) ret.d = ((double_fn_t)addr)(NATIVE_ARGS);
+  else ret.u = ((int_fn_t)addr)(NATIVE_ARGS);
+#undef NATIVE_ARGS
+  return canonical(ret, cs.ret);
+}
+
+// runs f, whose arguments are in its first registers. 'exec(nullptr,
+// nullptr)' only tells finish() where each instruction is handled
+VM::value_t VM::exec(function_t *f, value_t *regs) {
+  static const void *const table[] = {
+#define VM_OP_LABEL(name) &&op_##name,
+    VM_OPS(VM_OP_LABEL)
+#undef VM_OP_LABEL
+  };
+  if(!f) {
+    labels = table;
+    return value_t();
+  }
+  const insn_t *code = f->code.data(), *pc = code;
+  const value_t *k = f->consts.data();
+  char *frame = msp;
+  function_t *g;
+  value_t ret;
+  if(frame + f->frame_size > memory_end) error("error: -interp: stack overflow");
+  msp = frame + f->frame_size;
+
+#define A regs[pc->a]
+#define B regs[pc->b]
+#define C regs[pc->c]
+#define NEXT() goto *(++pc)->label
+#define JUMP_IF(cond) do { pc = (cond) ? code + pc->d : pc + 1; goto *pc->label; } while(0)
+#define ARITH32(name, expr) op_##name: { uint32_t b = B.i, c = C.i; (void)b, (void)c; A.i = (int32_t)(expr); } NEXT();
+#define ARITH64(name, expr) op_##name: { uint64_t b = B.u, c = C.u; (void)b, (void)c; A.u = (expr); } NEXT();
+
+  goto *pc->label;
+op_MOV:   A = B; NEXT();
+op_KINT:  A.i = pc->c; NEXT();
+op_KVAL:  A = k[pc->c]; NEXT();
+op_FRAME: A.p = frame + pc->c; NEXT();
+
+ARITH32(ADD32, b + c)
+ARITH32(SUB32, b - c)
+ARITH32(MUL32, b * c)
+op_SDIV32: A.i = (int32_t)B.i / (int32_t)C.i; NEXT();
+ARITH32(UDIV32, b / c)
+op_SREM32: A.i = (int32_t)B.i % (int32_t)C.i; NEXT();
+ARITH32(UREM32, b % c)
+ARITH32(SHL32, b << (c & 31))
+op_SAR32: A.i = (int32_t)B.i >> (C.i & 31); NEXT();
+ARITH32(SHR32, b >> (c & 31))
+ARITH64(ADD64, b + c)
+ARITH64(SUB64, b - c)
+ARITH64(MUL64, b * c)
+op_SDIV64: A.i = B.i / C.i; NEXT();
+ARITH64(UDIV64, b / c)
+op_SREM64: A.i = B.i % C.i; NEXT();
+ARITH64(UREM64, b % c)
+ARITH64(SHL64, b << (c & 63))
+op_SAR64: A.i = B.i >> (C.i & 63); NEXT();
+ARITH64(SHR64, b >> (c & 63))
+op_ADDI32: A.i = (int32_t)((uint32_t)B.i + (uint32_t)pc->c); NEXT();
+op_ADDI64: A.u = B.u + (uint64_t)(int64_t)pc->c; NEXT();
+op_NEG32:  A.i = (int32_t)(0u - (uint32_t)B.i); NEXT();
+op_NEG64:  A.u = 0 - B.u; NEXT();
+op_NOT:    A.i = ~B.i; NEXT();
+op_LNOT:   A.i = !B.i; NEXT();
+op_AND:    A.i = B.i & C.i; NEXT();
+op_OR:     A.i = B.i | C.i; NEXT();
+op_XOR:    A.i = B.i ^ C.i; NEXT();
+
+op_FADD: A.d = B.d + C.d; NEXT();
+op_FSUB: A.d = B.d - C.d; NEXT();
+op_FMUL: A.d = B.d * C.d; NEXT();
+op_FDIV: A.d = B.d / C.d; NEXT();
+
+op_EQ:  A.i = B.i == C.i; NEXT();
+op_NE:  A.i = B.i != C.i; NEXT();
+op_LT:  A.i = B.i <  C.i; NEXT();
+op_LE:  A.i = B.i <= C.i; NEXT();
+op_GT:  A.i = B.i >  C.i; NEXT();
+op_GE:  A.i = B.i >= C.i; NEXT();
+op_ULT: A.i = B.u <  C.u; NEXT();
+op_ULE: A.i = B.u <= C.u; NEXT();
+op_UGT: A.i = B.u >  C.u; NEXT();
+op_UGE: A.i = B.u >= C.u; NEXT();
+op_FEQ: A.i = B.d == C.d; NEXT();
+op_FNE: A.i = B.d < C.d || B.d > C.d; NEXT(); // ordered, false for NaN
+op_FLT: A.i = B.d <  C.d; NEXT();
+op_FLE: A.i = B.d <= C.d; NEXT();
+op_FGT: A.i = B.d >  C.d; NEXT();
+op_FGE: A.i = B.d >= C.d; NEXT();
+
+op_SEXT8:  A.i = (int8_t)B.i; NEXT();
+op_SEXT16: A.i = (int16_t)B.i; NEXT();
+op_SEXT32: A.i = (int32_t)B.i; NEXT();
+op_ZEXT8:  A.i = (uint8_t)B.i; NEXT();
+op_ZEXT16: A.i = (uint16_t)B.i; NEXT();
+op_ZEXT32: A.i = (uint32_t)B.i; NEXT();
+op_TRUNC1: A.i = B.i & 1; NEXT();
+op_I2F: A.d = (double)B.i; NEXT();
+op_U2F: A.d = (double)B.u; NEXT();
+op_F2I: A.i = (int64_t)B.d; NEXT();
+op_F2U: A.u = (uint64_t)B.d; NEXT();
+
+op_INDEX:   A.p = B.p + C.i * pc->d; NEXT();
+op_LOAD8:   A.i = *(int8_t  *)(B.p + pc->d); NEXT();
+op_LOAD16:  A.i = *(int16_t *)(B.p + pc->d); NEXT();
+op_LOAD32:  A.i = *(int32_t *)(B.p + pc->d); NEXT();
+op_LOAD64:  A.i = *(int64_t *)(B.p + pc->d); NEXT();
+op_STORE8:  *(int8_t  *)(A.p + pc->d) = B.i; NEXT();
+op_STORE16: *(int16_t *)(A.p + pc->d) = B.i; NEXT();
+op_STORE32: *(int32_t *)(A.p + pc->d) = B.i; NEXT();
+op_STORE64: *(int64_t *)(A.p + pc->d) = B.i; NEXT();
+op_COPY: memmove(A.p, B.p, pc->d); NEXT();
+op_ZERO: memset(A.p, 0, pc->d); NEXT();
+
+op_JMP:   pc = code + pc->d; goto *pc->label;
+op_JZ:    JUMP_IF(!A.i);
+op_JNZ:   JUMP_IF(A.i);
+op_JEQ:   JUMP_IF(A.i == B.i);
+op_JNE:   JUMP_IF(A.i != B.i);
+op_JLT:   JUMP_IF(A.i <  B.i);
+op_JLE:   JUMP_IF(A.i <= B.i);
+op_JGT:   JUMP_IF(A.i >  B.i);
+op_JGE:   JUMP_IF(A.i >= B.i);
+op_JULT:  JUMP_IF(A.u <  B.u);
+op_JULE:  JUMP_IF(A.u <= B.u);
+op_JUGT:  JUMP_IF(A.u >  B.u);
+op_JUGE:  JUMP_IF(A.u >= B.u);
+op_JEQI:  JUMP_IF(A.i == pc->c);
+op_JNEI:  JUMP_IF(A.i != pc->c);
+op_JLTI:  JUMP_IF(A.i <  pc->c);
+op_JLEI:  JUMP_IF(A.i <= pc->c);
+op_JGTI:  JUMP_IF(A.i >  pc->c);
+op_JGEI:  JUMP_IF(A.i >= pc->c);
+
+op_CALL:
+  g = by_index[pc->c];
+call:
+  if(!g->compiled) compile(g);
+  if(regs + pc->b + g->nregs > stack_end) error("error: -interp: stack overflow");
+  ret = exec(g, regs + pc->b);
+  A = ret;
+  NEXT();
+op_CALLN:
+  top = regs + f->nregs;
+  ret = call_native(f->calls[pc->c], f->calls[pc->c].addr, regs + pc->b);
+  A = ret;
+  NEXT();
+op_CALLI: { // an interpreted function is called as such
+    auto t = thunked.find(regs[pc->d].p);
+    if(t != thunked.end()) {
+      g = t->second;
+      goto call;
+    }
+  }
+  if(f->calls[pc->c].structs) error("error: -interp: structs can't be passed to C by value");
+  top = regs + f->nregs;
+  ret = call_native(f->calls[pc->c], regs[pc->d].p, regs + pc->b);
+  A = ret;
+  NEXT();
+op_RET:
+  ret = A;
+  msp = frame;
+  return ret;
+op_RETV:
+  msp = frame;
+  return value_t();
+
+#undef A
+#undef B
+#undef C
+#undef NEXT
+#undef JUMP_IF
+#undef ARITH32
+#undef ARITH64
+}
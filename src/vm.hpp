@@ -0,0 +1,204 @@
+#pragma once
+
+#include "common.hpp"
+#include "ast.hpp"
+#include "struct.hpp"
+
+// the instructions of the VM, see VM::exec. a, b, c and d are registers,
+// immediates, constants or code positions, as each says. comparisons and
+// their jumps keep the same order (see VM::branch)
+#define VM_OPS(X) \
+  X(MOV)    /* a = b */ \
+  X(KINT)   /* a = c */ \
+  X(KVAL)   /* a = consts[c] */ \
+  X(FRAME)  /* a = the frame's memory + c */ \
+  X(ADD32) X(SUB32) X(MUL32) X(SDIV32) X(UDIV32) X(SREM32) X(UREM32) X(SHL32) X(SAR32) X(SHR32) /* a = b op c */ \
+  X(ADD64) X(SUB64) X(MUL64) X(SDIV64) X(UDIV64) X(SREM64) X(UREM64) X(SHL64) X(SAR64) X(SHR64) \
+  X(ADDI32) X(ADDI64) /* a = b + c */ \
+  X(NEG32) X(NEG64) X(NOT) X(LNOT) /* a = op b */ \
+  X(AND) X(OR) X(XOR) \
+  X(FADD) X(FSUB) X(FMUL) X(FDIV) \
+  X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) X(ULT) X(ULE) X(UGT) X(UGE) /* a = b op c, 0 or 1 */ \
+  X(FEQ) X(FNE) X(FLT) X(FLE) X(FGT) X(FGE) \
+  X(SEXT8) X(SEXT16) X(SEXT32) X(ZEXT8) X(ZEXT16) X(ZEXT32) X(TRUNC1) /* a = op b */ \
+  X(I2F) X(U2F) X(F2I) X(F2U) \
+  X(INDEX)  /* a = b + c * d */ \
+  X(LOAD8) X(LOAD16) X(LOAD32) X(LOAD64)     /* a = *(b + d) */ \
+  X(STORE8) X(STORE16) X(STORE32) X(STORE64) /* *(a + d) = b */ \
+  X(COPY)   /* d bytes from b to a */ \
+  X(ZERO)   /* d bytes at a */ \
+  X(JMP)    /* to d */ \
+  X(JZ) X(JNZ) /* to d, if a is (not) 0 */ \
+  X(JEQ) X(JNE) X(JLT) X(JLE) X(JGT) X(JGE) X(JULT) X(JULE) X(JUGT) X(JUGE) /* to d, if a op b */ \
+  X(JEQI) X(JNEI) X(JLTI) X(JLEI) X(JGTI) X(JGEI) /* to d, if a op c */ \
+  X(CALL)   /* a = functions[c](b...) */ \
+  X(CALLN)  /* a = the C function of calls[c](b...) */ \
+  X(CALLI)  /* a = (*d)(b...), either */ \
+  X(RET) X(RETV) /* return a, or nothing */
+
+// -interp: runs main() on a bytecode of qcc's own instead of compiling it
+// with llvm, for programs that take less time to run than the JIT takes to
+// start. each function is compiled on its first call from its AST, as Sema
+// left it, to a register bytecode, and the bytecode is run by exec(), a
+// loop that jumps from instruction to instruction through computed gotos.
+//
+// registers are the 64-bit slots of a stack, a window of it per call: a
+// function's parameters are its first registers, so a call is its
+// arguments, lined up above the caller's registers. scalars whose address
+// is never taken live in registers, everything else in memory of the frame,
+// and globals and string literals in memory of their own: pointers are
+// real, so C gets them as they are.
+// calls into C (libc, or whatever qcc is linked with) go through a bridge
+// for the x86-64 System V convention, see call_native(). C gets an
+// interpreted function as the address of a thunk, which calls back into
+// the VM.
+class VM {
+  public:
+    union value_t {
+      int64_t i; // integers, sign-extended from their width, signed or not
+      uint64_t u;
+      double d;
+      char *p;
+    };
+  private:
+    enum op_t {
+#define VM_OP_ENUM(name) OP_##name,
+      VM_OPS(VM_OP_ENUM)
+#undef VM_OP_ENUM
+    };
+    struct insn_t {
+      union {
+        intptr_t op;       // while it's compiled
+        const void *label; // then where exec handles it, see finish()
+      };
+      int32_t a, b, c, d;
+    };
+    // a call into C
+    struct callsite_t {
+      void *addr = nullptr; // for CALLN
+      std::vector<bool> fp; // the arguments that go in floating-point registers
+      llvm::Type *ret;
+      bool structs = false; // passes one by value, which only interpreted functions take
+    };
+    struct function_t {
+      std::string name;
+      int index;
+      FunctionDefAST *def = nullptr; // null for C functions
+      bool compiled = false;
+      std::vector<insn_t> code;
+      std::vector<value_t> consts;
+      std::vector<callsite_t> calls;
+      int nregs = 0;
+      int32_t frame_size = 0; // bytes of memory
+      void *native = nullptr; // what C knows it by: the symbol, or a thunk into the VM
+    };
+    struct local_t {
+      llvm::Type *type;
+      int qual;
+      int reg;
+      bool memory; // reg holds its address
+    };
+    struct global_t {
+      llvm::Type *type = nullptr;
+      int qual = 0;
+      char *addr = nullptr;
+      bool external = false; // declared extern only, looked up in the process once used
+    };
+    struct lvalue_t {
+      int reg;
+      int32_t offset;
+    };
+
+    std::deque<function_t> funcs; // pointers stay valid as more are added
+    std::vector<function_t *> by_index;
+    std::unordered_map<std::string, function_t *> by_name;
+    std::map<std::string, global_t> globals;
+    std::vector<void *> allocations; // of globals
+    std::map<std::string, const char *> strings;
+    std::deque<std::string> string_data;
+    function_t init; // the initializers of the globals, run before main
+    std::vector<function_t *> slots; // thunk n calls slots[n]
+    std::unordered_map<void *, function_t *> thunked; // by their thunk
+
+    std::unique_ptr<value_t[]> stack;
+    value_t *stack_end;
+    value_t *top = nullptr; // above the registers in use, when C is called
+    std::unique_ptr<char[]> memory;
+    char *memory_end;
+    char *msp = nullptr; // above the frames in use
+
+    static thread_local VM *running;
+    static const void *const *labels; // of exec, by op
+
+    // the function being compiled
+    function_t *cur = nullptr;
+    int top_reg = 0; // registers above are free
+    int32_t frame_top = 0; // memory of the frame above is free
+    size_t landing = ~(size_t)0; // the last position jumped to
+    std::vector<std::map<std::string, local_t>> scopes;
+    std::vector<std::vector<size_t>> breaks, continues; // jumps to patch
+
+    value_t exec(function_t *, value_t *regs);
+    static value_t call_native(const callsite_t &, void *addr, const value_t *args);
+
+    function_t *function(const std::string &);
+    void *native_symbol(function_t *);
+    void *address_of(function_t *);
+    global_t *global(const std::string &);
+    const char *string(const std::string &);
+    uint64_t size_of(llvm::Type *);
+    local_t *lookup(const std::string &);
+
+    void load(AST_vec &);
+    void declare_globals(VarDeclarationAST *);
+    void init_globals(VarDeclarationAST *);
+    void compile(function_t *);
+    void finish(function_t *);
+
+    size_t emit(int op, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0);
+    int alloc();
+    int constant(value_t);
+    int load_int(int64_t);
+    int load_ptr(const void *);
+    size_t here();
+    bool falls_through();
+    void patch(const std::vector<size_t> &, size_t);
+    void move(int dst, int r, int mark);
+    int32_t frame_alloc(llvm::Type *);
+
+    void statement(AST *);
+    void declare_locals(VarDeclarationAST *);
+    void branch(AST *, bool when, std::vector<size_t> &jumps);
+    int expr(AST *);
+    int variable(VariableAST *);
+    int unary(UnaryAST *);
+    int step(UnaryAST *);
+    int binary(BinaryAST *);
+    int ternary(TernaryAST *);
+    int assign(AsgmtAST *);
+    int call(FunctionCallAST *);
+    int convert(int, ctype_t from, ctype_t to);
+    lvalue_t lvalue(AST *);
+    int address(lvalue_t);
+    int load(lvalue_t, llvm::Type *);
+    void store(lvalue_t, int, llvm::Type *);
+    void init_memory(lvalue_t, llvm::Type *, int qual, AST *);
+  public:
+    StructList struct_list;
+    UnionList   union_list;
+    bool time_report = false;
+    double frontend_ms = 0; // reported along with the VM's own times
+    double compile_ms = 0;
+    size_t instructions = 0;
+
+    VM();
+    ~VM();
+    int run(AST_vec &, const std::vector<std::string> &args);
+    // where the thunks C calls interpreted functions through come in
+    static value_t enter(int slot, const uint64_t *ints, const double *fps);
+};
+
+// the data layout of x86-64 System V, the only target -interp runs on. it
+// needs no target machine, which takes longer to make than most programs
+// take to run here
+extern const char *const host_data_layout;
@@ -0,0 +1,113 @@
+#include "qcc.hpp"
+#include "pool.hpp"
+
+// -whole-program: the files are compiled to bitcode side by side as usual,
+// then linked into one module in a unit of their own. everything but main
+// and -export=... becomes internal, so the link-time pipeline may inline
+// across files, propagate constants into functions it sees every call of
+// and drop what's unused. one output comes out, of the kind -c, -S and -exe
+// ask for.
+
+static void make_internal(llvm::GlobalValue &gv, const std::set<std::string> &exports) {
+  if(gv.isDeclaration() || gv.hasLocalLinkage() || gv.getName().startswith("llvm.")) return;
+  if(exports.count(gv.getName().str())) return;
+  gv.setLinkage(llvm::GlobalValue::InternalLinkage);
+  gv.setVisibility(llvm::GlobalValue::DefaultVisibility);
+}
+
+int QCC::run_whole_program(const std::vector<std::string> &files) {
+  if(run_jit) error("error: -whole-program can't be used with -run");
+  if(emit_ast) error("error: -whole-program can't be used with -emit-ast");
+  auto begin = std::chrono::steady_clock::now();
+  // at least -O2, or there's nothing to gain
+  int opt = std::max(opt_level, 2);
+
+  // each file's bitcode, in memory: its module lives in the job's own context
+  std::vector<llvm::SmallVector<char, 0>> bcs(files.size());
+  std::vector<int> status(files.size(), 1);
+  Pool pool(std::min<size_t>(jobs, files.size()));
+  for(size_t i = 0; i < files.size(); i++) {
+    pool.add([&, i](unsigned) {
+        QCC job(argc, argv);
+        job.copy_options(*this);
+        job.batch = files.size() > 1;
+        job.jobs = 1;
+        job.time_report = false;
+        job.emit_llvm_ir = false; // that's for the whole program
+        job.whole_program = false;
+        job.incremental = false; // nothing is written
+        job.compile_cache = false;
+        job.set_opt_level(opt, size_level);
+        job.set_output(OUTPUT_NONE, false);
+        job.set_bitcode(&bcs[i]);
+        status[i] = job.compile(files[i]);
+    });
+  }
+  pool.run();
+  if(std::any_of(status.begin(), status.end(), [](int s) { return s != 0; })) return 1;
+  auto compiled = std::chrono::steady_clock::now();
+
+  UNIT.reset(new unit_t);
+  unit = UNIT.get();
+  int result = 0;
+  std::string obj; // for -exe
+  try {
+    unit->target_machine = create_target_machine(opt);
+    unit->mod = new llvm::Module("QCC", unit->context);
+    unit->mod->setTargetTriple(unit->target_machine->getTargetTriple().str());
+    unit->mod->setDataLayout(unit->target_machine->createDataLayout());
+    for(size_t i = 0; i < files.size(); i++) {
+      llvm::StringRef bc(bcs[i].data(), bcs[i].size());
+      auto m = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bc, files[i]), unit->context);
+      if(!m) error("error: %s: %s", files[i].c_str(), m.getError().message().c_str());
+      // symbols defined twice are reported here, as a linker would
+      if(llvm::Linker::linkModules(*unit->mod, std::move(*m)))
+        error("error: can't link '%s' into the program", files[i].c_str());
+      llvm::SmallVector<char, 0>().swap(bcs[i]); // its module is in the program now
+    }
+
+    std::set<std::string> keep(exports.begin(), exports.end());
+    keep.insert("main");
+    for(auto &f : *unit->mod) make_internal(f, keep);
+    for(auto &gv : unit->mod->globals()) make_internal(gv, keep);
+    if(time_report) llvm::TimePassesIsEnabled = true;
+    optimize_whole_program(*unit->mod, unit->target_machine, opt, size_level);
+    if(time_report) llvm::TimerGroup::printAll(llvm::errs());
+    if(emit_llvm_ir) unit->mod->dump();
+
+    std::string out = out_file_name;
+    if(link) {
+      char tmp[] = "/tmp/qcc-XXXXXX.o";
+      int fd = mkstemps(tmp, 2);
+      if(fd < 0) error("error: can't create a temporary file");
+      close(fd);
+      out = obj = tmp;
+    }
+    {
+      std::error_code EC;
+      llvm::raw_fd_ostream os(out, EC, llvm::sys::fs::F_None);
+      if(EC) error("error: can't write '%s': %s", out.c_str(), EC.message().c_str());
+      if(output == OUTPUT_BITCODE) llvm::WriteBitcodeToFile(unit->mod, os);
+      else emit_native(*unit->mod, os, output == OUTPUT_ASM ?
+          llvm::TargetMachine::CGFT_AssemblyFile : llvm::TargetMachine::CGFT_ObjectFile);
+    }
+    if(link) {
+      bool linked = run_linker({obj}, out_file_name);
+      if(!linked) error("error: linking '%s' failed", out_file_name.c_str());
+    }
+  } catch(compile_error &e) {
+    puts(e.what());
+    result = 1;
+  }
+  if(!obj.empty()) unlink(obj.c_str());
+  unit = nullptr;
+
+  if(time_report) {
+    auto ms = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+      return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    llvm::errs() << "whole program: " << files.size() << " files compiled in " << ms(begin, compiled)
+                 << " ms, linked and optimized in " << ms(compiled, std::chrono::steady_clock::now()) << " ms\n";
+  }
+  return result;
+}
@@ -0,0 +1,29 @@
+int fibo(int n) {
+  if(n < 2) return n;
+  return fibo(n - 1) + fibo(n - 2);
+}
+
+int sum_sq(int n) {
+  int a[16], i, s;
+  for(i = 0; i < n; i++) a[i] = i * i;
+  s = 0;
+  for(i = 0; i < n; i++) s += a[i];
+  return s;
+}
+
+double half(double x) __attribute__((const));
+double half(double x) { return x / 2; }
+
+int g = fibo(20);
+int h = sum_sq(10);
+double d = half(3.0);
+
+int test() {
+  int n = 10;
+  if(g != 6765) return 1;
+  if(h != 285) return 1;
+  if(d != 1.5) return 1;
+  if(fibo(n) != 55) return 1;
+  if(sum_sq(4) != 14) return 1;
+  return 0;
+}
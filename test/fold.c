@@ -0,0 +1,18 @@
+enum { N = 3 };
+
+int g = N * 4 + 1;
+double d = 1.0 / 4;
+
+int test() {
+  if(0) return 1;
+  if(1) {
+    if(g != 13) return 1;
+  } else return 1;
+  while(0) return 1;
+  if((N << 2) - 1 != 11) return 1;
+  if(d != 0.25) return 1;
+  if(!(0 && g) != 1) return 1;
+  if(-7 / 2 != -3 || -7 % 2 != -1) return 1;
+  if((int)2.9 + (1 ? 2 : 3) != 4) return 1;
+  return g * 1 - 0 == 13 ? 0 : 1;
+}
@@ -6,6 +6,17 @@ A a1, a2;
 int a[2], i = 100;
 char *s;
 
+// initializers that take the address of what's defined further down
+int sum(int a, int b);
+int (*op)(int, int) = sum;
+extern int n;
+int *pn = &n;
+int n = 3;
+
+int sum(int a, int b) {
+  return a + b;
+}
+
 int test() {
-  return 0;
+  return op(*pn, 2) == 5 ? 0 : 1;
 }
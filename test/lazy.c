@@ -0,0 +1,22 @@
+// what headers bring: prototypes and static functions, mostly unused.
+// only what's referenced ends up in the module
+
+int puts(char *);
+int abs(int);
+static int unused_twice(int x) { return x + x; }
+static int unused_caller() { return unused_twice(1); }
+
+static int is_even(int);
+static int is_odd(int n) { return n == 0 ? 0 : is_even(n - 1); }
+static int is_even(int n) { return n == 0 ? 1 : is_odd(n - 1); }
+
+static inline int square(int x) { return x * x; }
+static int sub(int a, int b) { return a - b; }
+
+int test() {
+  int (*f)(int, int) = sub;
+  if(!is_even(10) || is_odd(10)) return 1;
+  if(square(7) != 49) return 1;
+  if(f(5, 3) != 2) return 1;
+  return 0;
+}
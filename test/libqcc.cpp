@@ -0,0 +1,22 @@
+#include "../src/libqcc.hpp"
+
+// compiles from memory, with a header only in memory, and calls the result
+int main() {
+  Compiler qcc;
+  qcc.headers["answer.h"] = "#define ANSWER 42\n";
+  auto jit = qcc.compile_jit("answer.c", "#include \"answer.h\"\nint answer(int x) { return ANSWER + x; }\n");
+  if(!jit) return 1;
+  auto answer = (int (*)(int))jit->address("answer");
+  if(!answer || answer(1) != 43) return 1;
+
+  llvm::SmallVector<char, 0> obj;
+  if(!qcc.compile_object("answer.c", "int answer() { return 42; }\n", obj) || obj.empty()) return 1;
+
+  // errors are reported, not fatal
+  if(qcc.compile_module("bad.c", "int f() { return y; }\n")) return 1;
+  if(qcc.diags.empty() || qcc.diags.back().kind != DIAG_ERROR || qcc.diags.back().file != "bad.c") return 1;
+  if(!qcc.compile_module("answer.c", "int answer() { return 42; }\n")) return 1;
+
+  puts("test/libqcc ... \x1b[32mOK\x1b[39m");
+  return 0;
+}
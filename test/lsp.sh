@@ -0,0 +1,32 @@
+#!/bin/sh
+# a short session with ./qcc --lsp: open a file, go to a definition, an edit
+# re-parsed on its own, then one that breaks a declaration and one that
+# fixes it, both re-parsed without the rest
+msg() { printf 'Content-Length: %d\r\n\r\n%s' "${#1}" "$1"; }
+uri="file://$PWD/test/lsp.c" # in memory only
+src='int twice(int x) { return x + x; }\nint main() {\n  return twice(1);\n}\n'
+out=$(mktemp) err=$(mktemp)
+{
+  msg '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+  msg '{"jsonrpc":"2.0","method":"initialized","params":{}}'
+  msg '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"'"$uri"'","languageId":"c","version":1,"text":"'"$src"'"}}}'
+  msg '{"jsonrpc":"2.0","id":2,"method":"textDocument/definition","params":{"textDocument":{"uri":"'"$uri"'"},"position":{"line":2,"character":10}}}'
+  # twice(1) to twice(2)
+  msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'"$uri"'","version":2},"contentChanges":[{"range":{"start":{"line":2,"character":15},"end":{"line":2,"character":16}},"text":"2"}]}}'
+  # main loses its '{'
+  msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'"$uri"'","version":3},"contentChanges":[{"range":{"start":{"line":1,"character":11},"end":{"line":1,"character":12}},"text":""}]}}'
+  # and gets it back
+  msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'"$uri"'","version":4},"contentChanges":[{"range":{"start":{"line":1,"character":11},"end":{"line":1,"character":11}},"text":"{"}]}}'
+  msg '{"jsonrpc":"2.0","id":3,"method":"shutdown"}'
+  msg '{"jsonrpc":"2.0","method":"exit"}'
+} | ./qcc --lsp > $out 2> $err
+status=$?
+grep -q '"definitionProvider":true' $out &&
+  grep -q '"id":2,"jsonrpc":"2.0","result":\[{"range":{"end":{"character":9,"line":0},"start":{"character":4,"line":0}}' $out &&
+  grep -q '1 of 2 declarations re-parsed' $err &&
+  grep -q '"severity":1' $out &&
+  test "$(grep -c 'declarations parsed' $err)" = 1 &&
+  test "$(grep -o '"diagnostics":\[[^]]*\]' $out | tail -1)" = '"diagnostics":[]'
+r=$?
+rm -f $out $err
+test $status = 0 && test $r = 0
@@ -0,0 +1,23 @@
+int calls;
+
+int bump() {
+  calls++;
+  return 1;
+}
+
+int test() {
+  unsigned int u = 4294967295;
+  char c = -1;
+  int a[10];
+  double d = 0.5;
+  if(u / 2 != 2147483647) return 1;
+  if(!(u > 1)) return 1;
+  if((u >> 31) != 1) return 1;
+  if((unsigned)-1 % 10 != 5) return 1;
+  if(c != -1) return 1;
+  if(c + 1 != 0) return 1;
+  if(sizeof(a) != 40) return 1;
+  if(sizeof(bump()) != 4 || calls != 0) return 1;
+  if(!d) return 1;
+  return 0;
+}
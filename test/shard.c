@@ -0,0 +1,59 @@
+// more functions than one shard holds, for -j<n>. static ones and string
+// literals are used from functions that may end up in another shard
+
+static int twice(int x) { return x * 2; }
+
+static char *name = "shard";
+
+int f0(int x) { return twice(x) + 0; }
+int f1(int x) { return twice(x) + 1; }
+int f2(int x) { return twice(x) + 2; }
+int f3(int x) { return twice(x) + 3; }
+int f4(int x) { return twice(x) + 4; }
+int f5(int x) { return twice(x) + 5; }
+int f6(int x) { return twice(x) + 6; }
+int f7(int x) { return twice(x) + 7; }
+int f8(int x) { return twice(x) + 8; }
+int f9(int x) { return twice(x) + 9; }
+int f10(int x) { return twice(x) + 10; }
+int f11(int x) { return twice(x) + 11; }
+int f12(int x) { return twice(x) + 12; }
+int f13(int x) { return twice(x) + 13; }
+int f14(int x) { return twice(x) + 14; }
+int f15(int x) { return twice(x) + 15; }
+int f16(int x) { return twice(x) + 16; }
+int f17(int x) { return twice(x) + 17; }
+int f18(int x) { return twice(x) + 18; }
+int f19(int x) { return twice(x) + 19; }
+int f20(int x) { return twice(x) + 20; }
+int f21(int x) { return twice(x) + 21; }
+int f22(int x) { return twice(x) + 22; }
+int f23(int x) { return twice(x) + 23; }
+int f24(int x) { return twice(x) + 24; }
+int f25(int x) { return twice(x) + 25; }
+int f26(int x) { return twice(x) + 26; }
+int f27(int x) { return twice(x) + 27; }
+int f28(int x) { return twice(x) + 28; }
+int f29(int x) { return twice(x) + 29; }
+int f30(int x) { return twice(x) + 30; }
+int f31(int x) { return twice(x) + 31; }
+int f32(int x) { return twice(x) + 32; }
+int f33(int x) { return twice(x) + 33; }
+int f34(int x) { return twice(x) + 34; }
+int f35(int x) { return twice(x) + 35; }
+int f36(int x) { return twice(x) + 36; }
+int f37(int x) { return twice(x) + 37; }
+int f38(int x) { return twice(x) + 38; }
+int f39(int x) { return twice(x) + 39; }
+
+int test() {
+  int s = 0;
+  s += f0(1) + f1(1) + f2(1) + f3(1) + f4(1) + f5(1) + f6(1) + f7(1);
+  s += f8(1) + f9(1) + f10(1) + f11(1) + f12(1) + f13(1) + f14(1) + f15(1);
+  s += f16(1) + f17(1) + f18(1) + f19(1) + f20(1) + f21(1) + f22(1) + f23(1);
+  s += f24(1) + f25(1) + f26(1) + f27(1) + f28(1) + f29(1) + f30(1) + f31(1);
+  s += f32(1) + f33(1) + f34(1) + f35(1) + f36(1) + f37(1) + f38(1) + f39(1);
+  if(s != 860) return 1;
+  if(name[0] != 's' || name[4] != 'd') return 1;
+  return 0;
+}
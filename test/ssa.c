@@ -0,0 +1,44 @@
+int add_to(int *p, int n) {
+  *p = *p + n;
+  return *p;
+}
+
+int fib(int n) {
+  int a = 0, b = 1;
+  while(n--) {
+    int t = a + b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+int sum_odd(int n) {
+  int s = 0;
+  for(int i = 0; i < n; i++) {
+    if(i % 2 == 0) continue;
+    if(i > 9) break;
+    s += i;
+  }
+  return s;
+}
+
+int test() {
+  int x = 1, y;
+  double d = 1.5;
+  if(fib(10) != 55) return 1;
+  if(sum_odd(100) != 25) return 1;
+  // x lives in memory once its address is taken
+  add_to(&x, 2);
+  if(x != 3) return 1;
+  y = x > 2 ? 10 : 20;
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++) {
+      if(j == i) continue;
+      y++;
+    }
+  if(y != 16) return 1;
+  d = d * 2;
+  if(d != 3.0) return 1;
+  return 0;
+}
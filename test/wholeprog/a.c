@@ -0,0 +1,10 @@
+int scale(int);
+extern int calls;
+
+int test() {
+  int i, s = 0;
+  for(i = 0; i < 10; i++) s += scale(i);
+  if(s != 90) return 1;
+  if(calls != 10) return 1;
+  return 0;
+}
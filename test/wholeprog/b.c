@@ -0,0 +1,8 @@
+// only a.c calls scale, so -whole-program can inline it there and drop it
+static int factor = 2;
+int calls;
+
+int scale(int x) {
+  calls++;
+  return x * factor;
+}
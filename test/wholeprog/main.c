@@ -0,0 +1,7 @@
+// for -whole-program: main(), test() and what test() calls are each in a
+// file of their own. see the Makefile
+int test();
+
+int main() {
+  return test();
+}